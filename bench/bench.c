@@ -0,0 +1,399 @@
+// Headless benchmarks over a synthetic document: save/load, PDF export, page
+// and tile rendering (the code the canvas draws pages with) and hit-testing.
+// Prints a table, optionally writes the results as JSON and compares them with
+// an earlier result file. Run with: make bench [BENCH_ARGS="..."]
+#include <gtk/gtk.h>
+#include <json-glib/json-glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "pdf_export.h"
+#include "render.h"
+#include "serialize.h"
+#include "synth.h"
+
+typedef struct {
+    Document *doc;
+    gchar *dir;                 // scratch directory for written files
+    int hit_queries;
+    int hits;                   // from the first hit_test run, -1 before it
+} Bench;
+
+typedef struct {
+    const char *name;
+    gboolean (*run)(Bench *bench);
+    const char *description;
+} Scenario;
+
+typedef struct {
+    const char *name;
+    int iterations;
+    double min_ms, median_ms, mean_ms;
+} Result;
+
+static gchar *scratch_path(Bench *bench, const char *name) {
+    return g_build_filename(bench->dir, name, NULL);
+}
+
+static gboolean run_save(Bench *bench) {
+    gchar *path = scratch_path(bench, "doc.json");
+    gboolean ok = document_save_to_file(bench->doc, path, NULL);
+    g_free(path);
+    return ok;
+}
+
+static gboolean run_load(Bench *bench) {
+    gchar *path = scratch_path(bench, "doc.json");
+    if (!g_file_test(path, G_FILE_TEST_EXISTS)) document_save_to_file(bench->doc, path, NULL);
+    Document *doc = document_load_from_file(path, NULL);
+    g_free(path);
+    if (!doc) return FALSE;
+    document_free(doc);
+    return TRUE;
+}
+
+static gboolean run_pdf(Bench *bench, PdfExportProfile profile) {
+    PdfExportOptions options;
+    pdf_export_options_init_profile(&options, profile);
+    gchar *path = scratch_path(bench, "doc.pdf");
+    gboolean ok = export_document_to_pdf(bench->doc, path, &options, NULL);
+    g_free(path);
+    return ok;
+}
+
+static gboolean run_pdf_lossless(Bench *bench) { return run_pdf(bench, PDF_EXPORT_LOSSLESS); }
+static gboolean run_pdf_balanced(Bench *bench) { return run_pdf(bench, PDF_EXPORT_BALANCED); }
+
+// Every page at 100% zoom, as the canvas page cache renders them.
+static gboolean run_render_pages(Bench *bench) {
+    for (guint i = 0; i < bench->doc->pages->len; i++) {
+        cairo_surface_t *s = render_page_to_surface(g_ptr_array_index(bench->doc->pages, i), 1.0, 1);
+        if (!s) return FALSE;
+        cairo_surface_destroy(s);
+    }
+    return TRUE;
+}
+
+// Every tile of the first page at 400% on a HiDPI screen, as the canvas tile
+// cache renders them when zoomed in.
+static gboolean run_render_tiles(Bench *bench) {
+    Page *page = g_ptr_array_index(bench->doc->pages, 0);
+    int cols, rows;
+    render_page_tile_grid(4.0, 2, &cols, &rows);
+    for (int ty = 0; ty < rows; ty++) {
+        for (int tx = 0; tx < cols; tx++) {
+            cairo_surface_t *s = render_page_tile(page, 4.0, 2, tx, ty);
+            if (!s) return FALSE;
+            cairo_surface_destroy(s);
+        }
+    }
+    return TRUE;
+}
+
+// The points come from a fixed seed, so every run must find the same hits.
+static gboolean run_hit_test(Bench *bench) {
+    GRand *rand = g_rand_new_with_seed(7);
+    int hits = 0;
+    for (guint i = 0; i < bench->doc->pages->len; i++) {
+        Page *page = g_ptr_array_index(bench->doc->pages, i);
+        for (int q = 0; q < bench->hit_queries; q++) {
+            double x = g_rand_double_range(rand, 0, A4_WIDTH_PT), y = g_rand_double_range(rand, 0, A4_HEIGHT_PT);
+            if (page_item_at(page, x, y)) hits++;
+        }
+    }
+    g_rand_free(rand);
+    if (bench->hits < 0) bench->hits = hits;
+    return hits == bench->hits;
+}
+
+static const Scenario scenarios[] = {
+    { "save", run_save, "document_save_to_file" },
+    { "load", run_load, "document_load_from_file" },
+    { "pdf_lossless", run_pdf_lossless, "export_document_to_pdf, lossless profile" },
+    { "pdf_balanced", run_pdf_balanced, "export_document_to_pdf, balanced profile" },
+    { "render_pages", run_render_pages, "render_page_to_surface of every page at 100%" },
+    { "render_tiles", run_render_tiles, "render_page_tile of page 1 at 400%, scale 2" },
+    { "hit_test", run_hit_test, "page_item_at, random points on every page" },
+};
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// One untimed warm-up run (decodes images, fills caches), then iterations.
+static gboolean measure(Bench *bench, const Scenario *sc, int iterations, Result *out) {
+    if (!sc->run(bench)) return FALSE;
+    double *ms = g_new(double, iterations);
+    double sum = 0;
+    for (int i = 0; i < iterations; i++) {
+        gint64 start = g_get_monotonic_time();
+        gboolean ok = sc->run(bench);
+        ms[i] = (g_get_monotonic_time() - start) / 1000.0;
+        sum += ms[i];
+        if (!ok) {
+            g_free(ms);
+            return FALSE;
+        }
+    }
+    qsort(ms, iterations, sizeof(double), compare_double);
+    out->name = sc->name;
+    out->iterations = iterations;
+    out->min_ms = ms[0];
+    out->median_ms = iterations % 2 ? ms[iterations / 2] : (ms[iterations / 2 - 1] + ms[iterations / 2]) / 2;
+    out->mean_ms = sum / iterations;
+    g_free(ms);
+    return TRUE;
+}
+
+static gboolean write_results(const char *path, const SynthParams *params, int hit_queries, GArray *results,
+                              GError **error) {
+    JsonBuilder *b = json_builder_new();
+    json_builder_begin_object(b);
+    json_builder_set_member_name(b, "document");
+    json_builder_begin_object(b);
+    json_builder_set_member_name(b, "pages");
+    json_builder_add_int_value(b, params->pages);
+    json_builder_set_member_name(b, "images_per_page");
+    json_builder_add_int_value(b, params->images_per_page);
+    json_builder_set_member_name(b, "image_width");
+    json_builder_add_int_value(b, params->image_width);
+    json_builder_set_member_name(b, "image_height");
+    json_builder_add_int_value(b, params->image_height);
+    json_builder_set_member_name(b, "distinct_images");
+    json_builder_add_int_value(b, params->distinct_images);
+    json_builder_set_member_name(b, "strokes_per_page");
+    json_builder_add_int_value(b, params->strokes_per_page);
+    json_builder_set_member_name(b, "points_per_stroke");
+    json_builder_add_int_value(b, params->points_per_stroke);
+    json_builder_set_member_name(b, "seed");
+    json_builder_add_int_value(b, params->seed);
+    json_builder_set_member_name(b, "hit_queries");
+    json_builder_add_int_value(b, hit_queries);
+    json_builder_end_object(b);
+    json_builder_set_member_name(b, "results");
+    json_builder_begin_array(b);
+    for (guint i = 0; i < results->len; i++) {
+        Result *r = &g_array_index(results, Result, i);
+        json_builder_begin_object(b);
+        json_builder_set_member_name(b, "name");
+        json_builder_add_string_value(b, r->name);
+        json_builder_set_member_name(b, "iterations");
+        json_builder_add_int_value(b, r->iterations);
+        json_builder_set_member_name(b, "min_ms");
+        json_builder_add_double_value(b, r->min_ms);
+        json_builder_set_member_name(b, "median_ms");
+        json_builder_add_double_value(b, r->median_ms);
+        json_builder_set_member_name(b, "mean_ms");
+        json_builder_add_double_value(b, r->mean_ms);
+        json_builder_end_object(b);
+    }
+    json_builder_end_array(b);
+    json_builder_end_object(b);
+
+    JsonGenerator *gen = json_generator_new();
+    JsonNode *root = json_builder_get_root(b);
+    json_generator_set_root(gen, root);
+    json_generator_set_pretty(gen, TRUE);
+    gboolean ok = json_generator_to_file(gen, path, error);
+    json_node_free(root);
+    g_object_unref(gen);
+    g_object_unref(b);
+    return ok;
+}
+
+// Baselines measured on another document are skipped with a warning
+#define BASELINE_MISMATCH g_quark_from_static_string("bench-baseline-mismatch")
+
+// Fails unless the baseline was measured on a document made with the same
+// parameters; timings of different documents are not comparable. Files from
+// before hit_queries was recorded are taken to match it.
+static gboolean same_document(JsonObject *obj, const SynthParams *params, int hit_queries, GError **error) {
+    const struct { const char *name; gint64 value; gboolean required; } expected[] = {
+        { "pages", params->pages, TRUE },
+        { "images_per_page", params->images_per_page, TRUE },
+        { "image_width", params->image_width, TRUE },
+        { "image_height", params->image_height, TRUE },
+        { "distinct_images", params->distinct_images, TRUE },
+        { "strokes_per_page", params->strokes_per_page, TRUE },
+        { "points_per_stroke", params->points_per_stroke, TRUE },
+        { "seed", params->seed, TRUE },
+        { "hit_queries", hit_queries, FALSE },
+    };
+    JsonObject *doc = obj && json_object_has_member(obj, "document") ? json_object_get_object_member(obj, "document")
+                                                                      : NULL;
+    if (!doc) {
+        g_set_error(error, BASELINE_MISMATCH, 0, "no document parameters recorded");
+        return FALSE;
+    }
+    for (guint i = 0; i < G_N_ELEMENTS(expected); i++) {
+        if (!json_object_has_member(doc, expected[i].name)) {
+            if (!expected[i].required) continue;
+            g_set_error(error, BASELINE_MISMATCH, 0, "%s not recorded", expected[i].name);
+            return FALSE;
+        }
+        gint64 value = json_object_get_int_member(doc, expected[i].name);
+        if (value != expected[i].value) {
+            g_set_error(error, BASELINE_MISMATCH, 0,
+                        "measured with %s %" G_GINT64_FORMAT ", this run uses %" G_GINT64_FORMAT,
+                        expected[i].name, value, expected[i].value);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Median of each scenario in an earlier result file, by name, if it was
+// measured on the same document.
+static GHashTable *read_baseline(const char *path, const SynthParams *params, int hit_queries, GError **error) {
+    JsonParser *parser = json_parser_new();
+    if (!json_parser_load_from_file(parser, path, error)) {
+        g_object_unref(parser);
+        return NULL;
+    }
+    JsonNode *root = json_parser_get_root(parser);
+    JsonObject *obj = root && JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+    if (!same_document(obj, params, hit_queries, error)) {
+        g_object_unref(parser);
+        return NULL;
+    }
+    GHashTable *medians = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    JsonArray *arr = obj && json_object_has_member(obj, "results") ? json_object_get_array_member(obj, "results") : NULL;
+    for (guint i = 0; arr && i < json_array_get_length(arr); i++) {
+        JsonObject *r = json_array_get_object_element(arr, i);
+        if (!r || !json_object_has_member(r, "name") || !json_object_has_member(r, "median_ms")) continue;
+        double *median = g_new(double, 1);
+        *median = json_object_get_double_member(r, "median_ms");
+        g_hash_table_insert(medians, g_strdup(json_object_get_string_member(r, "name")), median);
+    }
+    g_object_unref(parser);
+    return medians;
+}
+
+static gboolean scenario_selected(const Scenario *sc, gchar **only) {
+    if (!only) return TRUE;
+    for (int i = 0; only[i]; i++) if (g_strcmp0(only[i], sc->name) == 0) return TRUE;
+    return FALSE;
+}
+
+int main(int argc, char **argv) {
+    SynthParams params;
+    synth_params_init(&params);
+    int iterations = 5, hit_queries = 100000, seed = (int)params.seed;
+    double threshold = 10.0;
+    gchar *size = NULL, *only = NULL, *output = NULL, *baseline = NULL;
+    gboolean list = FALSE;
+    GOptionEntry entries[] = {
+        { "pages", 0, 0, G_OPTION_ARG_INT, &params.pages, "Pages in the document (10)", "N" },
+        { "images", 0, 0, G_OPTION_ARG_INT, &params.images_per_page, "Images per page (6)", "M" },
+        { "image-size", 0, 0, G_OPTION_ARG_STRING, &size, "Pixels of each image (1600x1200)", "WxH" },
+        { "distinct-images", 0, 0, G_OPTION_ARG_INT, &params.distinct_images, "Different images shared by the items (8)", "N" },
+        { "strokes", 0, 0, G_OPTION_ARG_INT, &params.strokes_per_page, "Strokes per page (20)", "K" },
+        { "points", 0, 0, G_OPTION_ARG_INT, &params.points_per_stroke, "Points per stroke (200)", "P" },
+        { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Generator seed (1)", "S" },
+        { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Timed runs per scenario (5)", "R" },
+        { "hit-queries", 0, 0, G_OPTION_ARG_INT, &hit_queries, "Hit tests per page and run (100000)", "Q" },
+        { "only", 0, 0, G_OPTION_ARG_STRING, &only, "Comma-separated scenarios to run", "NAMES" },
+        { "list", 0, 0, G_OPTION_ARG_NONE, &list, "List the scenarios and exit", NULL },
+        { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the results as JSON", "FILE" },
+        { "baseline", 'b', 0, G_OPTION_ARG_FILENAME, &baseline, "Compare with an earlier --output file", "FILE" },
+        { "threshold", 0, 0, G_OPTION_ARG_DOUBLE, &threshold, "Median slowdown in % counted as a regression (10)", "PCT" },
+        { NULL, 0, 0, 0, NULL, NULL, NULL }
+    };
+    GError *error = NULL;
+    GOptionContext *ctx = g_option_context_new("- cheatsheet-maker benchmarks");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        return 2;
+    }
+    g_option_context_free(ctx);
+    if (list) {
+        for (guint i = 0; i < G_N_ELEMENTS(scenarios); i++) printf("%-14s %s\n", scenarios[i].name, scenarios[i].description);
+        return 0;
+    }
+    if (size && sscanf(size, "%dx%d", &params.image_width, &params.image_height) != 2) {
+        fprintf(stderr, "--image-size must look like 1600x1200\n");
+        return 2;
+    }
+    params.seed = (guint32)seed;
+    params.pages = MAX(1, params.pages);
+    iterations = MAX(1, iterations);
+    hit_queries = MAX(1, hit_queries);
+
+    GHashTable *base = NULL;
+    if (baseline && !(base = read_baseline(baseline, &params, hit_queries, &error))) {
+        if (!g_error_matches(error, BASELINE_MISMATCH, 0)) {
+            fprintf(stderr, "Cannot read baseline: %s\n", error->message);
+            return 2;
+        }
+        fprintf(stderr, "Not comparing with %s: %s\n", baseline, error->message);
+        g_clear_error(&error);
+    }
+
+    Bench bench = { 0 };
+    bench.hit_queries = hit_queries;
+    bench.hits = -1;
+    bench.dir = g_dir_make_tmp("cheatsheet-bench-XXXXXX", &error);
+    if (!bench.dir) {
+        fprintf(stderr, "%s\n", error->message);
+        return 2;
+    }
+    gint64 start = g_get_monotonic_time();
+    bench.doc = synth_document(&params);
+    printf("Document: %d pages x %d images of %dx%d (%d distinct), %d strokes x %d points; generated in %.0f ms\n",
+           params.pages, params.images_per_page, params.image_width, params.image_height, params.distinct_images,
+           params.strokes_per_page, params.points_per_stroke, (g_get_monotonic_time() - start) / 1000.0);
+    printf("%-14s %10s %10s %10s", "scenario", "min ms", "median ms", "mean ms");
+    if (base) printf(" %12s %8s", "baseline ms", "change");
+    printf("\n");
+
+    gchar **selected = only ? g_strsplit(only, ",", -1) : NULL;
+    GArray *results = g_array_new(FALSE, FALSE, sizeof(Result));
+    int status = 0;
+    for (guint i = 0; i < G_N_ELEMENTS(scenarios); i++) {
+        const Scenario *sc = &scenarios[i];
+        if (!scenario_selected(sc, selected)) continue;
+        Result r;
+        if (!measure(&bench, sc, iterations, &r)) {
+            printf("%-14s FAILED\n", sc->name);
+            status = 1;
+            continue;
+        }
+        g_array_append_val(results, r);
+        printf("%-14s %10.2f %10.2f %10.2f", r.name, r.min_ms, r.median_ms, r.mean_ms);
+        double *old = base ? g_hash_table_lookup(base, r.name) : NULL;
+        if (old && *old > 0) {
+            double change = (r.median_ms - *old) / *old * 100.0;
+            gboolean regressed = change > threshold;
+            if (regressed) status = 1;
+            printf(" %12.2f %+7.1f%%%s", *old, change, regressed ? "  REGRESSION" : "");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (output && !write_results(output, &params, hit_queries, results, &error)) {
+        fprintf(stderr, "Cannot write results: %s\n", error->message);
+        g_clear_error(&error);
+        status = 2;
+    }
+
+    const char *scratch[] = { "doc.json", "doc.pdf" };
+    for (guint i = 0; i < G_N_ELEMENTS(scratch); i++) {
+        gchar *path = scratch_path(&bench, scratch[i]);
+        g_unlink(path);
+        g_free(path);
+    }
+    g_rmdir(bench.dir);
+    g_free(bench.dir);
+    document_free(bench.doc);
+    g_array_unref(results);
+    g_strfreev(selected);
+    if (base) g_hash_table_unref(base);
+    g_free(size);
+    g_free(only);
+    g_free(output);
+    g_free(baseline);
+    return status;
+}
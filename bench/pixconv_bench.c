@@ -0,0 +1,127 @@
+// Compares pixconv against gdk_cairo_surface_create_from_pixbuf() on a 4K
+// image: checks that every kernel set produces identical pixels, then times
+// each one. Every kernel set is also checked on odd widths, crop offsets and
+// padded rows, where the SIMD loops hand over to their scalar tails. Run with: make pixconv-bench && ./pixconv-bench [iterations]
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pixconv.h"
+
+#define WIDTH 3840
+#define HEIGHT 2160
+
+static GdkPixbuf *make_pixbuf(gboolean alpha) {
+    GdkPixbuf *pb = gdk_pixbuf_new(GDK_COLORSPACE_RGB, alpha, 8, WIDTH, HEIGHT);
+    guint8 *px = gdk_pixbuf_get_pixels(pb);
+    int stride = gdk_pixbuf_get_rowstride(pb);
+    int channels = gdk_pixbuf_get_n_channels(pb);
+    GRand *rand = g_rand_new_with_seed(42);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH * channels; x++) px[(gsize)y * stride + x] = (guint8)g_rand_int(rand);
+    }
+    g_rand_free(rand);
+    return pb;
+}
+
+static gboolean same_pixels(cairo_surface_t *a, cairo_surface_t *b) {
+    int h = cairo_image_surface_get_height(a);
+    int row = cairo_image_surface_get_width(a) * 4;
+    for (int y = 0; y < h; y++) {
+        const guint8 *ra = cairo_image_surface_get_data(a) + (gsize)y * cairo_image_surface_get_stride(a);
+        const guint8 *rb = cairo_image_surface_get_data(b) + (gsize)y * cairo_image_surface_get_stride(b);
+        if (memcmp(ra, rb, row) != 0) return FALSE;
+    }
+    return TRUE;
+}
+
+// Rows padded beyond what gdk_pixbuf_new() would use, so a kernel reading
+// past a row's pixels would pick up the wrong bytes
+#define EDGE_WIDTH 80
+#define EDGE_HEIGHT 9
+#define EDGE_PADDING 13
+
+static void free_pixels(guchar *pixels, gpointer data) {
+    (void)data;
+    g_free(pixels);
+}
+
+static GdkPixbuf *make_padded_pixbuf(gboolean alpha) {
+    int channels = alpha ? 4 : 3;
+    int stride = EDGE_WIDTH * channels + EDGE_PADDING;
+    guint8 *px = g_malloc((gsize)stride * EDGE_HEIGHT);
+    GRand *rand = g_rand_new_with_seed(7);
+    for (int i = 0; i < stride * EDGE_HEIGHT; i++) px[i] = (guint8)g_rand_int(rand);
+    g_rand_free(rand);
+    return gdk_pixbuf_new_from_data(px, GDK_COLORSPACE_RGB, alpha, 8, EDGE_WIDTH, EDGE_HEIGHT, stride, free_pixels, NULL);
+}
+
+// Sub-rectangles of every odd width around the SIMD block sizes, at several
+// offsets, against GDK's conversion of the same sub-pixbuf.
+static gboolean check_edges(GdkPixbuf *pb) {
+    static const int widths[] = { 1, 3, 7, 15, 17, 33 };
+    static const int xs[] = { 0, 1, 5, 30 };
+    static const int ys[] = { 0, 3 };
+    for (guint w = 0; w < G_N_ELEMENTS(widths); w++) {
+        for (guint i = 0; i < G_N_ELEMENTS(xs); i++) {
+            for (guint j = 0; j < G_N_ELEMENTS(ys); j++) {
+                int height = EDGE_HEIGHT - ys[j];
+                GdkPixbuf *sub = gdk_pixbuf_new_subpixbuf(pb, xs[i], ys[j], widths[w], height);
+                cairo_surface_t *expected = gdk_cairo_surface_create_from_pixbuf(sub, 1, NULL);
+                cairo_surface_t *got = pixconv_surface_from_pixbuf(pb, xs[i], ys[j], widths[w], height);
+                gboolean exact = got && same_pixels(expected, got);
+                if (got) cairo_surface_destroy(got);
+                cairo_surface_destroy(expected);
+                g_object_unref(sub);
+                if (!exact) {
+                    printf("    mismatch at %dx%d+%d+%d\n", widths[w], height, xs[i], ys[j]);
+                    return FALSE;
+                }
+            }
+        }
+    }
+    return TRUE;
+}
+
+static double time_gdk(GdkPixbuf *pb, int iterations) {
+    gint64 start = g_get_monotonic_time();
+    for (int i = 0; i < iterations; i++) cairo_surface_destroy(gdk_cairo_surface_create_from_pixbuf(pb, 1, NULL));
+    return (g_get_monotonic_time() - start) / 1000.0 / iterations;
+}
+
+static double time_pixconv(GdkPixbuf *pb, int iterations) {
+    gint64 start = g_get_monotonic_time();
+    for (int i = 0; i < iterations; i++) cairo_surface_destroy(pixconv_surface_from_pixbuf(pb, 0, 0, WIDTH, HEIGHT));
+    return (g_get_monotonic_time() - start) / 1000.0 / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? MAX(1, atoi(argv[1])) : 20;
+    const char *impls[] = { "scalar", "sse2", "avx2" };
+    int status = 0;
+
+    for (int alpha = 1; alpha >= 0; alpha--) {
+        GdkPixbuf *pb = make_pixbuf(alpha);
+        GdkPixbuf *padded = make_padded_pixbuf(alpha);
+        cairo_surface_t *expected = gdk_cairo_surface_create_from_pixbuf(pb, 1, NULL);
+        printf("%s %dx%d\n", alpha ? "RGBA" : "RGB", WIDTH, HEIGHT);
+        printf("  %-8s %8.2f ms\n", "gdk", time_gdk(pb, iterations));
+        for (guint i = 0; i < G_N_ELEMENTS(impls); i++) {
+            if (!pixconv_set_impl(impls[i])) {
+                printf("  %-8s unsupported on this CPU\n", impls[i]);
+                continue;
+            }
+            cairo_surface_t *got = pixconv_surface_from_pixbuf(pb, 0, 0, WIDTH, HEIGHT);
+            gboolean exact = got && same_pixels(expected, got);
+            if (got) cairo_surface_destroy(got);
+            gboolean edges = check_edges(padded);
+            if (!exact || !edges) status = 1;
+            printf("  %-8s %8.2f ms  %s, edges %s\n", impls[i], time_pixconv(pb, iterations),
+                   exact ? "bit-exact" : "MISMATCH", edges ? "bit-exact" : "MISMATCH");
+        }
+        cairo_surface_destroy(expected);
+        g_object_unref(padded);
+        g_object_unref(pb);
+    }
+    return status;
+}
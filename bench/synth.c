@@ -0,0 +1,111 @@
+#include "synth.h"
+
+void synth_params_init(SynthParams *params) {
+    params->pages = 10;
+    params->images_per_page = 6;
+    params->image_width = 1600;
+    params->image_height = 1200;
+    params->distinct_images = 8;
+    params->strokes_per_page = 20;
+    params->points_per_stroke = 200;
+    params->seed = 1;
+}
+
+static GdkPixbuf *make_photo(GRand *rand, int w, int h) {
+    GdkPixbuf *pb = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, w, h);
+    guint8 *px = gdk_pixbuf_get_pixels(pb);
+    int stride = gdk_pixbuf_get_rowstride(pb);
+    double hue = g_rand_double(rand);
+    for (int y = 0; y < h; y++) {
+        guint8 *row = px + (gsize)y * stride;
+        for (int x = 0; x < w; x++) {
+            int noise = g_rand_int_range(rand, -12, 13);
+            row[x * 3 + 0] = (guint8)CLAMP(255.0 * x / w + noise, 0, 255);
+            row[x * 3 + 1] = (guint8)CLAMP(255.0 * y / h + noise, 0, 255);
+            row[x * 3 + 2] = (guint8)CLAMP(255.0 * hue + noise, 0, 255);
+        }
+    }
+    return pb;
+}
+
+static GdkPixbuf *make_screenshot(GRand *rand, int w, int h) {
+    GdkPixbuf *pb = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, w, h);
+    gdk_pixbuf_fill(pb, 0xffffffff);
+    // Rows of dark "text" runs with the odd coloured panel
+    for (int y = 8; y + 10 < h; y += 18) {
+        int x = 8;
+        while (x < w - 8) {
+            int run = MIN(g_rand_int_range(rand, 10, 80), w - 8 - x);
+            guint32 color = g_rand_int_range(rand, 0, 10) == 0 ? 0x3366ccff : 0x202020ff;
+            GdkPixbuf *block = gdk_pixbuf_new_subpixbuf(pb, x, y, run, 10);
+            gdk_pixbuf_fill(block, color);
+            g_object_unref(block);
+            x += run + g_rand_int_range(rand, 6, 14);
+        }
+    }
+    return pb;
+}
+
+static ImageSource *make_source(GRand *rand, int index, int w, int h) {
+    gboolean photo = index % 2 == 0;
+    GdkPixbuf *pb = photo ? make_photo(rand, w, h) : make_screenshot(rand, w, h);
+    gchar *buffer = NULL;
+    gsize size = 0;
+    gboolean ok = photo ? gdk_pixbuf_save_to_buffer(pb, &buffer, &size, "jpeg", NULL, "quality", "90", NULL)
+                        : gdk_pixbuf_save_to_buffer(pb, &buffer, &size, "png", NULL, NULL);
+    ImageSource *src = NULL;
+    if (ok) {
+        GBytes *bytes = g_bytes_new_take(buffer, size);
+        src = image_source_new_from_bytes(bytes, NULL);
+        g_bytes_unref(bytes);
+    }
+    if (!src) src = image_source_new_from_pixbuf(pb);
+    g_object_unref(pb);
+    return src;
+}
+
+static Stroke *make_stroke(GRand *rand, int points) {
+    Stroke *s = stroke_new(g_rand_double(rand), g_rand_double(rand), g_rand_double(rand), 1.0,
+                           g_rand_double_range(rand, 1.0, 6.0));
+    double x = g_rand_double_range(rand, 0, A4_WIDTH_PT), y = g_rand_double_range(rand, 0, A4_HEIGHT_PT);
+    for (int i = 0; i < points; i++) {
+        x = CLAMP(x + g_rand_double_range(rand, -4, 4), 0, A4_WIDTH_PT);
+        y = CLAMP(y + g_rand_double_range(rand, -4, 4), 0, A4_HEIGHT_PT);
+        stroke_add_point(s, x, y);
+    }
+    return s;
+}
+
+Document *synth_document(const SynthParams *params) {
+    g_return_val_if_fail(params != NULL && params->pages > 0, NULL);
+    GRand *rand = g_rand_new_with_seed(params->seed);
+    int distinct = MAX(1, params->distinct_images);
+    ImageSource **sources = g_new0(ImageSource*, distinct);
+    for (int i = 0; i < distinct; i++) {
+        sources[i] = make_source(rand, i, MAX(1, params->image_width), MAX(1, params->image_height));
+    }
+
+    Document *doc = document_new();
+    int next = 0;
+    for (int p = 0; p < params->pages; p++) {
+        Page *page = p == 0 ? document_current_page(doc) : document_add_page(doc);
+        for (int i = 0; i < params->images_per_page; i++) {
+            ImageItem *it = image_item_new_from_source(sources[next++ % distinct]);
+            double scale = g_rand_double_range(rand, 0.3, 1.0);
+            it->width *= scale;
+            it->height *= scale;
+            it->x = g_rand_double_range(rand, 0, MAX(1.0, A4_WIDTH_PT - it->width));
+            it->y = g_rand_double_range(rand, 0, MAX(1.0, A4_HEIGHT_PT - it->height));
+            page_add_item(page, it);
+        }
+        for (int i = 0; i < params->strokes_per_page; i++) {
+            page_add_stroke(page, make_stroke(rand, params->points_per_stroke));
+        }
+    }
+    doc->current_page = 0;
+
+    for (int i = 0; i < distinct; i++) image_source_unref(sources[i]);
+    g_free(sources);
+    g_rand_free(rand);
+    return doc;
+}
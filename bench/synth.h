@@ -0,0 +1,25 @@
+#pragma once
+#include "document.h"
+
+G_BEGIN_DECLS
+
+// Parameters of a synthetic document. The same values and seed always give
+// the same document.
+typedef struct {
+    int pages;
+    int images_per_page;
+    int image_width, image_height;  // pixels of each source image
+    int distinct_images;            // sources shared round-robin by the items
+    int strokes_per_page;
+    int points_per_stroke;
+    guint32 seed;
+} SynthParams;
+
+void synth_params_init(SynthParams *params);
+
+// Builds a document as if the images had been imported from files: half of
+// the distinct images are noisy photos stored as JPEG, the others flat
+// screenshot-like blocks stored as PNG.
+Document *synth_document(const SynthParams *params);
+
+G_END_DECLS
@@ -1,12 +1,31 @@
 #include "canvas.h"
+#include "render.h"
+#include "layout.h"
+#include "page_cache.h"
+#include "perf_hud.h"
+#include "tile_cache.h"
+#include "trace.h"
 #include <math.h>
 
+// Rendered page bitmaps kept around: the current page plus up to two
+// neighbours on each side.
+#define PAGE_CACHE_CAPACITY 6
+// Pages whose bitmap would be larger than this are drawn in tiles instead.
+#define PAGE_CACHE_MAX_BYTES (64u * 1024u * 1024u)
+#define TILE_CACHE_MAX_BYTES (256u * 1024u * 1024u)
+// Continuous mode: widget pixels between stacked pages, and per wheel step.
+#define PAGE_GAP 24.0
+#define SCROLL_STEP 64.0
+// Full-quality rendering resumes once zoom/pan input has paused this long.
+#define SETTLE_DELAY_MS 150
+
 struct _CheatCanvas {
     GtkDrawingArea parent_instance;
     Document *doc;               // not owned
     double zoom;                 // screen pixels per point
     gboolean crop_mode;
     gboolean draw_mode;
+    gboolean continuous;         // all pages stacked vertically; pan_offset_y scrolls
 
     ImageItem *selected;
 
@@ -28,13 +47,47 @@ struct _CheatCanvas {
     double orig_x, orig_y, orig_w, orig_h;
     int orig_cx, orig_cy, orig_cw, orig_ch;
     double orig_pan_x, orig_pan_y;
+
+    // Render caches
+    PageCache *page_cache;
+    TileCache *tile_cache;       // high zoom, keyed by page uid and invalidated by damage
+    gint prefetch_generation;    // bumped on navigation; stale prefetch jobs drop their work
+    GHashTable *pending_renders; // stamps with a render job in flight for this generation
+    int visible_first, visible_last;
+    gboolean interactive;        // zoom/pan gesture in progress: reuse stale bitmaps, fast filtering
+    guint settle_id;
+
+    GArray *placeholders;        // Placeholder, images still loading
+    guint next_placeholder_id;
+
+    PerfHud *perf_hud;           // frame-time overlay, hidden by default
+    guint redraw_serial;         // bumped by every queued redraw
 };
 
+typedef struct {
+    guint id;
+    guint page_uid;              // page the image will land on
+    double x, y, w, h;           // page points
+} Placeholder;
+
 G_DEFINE_TYPE(CheatCanvas, cheat_canvas, GTK_TYPE_DRAWING_AREA)
 
-static void cheat_canvas_queue_redraw(CheatCanvas *self) { gtk_widget_queue_draw(GTK_WIDGET(self)); }
+enum { SIGNAL_PAGE_CHANGED, SIGNAL_CONTENT_CHANGED, N_SIGNALS };
+static guint canvas_signals[N_SIGNALS];
+
+static void cheat_canvas_queue_redraw(CheatCanvas *self) {
+    self->redraw_serial++;
+    gtk_widget_queue_draw(GTK_WIDGET(self));
+}
 
 static void draw_page_and_items(CheatCanvas *self, cairo_t *cr, int width, int height);
+static void canvas_prefetch_neighbours(CheatCanvas *self);
+static void canvas_scroll_to_page(CheatCanvas *self, int index);
+static void canvas_clamp_scroll(CheatCanvas *self, int alloc_h);
+static void canvas_sync_current_page(CheatCanvas *self);
+static void visible_page_range(CheatCanvas *self, int alloc_h, int *first, int *last);
+static int page_index_at(CheatCanvas *self, double sy);
+static void px_to_page_at(CheatCanvas *self, int index, double sx, double sy, double *out_px, double *out_py, int alloc_w, int alloc_h);
 static gboolean on_draw(GtkWidget *w, cairo_t *cr, gpointer user_data);
 static gboolean on_button_press(GtkWidget *w, GdkEventButton *ev, gpointer user_data);
 static gboolean on_button_release(GtkWidget *w, GdkEventButton *ev, gpointer user_data);
@@ -56,6 +109,18 @@ static void cheat_canvas_init(CheatCanvas *self) {
     self->draw_width = 2.0;
     self->pan_offset_x = 0.0;
     self->pan_offset_y = 0.0;
+    self->page_cache = page_cache_new(PAGE_CACHE_CAPACITY);
+    self->tile_cache = tile_cache_new(TILE_CACHE_MAX_BYTES);
+    self->prefetch_generation = 0;
+    self->pending_renders = g_hash_table_new(g_direct_hash, g_direct_equal);
+    self->continuous = FALSE;
+    self->visible_first = self->visible_last = -1;
+    self->interactive = FALSE;
+    self->settle_id = 0;
+    self->placeholders = g_array_new(FALSE, FALSE, sizeof(Placeholder));
+    self->next_placeholder_id = 1;
+    self->perf_hud = perf_hud_new();
+    self->redraw_serial = 0;
     gtk_widget_add_events(GTK_WIDGET(self), GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK |
                                               GDK_POINTER_MOTION_MASK | GDK_SCROLL_MASK);
     g_signal_connect(self, "draw", G_CALLBACK(on_draw), NULL);
@@ -69,12 +134,31 @@ static void cheat_canvas_dispose(GObject *obj) {
     CheatCanvas *self = CHEAT_CANVAS(obj);
     self->doc = NULL;
     self->selected = NULL;
+    g_atomic_int_inc(&self->prefetch_generation);
+    if (self->settle_id) {
+        g_source_remove(self->settle_id);
+        self->settle_id = 0;
+    }
+    g_clear_pointer(&self->page_cache, page_cache_free);
+    g_clear_pointer(&self->tile_cache, tile_cache_free);
+    g_clear_pointer(&self->pending_renders, g_hash_table_unref);
+    g_clear_pointer(&self->placeholders, g_array_unref);
+    g_clear_pointer(&self->perf_hud, perf_hud_free);
     G_OBJECT_CLASS(cheat_canvas_parent_class)->dispose(obj);
 }
 
 static void cheat_canvas_class_init(CheatCanvasClass *klass) {
     GObjectClass *gobj_class = G_OBJECT_CLASS(klass);
     gobj_class->dispose = cheat_canvas_dispose;
+
+    // Emitted when the current page follows the viewport in continuous mode
+    canvas_signals[SIGNAL_PAGE_CHANGED] = g_signal_new("page-changed", G_TYPE_FROM_CLASS(klass),
+                                                       G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
+                                                       G_TYPE_NONE, 0);
+    // Emitted whenever a page of the document is about to be edited
+    canvas_signals[SIGNAL_CONTENT_CHANGED] = g_signal_new("content-changed", G_TYPE_FROM_CLASS(klass),
+                                                          G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
+                                                          G_TYPE_NONE, 0);
 }
 
 GtkWidget *cheat_canvas_new(Document *doc) {
@@ -89,20 +173,284 @@ void cheat_canvas_set_document(CheatCanvas *self, Document *doc) {
     self->selected = NULL;
     self->pan_offset_x = 0.0;
     self->pan_offset_y = 0.0;
+    if (self->continuous && doc) canvas_scroll_to_page(self, doc->current_page);
+    canvas_prefetch_neighbours(self);
     cheat_canvas_queue_redraw(self);
 }
 
 Document *cheat_canvas_get_document(CheatCanvas *self) { return self->doc; }
 
-void cheat_canvas_zoom_in(CheatCanvas *self) { self->zoom *= 1.1; cheat_canvas_queue_redraw(self); }
-void cheat_canvas_zoom_out(CheatCanvas *self) { self->zoom /= 1.1; if (self->zoom < 0.2) self->zoom = 0.2; cheat_canvas_queue_redraw(self); }
+// Fetch the current page for editing. A snapshot may still share the page, in
+// which case it is cloned and the selection is moved onto the clone.
+static Page *canvas_page_for_write(CheatCanvas *self) {
+    Page *shared = document_current_page(self->doc);
+    gint sel_index = self->selected ? g_list_index(shared->items, self->selected) : -1;
+    Page *p = document_current_page_for_write(self->doc);
+    if (p != shared && sel_index >= 0) self->selected = (ImageItem*)g_list_nth_data(p->items, (guint)sel_index);
+    g_signal_emit(self, canvas_signals[SIGNAL_CONTENT_CHANGED], 0);
+    return p;
+}
+
+// Report an area of the current page (in page points) whose pixels change, so
+// tiles covering it are re-rendered. Padded for antialiased edges.
+static void canvas_damage_rect(CheatCanvas *self, double x, double y, double w, double h) {
+    if (!self->tile_cache || !self->doc) return;
+    tile_cache_invalidate(self->tile_cache, document_current_page(self->doc)->uid, x - 1, y - 1, w + 2, h + 2);
+}
+
+static void canvas_damage_item(CheatCanvas *self, ImageItem *it) {
+    canvas_damage_rect(self, it->x, it->y, it->width, it->height);
+}
+
+static void canvas_damage_stroke(CheatCanvas *self, Stroke *stroke) {
+    if (!stroke->points || stroke->points->len == 0) return;
+    Point *p0 = &g_array_index(stroke->points, Point, 0);
+    double x0 = p0->x, y0 = p0->y, x1 = p0->x, y1 = p0->y;
+    for (guint i = 1; i < stroke->points->len; i++) {
+        Point *pt = &g_array_index(stroke->points, Point, i);
+        x0 = MIN(x0, pt->x); y0 = MIN(y0, pt->y);
+        x1 = MAX(x1, pt->x); y1 = MAX(y1, pt->y);
+    }
+    double r = stroke->width / 2.0;
+    canvas_damage_rect(self, x0 - r, y0 - r, x1 - x0 + 2 * r, y1 - y0 + 2 * r);
+}
+
+// Neighbour prefetch: while the user is on page N, pages N±1 (and N±2 when
+// the image budget has room) are rendered into the page cache on the render
+// pool so that flipping to them only needs a blit. In continuous mode the
+// same jobs render the visible pages other than the current one, plus the
+// pages just above and below the viewport.
+
+typedef struct {
+    CheatCanvas *canvas;         // strong ref, released on the main thread
+    Page *page;                  // strong ref; edits clone the page instead of touching it
+    guint stamp;
+    double zoom;
+    int scale;
+    gint generation;
+    cairo_surface_t *surface;    // result
+} PrefetchJob;
+
+// A finished render is still worth caching if it matches the current zoom and
+// its page is queued again or within the widest prefetch reach of the visible
+// pages, even if the user moved a little since it was queued.
+static gboolean prefetch_wanted(CheatCanvas *self, const PrefetchJob *job) {
+    if (!self->doc || job->zoom != self->zoom || job->scale != gtk_widget_get_scale_factor(GTK_WIDGET(self))) return FALSE;
+    if (g_hash_table_contains(self->pending_renders, GUINT_TO_POINTER(job->stamp))) return TRUE;
+    int n = document_page_count(self->doc);
+    int lo = MAX(0, self->visible_first - 2), hi = MIN(n - 1, self->visible_last + 2);
+    for (int i = lo; i <= hi; i++) {
+        if (((Page*)g_ptr_array_index(self->doc->pages, i))->stamp == job->stamp) return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean prefetch_deliver(gpointer data) {
+    PrefetchJob *job = (PrefetchJob*)data;
+    CheatCanvas *self = job->canvas;
+    // Older jobs no longer own their pending entry; a newer job for the same
+    // stamp may hold it
+    gboolean current = job->generation == g_atomic_int_get(&self->prefetch_generation);
+    if (self->page_cache && current) g_hash_table_remove(self->pending_renders, GUINT_TO_POINTER(job->stamp));
+    if (self->page_cache && (current || prefetch_wanted(self, job))) {
+        if (job->surface) {
+            page_cache_insert(self->page_cache, job->stamp, job->zoom, job->scale, job->surface);
+            // A visible page may be showing its placeholder
+            if (self->continuous) cheat_canvas_queue_redraw(self);
+        }
+    }
+    if (job->surface) cairo_surface_destroy(job->surface);
+    page_unref(job->page);
+    g_object_unref(self);
+    g_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+static void prefetch_run(gpointer data) {
+    PrefetchJob *job = (PrefetchJob*)data;
+    // Skip work queued before the user moved on
+    if (job->generation == g_atomic_int_get(&job->canvas->prefetch_generation)) {
+        job->surface = render_page_to_surface(job->page, job->zoom, job->scale);
+    }
+    g_idle_add(prefetch_deliver, job);
+}
+
+// Queue a background render of p unless it is cached or already queued.
+static void canvas_request_render(CheatCanvas *self, Page *p, int scale, gint generation) {
+    if (page_cache_contains(self->page_cache, p->stamp, self->zoom, scale)) return;
+    if (g_hash_table_contains(self->pending_renders, GUINT_TO_POINTER(p->stamp))) return;
+    g_hash_table_add(self->pending_renders, GUINT_TO_POINTER(p->stamp));
+    PrefetchJob *job = g_new0(PrefetchJob, 1);
+    job->canvas = g_object_ref(self);
+    job->page = page_ref(p);
+    job->stamp = p->stamp;
+    job->zoom = self->zoom;
+    job->scale = scale;
+    job->generation = generation;
+    render_run_async(prefetch_run, job);
+}
+
+// High zoom: the visible tiles of a page are rendered in parallel on the
+// render pool, each job from its own reference to the page.
+
+typedef struct {
+    CheatCanvas *canvas;         // strong ref, released on the main thread
+    Page *page;                  // strong ref
+    TileKey key;
+    guint serial;
+    gint generation;
+    cairo_surface_t *surface;    // result, NULL if skipped
+} TileJob;
+
+static gboolean tile_deliver(gpointer data) {
+    TileJob *job = (TileJob*)data;
+    CheatCanvas *self = job->canvas;
+    if (self->tile_cache) {
+        tile_cache_finish_render(self->tile_cache, &job->key, job->serial, job->surface);
+        // Shows the tile, or asks for it again if the job was skipped
+        cheat_canvas_queue_redraw(self);
+    }
+    if (job->surface) cairo_surface_destroy(job->surface);
+    page_unref(job->page);
+    g_object_unref(self);
+    g_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+static void tile_run(gpointer data) {
+    TileJob *job = (TileJob*)data;
+    if (job->generation == g_atomic_int_get(&job->canvas->prefetch_generation)) {
+        job->surface = render_page_tile(job->page, job->key.zoom, job->key.scale, job->key.tx, job->key.ty);
+    }
+    g_idle_add(tile_deliver, job);
+}
+
+static void canvas_request_tile(CheatCanvas *self, Page *p, const TileKey *key) {
+    guint serial = tile_cache_begin_render(self->tile_cache, key);
+    if (!serial) return;
+    TileJob *job = g_new0(TileJob, 1);
+    job->canvas = g_object_ref(self);
+    job->page = page_ref(p);
+    job->key = *key;
+    job->serial = serial;
+    job->generation = g_atomic_int_get(&self->prefetch_generation);
+    render_run_async(tile_run, job);
+}
+
+static void canvas_prefetch_neighbours(CheatCanvas *self) {
+    gint generation = g_atomic_int_add(&self->prefetch_generation, 1) + 1;
+    if (self->pending_renders) g_hash_table_remove_all(self->pending_renders);
+    if (!self->doc || !self->page_cache) return;
+    int scale = gtk_widget_get_scale_factor(GTK_WIDGET(self));
+    int first, last;
+    visible_page_range(self, gtk_widget_get_allocated_height(GTK_WIDGET(self)), &first, &last);
+    self->visible_first = first;
+    self->visible_last = last;
+    if (render_page_surface_bytes(self->zoom, scale) > PAGE_CACHE_MAX_BYTES) return;
+    int reach = image_source_get_usage() < image_source_get_budget() / 2 ? 2 : 1;
+    int n = document_page_count(self->doc);
+    int lo = MAX(0, first - reach), hi = MIN(n - 1, last + reach);
+    page_cache_set_capacity(self->page_cache, MAX(PAGE_CACHE_CAPACITY, (guint)(hi - lo + 1)));
+
+    if (self->continuous) {
+        // Pages scrolled far away give their bitmaps back
+        guint *keep = g_new(guint, hi - lo + 1);
+        for (int i = lo; i <= hi; i++) keep[i - lo] = ((Page*)g_ptr_array_index(self->doc->pages, i))->stamp;
+        page_cache_retain(self->page_cache, keep, (guint)(hi - lo + 1));
+        g_free(keep);
+        // The current page is rendered synchronously by the draw handler
+        for (int i = first; i <= last; i++) {
+            if (i == self->doc->current_page) continue;
+            canvas_request_render(self, (Page*)g_ptr_array_index(self->doc->pages, i), scale, generation);
+        }
+    }
+    // Nearest pages first so they are ready soonest
+    for (int d = 1; d <= reach; d++) {
+        if (last + d < n) canvas_request_render(self, (Page*)g_ptr_array_index(self->doc->pages, last + d), scale, generation);
+        if (first - d >= 0) canvas_request_render(self, (Page*)g_ptr_array_index(self->doc->pages, first - d), scale, generation);
+    }
+}
+
+// Zoom and pan gestures: while input keeps coming, frames are composed from
+// whatever page bitmaps are cached, scaled to the new zoom, and anything drawn
+// directly uses fast image filtering. Once input pauses the view is rendered
+// again at full quality and the neighbours are prefetched at the final zoom.
+
+static gboolean canvas_settle(gpointer data) {
+    CheatCanvas *self = CHEAT_CANVAS(data);
+    self->settle_id = 0;
+    self->interactive = FALSE;
+    canvas_prefetch_neighbours(self);
+    cheat_canvas_queue_redraw(self);
+    return G_SOURCE_REMOVE;
+}
+
+static void canvas_begin_interaction(CheatCanvas *self) {
+    self->interactive = TRUE;
+    if (self->settle_id) g_source_remove(self->settle_id);
+    self->settle_id = g_timeout_add(SETTLE_DELAY_MS, canvas_settle, self);
+}
+
+// Zoom by factor keeping the page point under widget position (ax, ay) fixed.
+static void canvas_zoom_at(CheatCanvas *self, double factor, double ax, double ay) {
+    GtkAllocation alloc;
+    gtk_widget_get_allocation(GTK_WIDGET(self), &alloc);
+    int index = self->continuous && self->doc ? page_index_at(self, ay) : (self->doc ? self->doc->current_page : 0);
+
+    double px_before, py_before;
+    px_to_page_at(self, index, ax, ay, &px_before, &py_before, alloc.width, alloc.height);
+    self->zoom *= factor;
+    if (self->zoom < 0.2) self->zoom = 0.2;
+    double px_after, py_after;
+    px_to_page_at(self, index, ax, ay, &px_after, &py_after, alloc.width, alloc.height);
+
+    // Adjust pan offset to keep the same point under the cursor
+    self->pan_offset_x += (px_after - px_before) * self->zoom;
+    self->pan_offset_y += (py_after - py_before) * self->zoom;
+    canvas_clamp_scroll(self, alloc.height);
+    canvas_sync_current_page(self);
+    // Renders queued for the old zoom are no longer useful
+    g_atomic_int_inc(&self->prefetch_generation);
+    g_hash_table_remove_all(self->pending_renders);
+    canvas_begin_interaction(self);
+    cheat_canvas_queue_redraw(self);
+}
+
+void cheat_canvas_zoom_in(CheatCanvas *self) {
+    canvas_zoom_at(self, 1.1, gtk_widget_get_allocated_width(GTK_WIDGET(self)) / 2.0,
+                   gtk_widget_get_allocated_height(GTK_WIDGET(self)) / 2.0);
+}
+
+void cheat_canvas_zoom_out(CheatCanvas *self) {
+    canvas_zoom_at(self, 1.0 / 1.1, gtk_widget_get_allocated_width(GTK_WIDGET(self)) / 2.0,
+                   gtk_widget_get_allocated_height(GTK_WIDGET(self)) / 2.0);
+}
+
 void cheat_canvas_zoom_reset(CheatCanvas *self) { 
     self->zoom = 1.25; 
     self->pan_offset_x = 0.0;
     self->pan_offset_y = 0.0;
+    if (self->continuous && self->doc) canvas_scroll_to_page(self, self->doc->current_page);
+    canvas_prefetch_neighbours(self);
     cheat_canvas_queue_redraw(self); 
 }
 
+void cheat_canvas_set_continuous(CheatCanvas *self, gboolean continuous) {
+    g_return_if_fail(CHEAT_IS_CANVAS(self));
+    if (self->continuous == continuous) return;
+    self->continuous = continuous;
+    self->pan_offset_x = 0.0;
+    self->pan_offset_y = 0.0;
+    if (continuous && self->doc) canvas_scroll_to_page(self, self->doc->current_page);
+    canvas_prefetch_neighbours(self);
+    cheat_canvas_queue_redraw(self);
+}
+
+gboolean cheat_canvas_get_continuous(CheatCanvas *self) {
+    g_return_val_if_fail(CHEAT_IS_CANVAS(self), FALSE);
+    return self->continuous;
+}
+
 void cheat_canvas_toggle_crop_mode(CheatCanvas *self) { 
     self->crop_mode = !self->crop_mode;
     if (self->crop_mode) self->draw_mode = FALSE; // Disable draw mode when crop is on
@@ -131,12 +479,13 @@ void cheat_canvas_set_draw_width(CheatCanvas *self, double width) {
 
 void cheat_canvas_undo_last_stroke(CheatCanvas *self) {
     if (!self->doc) return;
-    Page *p = document_current_page(self->doc);
-    if (!p->strokes) return;
+    if (!document_current_page(self->doc)->strokes) return;
+    Page *p = canvas_page_for_write(self);
     
     // Remove the last stroke
     GList *last = g_list_last(p->strokes);
     if (last) {
+        canvas_damage_stroke(self, (Stroke*)last->data);
         stroke_free((Stroke*)last->data);
         p->strokes = g_list_delete_link(p->strokes, last);
         cheat_canvas_queue_redraw(self);
@@ -145,14 +494,16 @@ void cheat_canvas_undo_last_stroke(CheatCanvas *self) {
 
 void cheat_canvas_clear_all_strokes(CheatCanvas *self) {
     if (!self->doc) return;
-    Page *p = document_current_page(self->doc);
+    Page *p = canvas_page_for_write(self);
     page_clear_strokes(p);
+    canvas_damage_rect(self, 0, 0, A4_WIDTH_PT, A4_HEIGHT_PT);
     cheat_canvas_queue_redraw(self);
 }
 
 static void canvas_add_item_centered(CheatCanvas *self, ImageItem *it) {
-    Page *p = document_current_page(self->doc);
+    Page *p = canvas_page_for_write(self);
     page_add_item(p, it);
+    canvas_damage_item(self, it);
     self->selected = it;
     page_bring_to_front(p, it);
     cheat_canvas_queue_redraw(self);
@@ -164,9 +515,95 @@ void cheat_canvas_add_pixbuf(CheatCanvas *self, GdkPixbuf *pixbuf) {
     canvas_add_item_centered(self, it);
 }
 
+void cheat_canvas_add_source(CheatCanvas *self, ImageSource *source) {
+    if (!self->doc || !source) return;
+    ImageItem *it = image_item_new_from_source(source);
+    canvas_add_item_centered(self, it);
+}
+
+void cheat_canvas_flow_sources(CheatCanvas *self, ImageSource * const *sources, guint n_sources) {
+    g_return_if_fail(CHEAT_IS_CANVAS(self));
+    if (!self->doc || n_sources == 0) return;
+    Page *p = canvas_page_for_write(self);
+    LayoutParams params;
+    layout_params_init(&params);
+    int added = layout_flow_sources(self->doc, sources, n_sources, &params);
+    // New items only go below what was there, but the whole page is cheaper
+    // to invalidate than to track item by item
+    if (self->tile_cache) tile_cache_invalidate(self->tile_cache, p->uid, 0, 0, A4_WIDTH_PT, A4_HEIGHT_PT);
+    if (added > 0) {
+        self->selected = NULL;
+        if (self->continuous) canvas_scroll_to_page(self, self->doc->current_page);
+        canvas_prefetch_neighbours(self);
+        g_signal_emit(self, canvas_signals[SIGNAL_PAGE_CHANGED], 0);
+    }
+    cheat_canvas_queue_redraw(self);
+}
+
+// Placeholders cascade from the centre of the page so several stay visible.
+guint cheat_canvas_add_placeholder(CheatCanvas *self) {
+    g_return_val_if_fail(CHEAT_IS_CANVAS(self), 0);
+    if (!self->doc) return 0;
+    Placeholder ph;
+    ph.id = self->next_placeholder_id++;
+    ph.page_uid = document_current_page(self->doc)->uid;
+    ph.w = IMAGE_ITEM_DEFAULT_WIDTH_PT;
+    ph.h = ph.w * 0.75;
+    double step = 12.0 * (self->placeholders->len % 8);
+    ph.x = (A4_WIDTH_PT - ph.w) / 2.0 + step;
+    ph.y = (A4_HEIGHT_PT - ph.h) / 2.0 + step;
+    g_array_append_val(self->placeholders, ph);
+    cheat_canvas_queue_redraw(self);
+    return ph.id;
+}
+
+static gboolean take_placeholder(CheatCanvas *self, guint id, Placeholder *out) {
+    for (guint i = 0; self->placeholders && i < self->placeholders->len; i++) {
+        if (g_array_index(self->placeholders, Placeholder, i).id != id) continue;
+        if (out) *out = g_array_index(self->placeholders, Placeholder, i);
+        g_array_remove_index(self->placeholders, i);
+        cheat_canvas_queue_redraw(self);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void cheat_canvas_remove_placeholder(CheatCanvas *self, guint id) {
+    g_return_if_fail(CHEAT_IS_CANVAS(self));
+    take_placeholder(self, id, NULL);
+}
+
+void cheat_canvas_replace_placeholder(CheatCanvas *self, guint id, ImageSource *source, gboolean select) {
+    g_return_if_fail(CHEAT_IS_CANVAS(self));
+    Placeholder ph;
+    if (!take_placeholder(self, id, &ph) || !self->doc || !source) return;
+    int index = self->doc->current_page;
+    for (guint i = 0; i < self->doc->pages->len; i++) {
+        if (((Page*)g_ptr_array_index(self->doc->pages, i))->uid == ph.page_uid) { index = (int)i; break; }
+    }
+    // Land where the placeholder was, kept on the page
+    ImageItem *it = image_item_new_from_source(source);
+    it->x = CLAMP(ph.x, 0.0, MAX(0.0, A4_WIDTH_PT - it->width));
+    it->y = CLAMP(ph.y, 0.0, MAX(0.0, A4_HEIGHT_PT - it->height));
+    if (index == self->doc->current_page) {
+        Page *p = canvas_page_for_write(self);
+        page_add_item(p, it);
+        canvas_damage_item(self, it);
+        if (select) self->selected = it;
+    } else {
+        // The user moved on to another page meanwhile; leave the selection alone
+        Page *p = document_get_page_for_write(self->doc, (guint)index);
+        g_signal_emit(self, canvas_signals[SIGNAL_CONTENT_CHANGED], 0);
+        page_add_item(p, it);
+        if (self->tile_cache) tile_cache_invalidate(self->tile_cache, p->uid, it->x - 1, it->y - 1, it->width + 2, it->height + 2);
+    }
+    cheat_canvas_queue_redraw(self);
+}
+
 void cheat_canvas_delete_selection(CheatCanvas *self) {
     if (!self->doc || !self->selected) return;
-    Page *p = document_current_page(self->doc);
+    Page *p = canvas_page_for_write(self);
+    canvas_damage_item(self, self->selected);
     page_remove_item(p, self->selected);
     self->selected = NULL;
     cheat_canvas_queue_redraw(self);
@@ -180,6 +617,8 @@ void cheat_canvas_next_page(CheatCanvas *self) {
         document_add_page(self->doc);
     }
     self->selected = NULL;
+    if (self->continuous) canvas_scroll_to_page(self, self->doc->current_page);
+    canvas_prefetch_neighbours(self);
     cheat_canvas_queue_redraw(self);
 }
 
@@ -187,32 +626,100 @@ void cheat_canvas_prev_page(CheatCanvas *self) {
     if (!self->doc) return;
     if (self->doc->current_page > 0) self->doc->current_page--;
     self->selected = NULL;
+    if (self->continuous) canvas_scroll_to_page(self, self->doc->current_page);
+    canvas_prefetch_neighbours(self);
+    cheat_canvas_queue_redraw(self);
+}
+
+void cheat_canvas_go_to_page(CheatCanvas *self, int index) {
+    g_return_if_fail(CHEAT_IS_CANVAS(self));
+    if (!self->doc || index < 0 || index >= document_page_count(self->doc)) return;
+    self->doc->current_page = index;
+    self->selected = NULL;
+    if (self->continuous) canvas_scroll_to_page(self, index);
+    else self->pan_offset_x = self->pan_offset_y = 0.0;
+    canvas_prefetch_neighbours(self);
     cheat_canvas_queue_redraw(self);
 }
 
 // Geometry helpers
 
-static void px_to_page(CheatCanvas *self, double sx, double sy, double *out_px, double *out_py, int alloc_w, int alloc_h) {
+// Distance between the tops of consecutive pages in continuous mode.
+static double page_stride(CheatCanvas *self) {
+    return A4_HEIGHT_PT * self->zoom + PAGE_GAP;
+}
+
+// Top-left corner of page index in widget pixels. Only the current page is
+// placed outside continuous mode. Snapped to whole device pixels so cached
+// page bitmaps are composited without resampling.
+static void page_origin_at(CheatCanvas *self, int index, int alloc_w, int alloc_h, double *offx, double *offy) {
     double w = A4_WIDTH_PT * self->zoom;
     double h = A4_HEIGHT_PT * self->zoom;
-    double offx = (alloc_w - w) / 2.0 + self->pan_offset_x;
-    double offy = (alloc_h - h) / 2.0 + self->pan_offset_y;
+    double scale = gtk_widget_get_scale_factor(GTK_WIDGET(self));
+    double y = self->continuous ? PAGE_GAP + index * page_stride(self) + self->pan_offset_y
+                                : (alloc_h - h) / 2.0 + self->pan_offset_y;
+    *offx = round(((alloc_w - w) / 2.0 + self->pan_offset_x) * scale) / scale;
+    *offy = round(y * scale) / scale;
+}
+
+static void px_to_page_at(CheatCanvas *self, int index, double sx, double sy, double *out_px, double *out_py, int alloc_w, int alloc_h) {
+    double offx, offy;
+    page_origin_at(self, index, alloc_w, alloc_h, &offx, &offy);
     if (out_px) *out_px = (sx - offx) / self->zoom;
     if (out_py) *out_py = (sy - offy) / self->zoom;
 }
 
-static gboolean point_in_item(ImageItem *it, double px, double py) {
-    return (px >= it->x && py >= it->y && px <= it->x + it->width && py <= it->y + it->height);
+static void px_to_page(CheatCanvas *self, double sx, double sy, double *out_px, double *out_py, int alloc_w, int alloc_h) {
+    px_to_page_at(self, self->doc ? self->doc->current_page : 0, sx, sy, out_px, out_py, alloc_w, alloc_h);
 }
 
-static ImageItem *hit_test(CheatCanvas *self, double page_x, double page_y) {
-    Page *p = document_current_page(self->doc);
-    // Iterate from front (tail) to back
-    for (GList *l = g_list_last(p->items); l; l = l->prev) {
-        ImageItem *it = (ImageItem*)l->data;
-        if (point_in_item(it, page_x, page_y)) return it;
+// Page under widget row sy in continuous mode. The gap below a page belongs
+// to that page; rows past either end map to the first or last page.
+static int page_index_at(CheatCanvas *self, double sy) {
+    int n = self->doc ? document_page_count(self->doc) : 1;
+    int idx = (int)floor((sy - self->pan_offset_y - PAGE_GAP) / page_stride(self));
+    return CLAMP(idx, 0, n - 1);
+}
+
+// Pages intersecting the viewport. Computed from the layout arithmetic, so
+// the cost does not depend on the document length.
+static void visible_page_range(CheatCanvas *self, int alloc_h, int *first, int *last) {
+    if (!self->continuous || !self->doc) {
+        *first = *last = self->doc ? self->doc->current_page : 0;
+        return;
     }
-    return NULL;
+    *first = page_index_at(self, 0);
+    *last = page_index_at(self, alloc_h);
+}
+
+// Keep the page stack in view: the first page cannot scroll below its top
+// margin, nor the last page above the bottom edge.
+static void canvas_clamp_scroll(CheatCanvas *self, int alloc_h) {
+    if (!self->continuous || !self->doc) return;
+    double content = PAGE_GAP + document_page_count(self->doc) * page_stride(self);
+    double min_y = MIN(0.0, alloc_h - content);
+    self->pan_offset_y = CLAMP(self->pan_offset_y, min_y, 0.0);
+}
+
+static void canvas_scroll_to_page(CheatCanvas *self, int index) {
+    self->pan_offset_y = -index * page_stride(self);
+    canvas_clamp_scroll(self, gtk_widget_get_allocated_height(GTK_WIDGET(self)));
+}
+
+// In continuous mode the current page is the one under the middle of the
+// view. Left alone while an edit is in progress on the current page.
+static void canvas_sync_current_page(CheatCanvas *self) {
+    if (!self->continuous || !self->doc || self->current_stroke) return;
+    if (self->dragging && self->drag_kind != DRAG_PAN) return;
+    int idx = page_index_at(self, gtk_widget_get_allocated_height(GTK_WIDGET(self)) / 2.0);
+    if (idx == self->doc->current_page) return;
+    self->doc->current_page = idx;
+    self->selected = NULL;
+    g_signal_emit(self, canvas_signals[SIGNAL_PAGE_CHANGED], 0);
+}
+
+static ImageItem *hit_test(CheatCanvas *self, double page_x, double page_y) {
+    return page_item_at(document_current_page(self->doc), page_x, page_y);
 }
 
 static void draw_checker(cairo_t *cr, double x, double y, double w, double h) {
@@ -231,21 +738,6 @@ static void draw_checker(cairo_t *cr, double x, double y, double w, double h) {
     cairo_restore(cr);
 }
 
-static void draw_image_item(cairo_t *cr, ImageItem *it) {
-    // Create subpixbuf for crop
-    GdkPixbuf *sub = gdk_pixbuf_new_subpixbuf(it->pixbuf, it->crop_x, it->crop_y, it->crop_w, it->crop_h);
-    cairo_save(cr);
-    cairo_translate(cr, it->x, it->y);
-    double sx = it->width / (double)it->crop_w;
-    double sy = it->height / (double)it->crop_h;
-    cairo_scale(cr, sx, sy);
-    gdk_cairo_set_source_pixbuf(cr, sub, 0, 0);
-    cairo_rectangle(cr, 0, 0, it->crop_w, it->crop_h);
-    cairo_fill(cr);
-    cairo_restore(cr);
-    g_object_unref(sub);
-}
-
 static void draw_selection(cairo_t *cr, ImageItem *it) {
     cairo_save(cr);
     cairo_set_source_rgba(cr, 0.2, 0.6, 1.0, 0.8);
@@ -313,86 +805,220 @@ static void draw_crop_overlay(cairo_t *cr, ImageItem *it) {
     cairo_restore(cr);
 }
 
-static void draw_stroke(cairo_t *cr, Stroke *stroke) {
-    if (!stroke || !stroke->points || stroke->points->len < 2) return;
-    
+// Tiled drawing for zooms where a whole-page bitmap is too large to cache.
+// Only tiles inside the clip are touched. A tile without a current bitmap is
+// queued on the render pool and shows its previous bitmap (or white) until
+// the new one lands. While content is being dragged, or during a zoom/pan
+// gesture, such tiles are drawn on the spot instead, the latter from a
+// stretched lower-zoom page bitmap when there is one.
+static void draw_page_tiles(CheatCanvas *self, cairo_t *cr, Page *p, int scale, gboolean editing) {
+    double pw = A4_WIDTH_PT * self->zoom;
+    double ph = A4_HEIGHT_PT * self->zoom;
+    double tile = RENDER_TILE_SIZE / (double)scale;
+    int cols, rows;
+    render_page_tile_grid(self->zoom, scale, &cols, &rows);
+
     cairo_save(cr);
-    cairo_set_source_rgba(cr, stroke->r, stroke->g, stroke->b, stroke->a);
-    cairo_set_line_width(cr, stroke->width);
-    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
-    cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
-    
-    Point *p0 = &g_array_index(stroke->points, Point, 0);
-    cairo_move_to(cr, p0->x, p0->y);
-    
-    for (guint i = 1; i < stroke->points->len; i++) {
-        Point *p = &g_array_index(stroke->points, Point, i);
-        cairo_line_to(cr, p->x, p->y);
+    cairo_rectangle(cr, 0, 0, pw, ph);
+    cairo_clip(cr);
+    double x1, y1, x2, y2;
+    cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+    int c0 = MAX(0, (int)floor(x1 / tile)), c1 = MIN(cols - 1, (int)floor(x2 / tile));
+    int r0 = MAX(0, (int)floor(y1 / tile)), r1 = MIN(rows - 1, (int)floor(y2 / tile));
+
+    for (int ty = r0; ty <= r1; ty++) {
+        for (int tx = c0; tx <= c1; tx++) {
+            TileKey key = { p->uid, self->zoom, scale, tx, ty };
+            gboolean valid = FALSE;
+            cairo_surface_t *bitmap = tile_cache_lookup(self->tile_cache, &key, &valid);
+            double x = tx * tile, y = ty * tile;
+
+            if (!valid && (editing || self->interactive)) {
+                cairo_save(cr);
+                cairo_rectangle(cr, x, y, tile, tile);
+                cairo_clip(cr);
+                double stale_zoom = 0.0;
+                cairo_surface_t *stale = self->interactive && !editing
+                    ? page_cache_lookup_any_zoom(self->page_cache, p, scale, &stale_zoom) : NULL;
+                if (stale) {
+                    cairo_scale(cr, self->zoom / stale_zoom, self->zoom / stale_zoom);
+                    cairo_set_source_surface(cr, stale, 0, 0);
+                    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+                    cairo_paint(cr);
+                } else {
+                    cairo_set_source_rgb(cr, 1, 1, 1);
+                    cairo_paint(cr);
+                    cairo_scale(cr, self->zoom, self->zoom);
+                    render_page_content(cr, p, self->interactive ? CAIRO_FILTER_FAST : CAIRO_FILTER_GOOD);
+                }
+                cairo_restore(cr);
+                continue;
+            }
+
+            if (!valid) canvas_request_tile(self, p, &key);
+            if (bitmap) {
+                cairo_set_source_surface(cr, bitmap, x, y);
+                cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+            } else {
+                cairo_set_source_rgb(cr, 1, 1, 1);
+            }
+            cairo_rectangle(cr, x, y, tile, tile);
+            cairo_fill(cr);
+        }
     }
-    
-    cairo_stroke(cr);
     cairo_restore(cr);
 }
 
-static void draw_page_and_items(CheatCanvas *self, cairo_t *cr, int width, int height) {
-    // background checker
-    draw_checker(cr, 0, 0, width, height);
-
-    // page rect in px
+// Draw the page shadow and content with the page's top-left corner at the
+// current origin. A page that is not cached is rendered now when render_now
+// is set; otherwise it is queued on the render pool and shown blank until the
+// bitmap arrives. During a zoom/pan gesture a bitmap cached at another zoom
+// is stretched instead.
+static void draw_page_body(CheatCanvas *self, cairo_t *cr, Page *p, gboolean render_now) {
     double pw = A4_WIDTH_PT * self->zoom;
     double ph = A4_HEIGHT_PT * self->zoom;
-    double offx = (width - pw) / 2.0 + self->pan_offset_x;
-    double offy = (height - ph) / 2.0 + self->pan_offset_y;
-
-    cairo_save(cr);
-    cairo_translate(cr, offx, offy);
 
     // page drop shadow
     cairo_set_source_rgba(cr, 0,0,0,0.25);
     cairo_rectangle(cr, 5, 5, pw, ph);
     cairo_fill(cr);
 
+    cairo_surface_t *cached = NULL;
+    gboolean direct = p != NULL;
+    if (p && self->page_cache) {
+        int scale = gtk_widget_get_scale_factor(GTK_WIDGET(self));
+        gboolean fits = render_page_surface_bytes(self->zoom, scale) <= PAGE_CACHE_MAX_BYTES;
+        // While an item is being dragged the page changes every frame, so
+        // caching it would only add a copy.
+        gboolean editing = self->dragging && self->drag_kind != DRAG_PAN;
+        cached = page_cache_lookup(self->page_cache, p, self->zoom, scale);
+        if (!fits && self->tile_cache) {
+            draw_page_tiles(self, cr, p, scale, editing);
+            return;
+        }
+        double stale_zoom = 0.0;
+        cairo_surface_t *stale = !cached && self->interactive
+            ? page_cache_lookup_any_zoom(self->page_cache, p, scale, &stale_zoom) : NULL;
+        if (stale) {
+            // page drawn at its old zoom, stretched; sharp again once settled
+            cairo_save(cr);
+            cairo_scale(cr, self->zoom / stale_zoom, self->zoom / stale_zoom);
+            cairo_set_source_surface(cr, stale, 0, 0);
+            cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+            cairo_rectangle(cr, 0, 0, A4_WIDTH_PT * stale_zoom, A4_HEIGHT_PT * stale_zoom);
+            cairo_fill(cr);
+            cairo_restore(cr);
+            return;
+        } else if (!cached && self->interactive) {
+            direct = render_now || !fits;
+        } else if (!cached && fits && !render_now) {
+            canvas_request_render(self, p, scale, g_atomic_int_get(&self->prefetch_generation));
+            direct = FALSE;
+        } else if (!cached && fits && !editing) {
+            cairo_surface_t *fresh = render_page_to_surface(p, self->zoom, scale);
+            if (fresh) {
+                page_cache_insert(self->page_cache, p->stamp, self->zoom, scale, fresh);
+                cairo_surface_destroy(fresh);
+                cached = page_cache_lookup(self->page_cache, p, self->zoom, scale);
+            }
+        }
+    }
+
+    if (cached) {
+        cairo_set_source_surface(cr, cached, 0, 0);
+        cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+        cairo_rectangle(cr, 0, 0, pw, ph);
+        cairo_fill(cr);
+        return;
+    }
+
     // page background
     cairo_set_source_rgb(cr, 1, 1, 1);
     cairo_rectangle(cr, 0, 0, pw, ph);
     cairo_fill(cr);
-
-    // scale to page points
-    cairo_scale(cr, self->zoom, self->zoom);
-
-    // draw items
-    if (!self->doc) { cairo_restore(cr); return; }
-    Page *p = document_current_page(self->doc);
-    for (GList *l = p->items; l; l = l->next) {
-        ImageItem *it = (ImageItem*)l->data;
-        draw_image_item(cr, it);
+    if (direct) {
+        cairo_save(cr);
+        cairo_scale(cr, self->zoom, self->zoom);
+        render_page_content(cr, p, self->interactive ? CAIRO_FILTER_FAST : CAIRO_FILTER_GOOD);
+        cairo_restore(cr);
     }
+}
 
-    // draw strokes
-    for (GList *l = p->strokes; l; l = l->next) {
-        Stroke *s = (Stroke*)l->data;
-        draw_stroke(cr, s);
+static void draw_placeholders(CheatCanvas *self, cairo_t *cr, Page *p) {
+    static const double dash[] = { 6.0, 4.0 };
+    for (guint i = 0; i < self->placeholders->len; i++) {
+        Placeholder *ph = &g_array_index(self->placeholders, Placeholder, i);
+        if (ph->page_uid != p->uid) continue;
+        cairo_save(cr);
+        cairo_rectangle(cr, ph->x, ph->y, ph->w, ph->h);
+        cairo_set_source_rgba(cr, 0.5, 0.5, 0.5, 0.15);
+        cairo_fill_preserve(cr);
+        cairo_set_source_rgba(cr, 0.3, 0.3, 0.3, 0.8);
+        cairo_set_line_width(cr, 1.0 / self->zoom);
+        cairo_set_dash(cr, dash, 2, 0);
+        cairo_stroke(cr);
+        cairo_set_font_size(cr, 12.0);
+        cairo_move_to(cr, ph->x + 8, ph->y + 20);
+        cairo_show_text(cr, "Loading…");
+        cairo_restore(cr);
     }
+}
 
-    // draw current stroke being drawn
-    if (self->current_stroke) {
-        draw_stroke(cr, self->current_stroke);
-    }
+static void draw_page_and_items(CheatCanvas *self, cairo_t *cr, int width, int height) {
+    // background checker
+    draw_checker(cr, 0, 0, width, height);
 
-    // overlays
-    if (self->selected && !self->draw_mode) {
-        draw_selection(cr, self->selected);
-        if (self->crop_mode) draw_crop_overlay(cr, self->selected);
+    int first, last;
+    visible_page_range(self, height, &first, &last);
+    if (self->continuous && !self->interactive && (first != self->visible_first || last != self->visible_last)) {
+        canvas_prefetch_neighbours(self);
     }
 
-    cairo_restore(cr);
+    int current = self->doc ? self->doc->current_page : 0;
+    for (int i = first; i <= last; i++) {
+        Page *p = self->doc ? (Page*)g_ptr_array_index(self->doc->pages, i) : NULL;
+        double offx, offy;
+        page_origin_at(self, i, width, height, &offx, &offy);
+
+        cairo_save(cr);
+        cairo_translate(cr, offx, offy);
+        draw_page_body(self, cr, p, i == current);
+        if (p && self->placeholders->len) {
+            cairo_save(cr);
+            cairo_scale(cr, self->zoom, self->zoom);
+            draw_placeholders(self, cr, p);
+            cairo_restore(cr);
+        }
+
+        if (p && i == current) {
+            // scale to page points
+            cairo_scale(cr, self->zoom, self->zoom);
+
+            // draw current stroke being drawn
+            if (self->current_stroke) {
+                render_stroke(cr, self->current_stroke);
+            }
+
+            // overlays
+            if (self->selected && !self->draw_mode) {
+                draw_selection(cr, self->selected);
+                if (self->crop_mode) draw_crop_overlay(cr, self->selected);
+            }
+        }
+        cairo_restore(cr);
+    }
 }
 
 static gboolean on_draw(GtkWidget *w, cairo_t *cr, gpointer user_data) {
     (void)user_data;
+    TRACE_SCOPE("canvas.draw");
     CheatCanvas *self = CHEAT_CANVAS(w);
+    gint64 start = g_get_monotonic_time();
     GtkAllocation alloc; gtk_widget_get_allocation(w, &alloc);
     draw_page_and_items(self, cr, alloc.width, alloc.height);
+    // The overlay's own drawing is not part of the measured frame
+    perf_hud_frame(self->perf_hud, w, start);
+    perf_hud_draw(self->perf_hud, cr, self->doc ? document_current_page(self->doc) : NULL);
     return FALSE;
 }
 
@@ -435,7 +1061,6 @@ static gboolean on_button_press(GtkWidget *w, GdkEventButton *ev, gpointer user_
     CheatCanvas *self = CHEAT_CANVAS(w);
     
     GtkAllocation alloc; gtk_widget_get_allocation(w, &alloc);
-    double px, py; px_to_page(self, ev->x, ev->y, &px, &py, alloc.width, alloc.height);
 
     // Middle mouse button or right mouse button for panning
     if (ev->button == GDK_BUTTON_MIDDLE || ev->button == GDK_BUTTON_SECONDARY) {
@@ -458,6 +1083,17 @@ static gboolean on_button_press(GtkWidget *w, GdkEventButton *ev, gpointer user_
     
     if (ev->button != GDK_BUTTON_PRIMARY) return FALSE;
 
+    // In continuous mode edits go to the page under the cursor
+    if (self->continuous && self->doc) {
+        int idx = page_index_at(self, ev->y);
+        if (idx != self->doc->current_page) {
+            self->doc->current_page = idx;
+            self->selected = NULL;
+            g_signal_emit(self, canvas_signals[SIGNAL_PAGE_CHANGED], 0);
+        }
+    }
+    double px, py; px_to_page(self, ev->x, ev->y, &px, &py, alloc.width, alloc.height);
+
     // If in draw mode, start a new stroke
     if (self->draw_mode && self->doc) {
         self->current_stroke = stroke_new(self->draw_r, self->draw_g, self->draw_b, self->draw_a, self->draw_width);
@@ -469,8 +1105,10 @@ static gboolean on_button_press(GtkWidget *w, GdkEventButton *ev, gpointer user_
     ImageItem *hit = self->doc ? hit_test(self, px, py) : NULL;
     self->selected = hit;
     if (hit) {
-        Page *p = document_current_page(self->doc);
+        Page *p = canvas_page_for_write(self);
+        hit = self->selected;
         page_bring_to_front(p, hit);
+        canvas_damage_item(self, hit);
         self->dragging = TRUE;
         self->drag_start_px = ev->x; self->drag_start_py = ev->y;
         self->orig_x = hit->x; self->orig_y = hit->y; self->orig_w = hit->width; self->orig_h = hit->height;
@@ -515,8 +1153,9 @@ static gboolean on_button_release(GtkWidget *w, GdkEventButton *ev, gpointer use
     
     // If we were drawing, finish the stroke
     if (self->current_stroke && self->doc) {
-        Page *p = document_current_page(self->doc);
+        Page *p = canvas_page_for_write(self);
         page_add_stroke(p, self->current_stroke);
+        canvas_damage_stroke(self, self->current_stroke);
         self->current_stroke = NULL;
         cheat_canvas_queue_redraw(self);
     }
@@ -526,10 +1165,8 @@ static gboolean on_button_release(GtkWidget *w, GdkEventButton *ev, gpointer use
     return TRUE;
 }
 
-static gboolean on_motion(GtkWidget *w, GdkEventMotion *ev, gpointer user_data) {
-    (void)user_data;
-    CheatCanvas *self = CHEAT_CANVAS(w);
-    
+static gboolean handle_motion(CheatCanvas *self, GdkEventMotion *ev) {
+    GtkWidget *w = GTK_WIDGET(self);
     GtkAllocation alloc; gtk_widget_get_allocation(w, &alloc);
     double px, py; px_to_page(self, ev->x, ev->y, &px, &py, alloc.width, alloc.height);
     
@@ -546,6 +1183,9 @@ static gboolean on_motion(GtkWidget *w, GdkEventMotion *ev, gpointer user_data)
         double dpy = ev->y - self->drag_start_py;
         self->pan_offset_x = self->orig_pan_x + dpx;
         self->pan_offset_y = self->orig_pan_y + dpy;
+        canvas_clamp_scroll(self, alloc.height);
+        canvas_sync_current_page(self);
+        canvas_begin_interaction(self);
         cheat_canvas_queue_redraw(self);
         return TRUE;
     }
@@ -573,11 +1213,13 @@ static gboolean on_motion(GtkWidget *w, GdkEventMotion *ev, gpointer user_data)
     }
     
     if (!self->selected) return FALSE;
+    canvas_page_for_write(self);
 
     double dpx = (ev->x - self->drag_start_px) / self->zoom;
     double dpy = (ev->y - self->drag_start_py) / self->zoom;
 
     ImageItem *it = self->selected;
+    canvas_damage_item(self, it); // where it was
     if (self->drag_kind == DRAG_MOVE) {
         it->x = self->orig_x + dpx;
         it->y = self->orig_y + dpy;
@@ -609,8 +1251,8 @@ static gboolean on_motion(GtkWidget *w, GdkEventMotion *ev, gpointer user_data)
         double scale_y = self->orig_h / (double)self->orig_ch;
         int ddx = (int)round(dpx / scale_x);
         int ddy = (int)round(dpy / scale_y);
-        int imgw = gdk_pixbuf_get_width(it->pixbuf);
-        int imgh = gdk_pixbuf_get_height(it->pixbuf);
+        int imgw = image_source_get_width(it->source);
+        int imgh = image_source_get_height(it->source);
         int cx = self->orig_cx, cy = self->orig_cy, cw = self->orig_cw, ch = self->orig_ch;
         if (self->drag_handle < 0) {
             // move crop rect
@@ -643,39 +1285,61 @@ static gboolean on_motion(GtkWidget *w, GdkEventMotion *ev, gpointer user_data)
         double aspect = (double)cw / (double)ch;
         it->height = it->width / aspect;
     }
+    canvas_damage_item(self, it); // where it is now
 
     cheat_canvas_queue_redraw(self);
     return TRUE;
 }
 
+static gboolean on_motion(GtkWidget *w, GdkEventMotion *ev, gpointer user_data) {
+    (void)user_data;
+    TRACE_SCOPE("canvas.motion");
+    CheatCanvas *self = CHEAT_CANVAS(w);
+    guint serial = self->redraw_serial;
+    gboolean handled = handle_motion(self, ev);
+    // Only motion that changed the picture has a frame to wait for
+    if (self->redraw_serial != serial) perf_hud_input(self->perf_hud, ev->time);
+    return handled;
+}
+
 static gboolean on_scroll(GtkWidget *w, GdkEventScroll *ev, gpointer user_data) {
     (void)user_data;
     CheatCanvas *self = CHEAT_CANVAS(w);
-    
-    // Get the page coordinates before zoom
-    GtkAllocation alloc; 
-    gtk_widget_get_allocation(w, &alloc);
-    double px_before, py_before;
-    px_to_page(self, ev->x, ev->y, &px_before, &py_before, alloc.width, alloc.height);
-    
-    // Apply zoom
-    if (ev->direction == GDK_SCROLL_UP) {
-        self->zoom *= 1.1;
-    } else if (ev->direction == GDK_SCROLL_DOWN) {
-        self->zoom /= 1.1;
-        if (self->zoom < 0.2) self->zoom = 0.2;
+    if (ev->direction != GDK_SCROLL_UP && ev->direction != GDK_SCROLL_DOWN) return FALSE;
+
+    // Continuous mode scrolls with the wheel and zooms with Ctrl+wheel
+    if (self->continuous && !(ev->state & GDK_CONTROL_MASK)) {
+        self->pan_offset_y += ev->direction == GDK_SCROLL_UP ? SCROLL_STEP : -SCROLL_STEP;
+        canvas_clamp_scroll(self, gtk_widget_get_allocated_height(w));
+        canvas_sync_current_page(self);
+        cheat_canvas_queue_redraw(self);
+        return TRUE;
     }
-    
-    // Get the page coordinates after zoom (without pan adjustment)
-    double px_after, py_after;
-    px_to_page(self, ev->x, ev->y, &px_after, &py_after, alloc.width, alloc.height);
-    
-    // Adjust pan offset to keep the same point under the cursor
-    double page_delta_x = (px_after - px_before) * self->zoom;
-    double page_delta_y = (py_after - py_before) * self->zoom;
-    self->pan_offset_x -= page_delta_x;
-    self->pan_offset_y -= page_delta_y;
-    
-    cheat_canvas_queue_redraw(self);
+
+    canvas_zoom_at(self, ev->direction == GDK_SCROLL_UP ? 1.1 : 1.0 / 1.1, ev->x, ev->y);
     return TRUE;
 }
+
+void cheat_canvas_set_perf_hud(CheatCanvas *self, gboolean visible) {
+    g_return_if_fail(CHEAT_IS_CANVAS(self));
+    perf_hud_set_visible(self->perf_hud, visible);
+    cheat_canvas_queue_redraw(self);
+}
+
+gboolean cheat_canvas_get_perf_hud(CheatCanvas *self) {
+    g_return_val_if_fail(CHEAT_IS_CANVAS(self), FALSE);
+    return perf_hud_get_visible(self->perf_hud);
+}
+
+gboolean cheat_canvas_write_perf_stats(CheatCanvas *self, const char *path, GError **error) {
+    g_return_val_if_fail(CHEAT_IS_CANVAS(self), FALSE);
+    return perf_hud_write(self->perf_hud, path, error);
+}
+
+gsize cheat_canvas_get_cache_bytes(CheatCanvas *self) {
+    g_return_val_if_fail(CHEAT_IS_CANVAS(self), 0);
+    gsize bytes = 0;
+    if (self->page_cache) bytes += page_cache_get_bytes(self->page_cache);
+    if (self->tile_cache) bytes += tile_cache_get_bytes(self->tile_cache);
+    return bytes;
+}
@@ -15,6 +15,14 @@ void cheat_canvas_zoom_in(CheatCanvas *self);
 void cheat_canvas_zoom_out(CheatCanvas *self);
 void cheat_canvas_zoom_reset(CheatCanvas *self);
 
+// Signals: "page-changed" when the current page changes from within the
+// canvas, "content-changed" whenever a page is about to be edited.
+
+// Continuous mode stacks all pages vertically: the wheel scrolls, Ctrl+wheel
+// zooms, and the current page follows the viewport, emitting "page-changed".
+void cheat_canvas_set_continuous(CheatCanvas *self, gboolean continuous);
+gboolean cheat_canvas_get_continuous(CheatCanvas *self);
+
 void cheat_canvas_toggle_crop_mode(CheatCanvas *self);
 void cheat_canvas_toggle_draw_mode(CheatCanvas *self);
 void cheat_canvas_set_draw_color(CheatCanvas *self, double r, double g, double b, double a);
@@ -24,10 +32,36 @@ void cheat_canvas_clear_all_strokes(CheatCanvas *self);
 
 // Add an image to the current page centered; takes ownership reference of pixbuf
 void cheat_canvas_add_pixbuf(CheatCanvas *self, GdkPixbuf *pixbuf);
+void cheat_canvas_add_source(CheatCanvas *self, ImageSource *source);
+
+// Placeholders mark images that are still loading: a dashed box on the page
+// that was current when it was added. They are not part of the document.
+guint cheat_canvas_add_placeholder(CheatCanvas *self);
+void cheat_canvas_remove_placeholder(CheatCanvas *self, guint id);
+// Adds source where the placeholder was on its page (or the current page if
+// that page is gone) and removes the placeholder. The new item is selected if
+// select is set and it landed on the current page.
+void cheat_canvas_replace_placeholder(CheatCanvas *self, guint id, ImageSource *source, gboolean select);
+
+// Packs an item for each source below the current page's items, carrying on
+// over new pages at the end of the document as pages fill (see layout.h),
+// with a single redraw. Emits "page-changed" if pages were added.
+void cheat_canvas_flow_sources(CheatCanvas *self, ImageSource * const *sources, guint n_sources);
 
 // Helpers used by main window actions
 void cheat_canvas_delete_selection(CheatCanvas *self);
 void cheat_canvas_next_page(CheatCanvas *self);
 void cheat_canvas_prev_page(CheatCanvas *self);
+void cheat_canvas_go_to_page(CheatCanvas *self, int index);
+
+// Performance overlay: draw time, input-to-screen latency, dropped frames and
+// the size of the current page. Statistics are gathered while it is shown
+// and can be written out as JSON.
+void cheat_canvas_set_perf_hud(CheatCanvas *self, gboolean visible);
+gboolean cheat_canvas_get_perf_hud(CheatCanvas *self);
+gboolean cheat_canvas_write_perf_stats(CheatCanvas *self, const char *path, GError **error);
+
+// Bytes of rendered page and tile bitmaps cached by the canvas.
+gsize cheat_canvas_get_cache_bytes(CheatCanvas *self);
 
 G_END_DECLS
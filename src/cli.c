@@ -0,0 +1,388 @@
+#include "cli.h"
+#include "image_io.h"
+#include "import_policy.h"
+#include "layout.h"
+#include "memory_report.h"
+#include "pdf_export.h"
+#include "png_export.h"
+#include "serialize.h"
+#include "trace.h"
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *input;
+    const char *output;
+    gboolean ok;
+} ExportJob;
+
+typedef struct {
+    PdfExportOptions options;
+    double png_dpi;
+    GMutex lock;                // serialises progress output
+} ExportBatch;
+
+static void usage(FILE *out) {
+    fprintf(out,
+            "Usage: cheatsheet-maker [--export DOC.json OUT.pdf|OUT.png]... [options]\n"
+            "       cheatsheet-maker --compose IMAGE|DIR|'GLOB'... --output OUT... [options]\n"
+            "       cheatsheet-maker --memory-report DOC.json\n"
+            "\n"
+            "Export saved documents without opening a window. --export may be\n"
+            "repeated; the documents are exported in parallel. A .png output\n"
+            "writes one image per page: OUT-01.png, OUT-02.png, ...\n"
+            "\n"
+            "  --profile NAME   lossless (default), balanced or small\n"
+            "  --dpi N          image resolution in the PDF (default: full resolution\n"
+            "                   for lossless, 300 for balanced, 150 for small),\n"
+            "                   or page resolution of PNGs (default: 150)\n"
+            "  --jobs N         documents exported at once (default: one per core)\n"
+            "\n"
+            "--compose packs images onto A4 pages in rows, decoding them in parallel.\n"
+            "A directory adds every image in it by name; quote globs to pass them on.\n"
+            "  --output FILE    DOC.json, OUT.pdf or OUT.png; may be repeated\n"
+            "  --columns N      images per row (default: %d)\n"
+            "  --margin PT      page margin in points (default: %g)\n"
+            "\n"
+            "  --memory-report DOC.json\n"
+            "                   print decoded image, stroke and file size per page;\n"
+            "                   every image is decoded once to measure it\n"
+            "  --trace FILE     record a Chrome trace of the run (also for the GUI)\n",
+            LAYOUT_DEFAULT_COLUMNS, LAYOUT_DEFAULT_MARGIN);
+}
+
+// Writes PNGs for a .png output and a PDF otherwise.
+static gboolean export_to(Document *doc, const char *output, const PdfExportOptions *options, double png_dpi,
+                          GError **error) {
+    if (g_str_has_suffix(output, ".png") || g_str_has_suffix(output, ".PNG")) {
+        return export_document_to_png(doc, output, png_dpi, NULL, NULL, NULL, error);
+    }
+    return export_document_to_pdf(doc, output, options, error);
+}
+
+static void export_job_run(gpointer data, gpointer user_data) {
+    ExportJob *job = (ExportJob*)data;
+    ExportBatch *batch = (ExportBatch*)user_data;
+    GError *error = NULL;
+    Document *doc = document_load_from_file(job->input, &error);
+    if (doc) {
+        job->ok = export_to(doc, job->output, &batch->options, batch->png_dpi, &error);
+        document_free(doc);
+    }
+    g_mutex_lock(&batch->lock);
+    if (job->ok) printf("%s -> %s\n", job->input, job->output);
+    else fprintf(stderr, "%s: %s\n", job->input, error ? error->message : "export failed");
+    fflush(stdout);
+    g_mutex_unlock(&batch->lock);
+    if (error) g_error_free(error);
+}
+
+static int run_exports(GArray *jobs, const PdfExportOptions *options, double png_dpi, int threads) {
+    ExportBatch batch;
+    batch.options = *options;
+    batch.png_dpi = png_dpi;
+    g_mutex_init(&batch.lock);
+    GThreadPool *pool = g_thread_pool_new(export_job_run, &batch, MAX(1, threads), FALSE, NULL);
+    for (guint i = 0; i < jobs->len; i++) g_thread_pool_push(pool, &g_array_index(jobs, ExportJob, i), NULL);
+    g_thread_pool_free(pool, FALSE, TRUE);
+    g_mutex_clear(&batch.lock);
+
+    int failed = 0;
+    for (guint i = 0; i < jobs->len; i++) if (!g_array_index(jobs, ExportJob, i).ok) failed++;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+typedef struct {
+    const char *path;
+    ImageSource *source;        // NULL if loading failed
+    gchar *error;
+} ComposeSlot;
+
+static void compose_load(gpointer data, gpointer user_data) {
+    TRACE_SCOPE("compose.load");
+    ComposeSlot *slot = (ComposeSlot*)data;
+    const ImportPolicy *policy = (const ImportPolicy*)user_data;
+    GError *error = NULL;
+    ImageSource *src = image_source_new_from_file(slot->path, &error);
+    if (src) {
+        ImageSource *out = import_policy_apply(policy, src, &error);
+        image_source_unref(src);
+        src = out;
+    }
+    // Decode now, in parallel, rather than one by one during the export
+    if (src && !image_source_preload(src)) {
+        g_set_error(&error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE, "Cannot decode image");
+        g_clear_pointer(&src, image_source_unref);
+    }
+    slot->source = src;
+    if (!src) slot->error = g_strdup(error ? error->message : "unknown error");
+    if (error) g_error_free(error);
+}
+
+static gint compare_paths(gconstpointer a, gconstpointer b) {
+    return g_strcmp0(*(const char * const *)a, *(const char * const *)b);
+}
+
+// Adds the images arg names to paths: a file, every image in a directory in
+// name order, or the matches of a glob pattern the shell did not expand.
+static gboolean expand_input(const char *arg, GPtrArray *paths) {
+    if (g_file_test(arg, G_FILE_TEST_IS_DIR)) {
+        GError *error = NULL;
+        GDir *dir = g_dir_open(arg, 0, &error);
+        if (!dir) {
+            fprintf(stderr, "%s\n", error->message);
+            g_error_free(error);
+            return FALSE;
+        }
+        guint first = paths->len;
+        const gchar *name;
+        while ((name = g_dir_read_name(dir))) {
+            if (path_looks_like_image(name)) g_ptr_array_add(paths, g_build_filename(arg, name, NULL));
+        }
+        g_dir_close(dir);
+        qsort(paths->pdata + first, paths->len - first, sizeof(gpointer), compare_paths);
+        return TRUE;
+    }
+    if (strpbrk(arg, "*?[")) {
+        glob_t matches;
+        int rc = glob(arg, 0, NULL, &matches);
+        if (rc == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                if (!g_file_test(matches.gl_pathv[i], G_FILE_TEST_IS_DIR)) g_ptr_array_add(paths, g_strdup(matches.gl_pathv[i]));
+            }
+        }
+        globfree(&matches);
+        if (rc != 0) fprintf(stderr, "No files match '%s'\n", arg);
+        return rc == 0;
+    }
+    g_ptr_array_add(paths, g_strdup(arg));
+    return TRUE;
+}
+
+// Nothing is written unless every image loads, so a broken input fails a
+// build instead of silently leaving a gap.
+static int run_compose(GPtrArray *inputs, GPtrArray *outputs, const LayoutParams *layout,
+                       const PdfExportOptions *options, double png_dpi, int threads) {
+    TRACE_SCOPE("cli.compose");
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    gboolean ok = TRUE;
+    for (guint i = 0; i < inputs->len; i++) ok &= expand_input((const char*)g_ptr_array_index(inputs, i), paths);
+    if (ok && paths->len == 0) {
+        fprintf(stderr, "No images to compose\n");
+        ok = FALSE;
+    }
+    if (!ok) {
+        g_ptr_array_unref(paths);
+        return EXIT_FAILURE;
+    }
+
+    // The policy caps pixels at the default item width; hold the same DPI at
+    // the width the layout places items at
+    ImportPolicy policy;
+    import_policy_init_default(&policy);
+    policy.max_dpi *= layout->item_width / IMAGE_ITEM_DEFAULT_WIDTH_PT;
+
+    guint n = paths->len;
+    ComposeSlot *slots = g_new0(ComposeSlot, n);
+    GThreadPool *pool = g_thread_pool_new(compose_load, &policy, MAX(1, threads), FALSE, NULL);
+    for (guint i = 0; i < n; i++) {
+        slots[i].path = (const char*)g_ptr_array_index(paths, i);
+        g_thread_pool_push(pool, &slots[i], NULL);
+    }
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    ImageSource **sources = g_new0(ImageSource*, n);
+    for (guint i = 0; i < n; i++) {
+        sources[i] = slots[i].source;
+        if (!sources[i]) {
+            fprintf(stderr, "%s: %s\n", slots[i].path, slots[i].error);
+            ok = FALSE;
+        }
+    }
+
+    if (ok) {
+        Document *doc = document_new();
+        layout_flow_sources(doc, sources, n, layout);
+        doc->current_page = 0;
+        for (guint i = 0; i < outputs->len; i++) {
+            const char *output = (const char*)g_ptr_array_index(outputs, i);
+            GError *error = NULL;
+            gboolean written = g_str_has_suffix(output, ".json") || g_str_has_suffix(output, ".JSON")
+                             ? document_save_to_file(doc, output, &error)
+                             : export_to(doc, output, options, png_dpi, &error);
+            if (written) {
+                printf("%u images -> %s (%d pages)\n", n, output, document_page_count(doc));
+            } else {
+                fprintf(stderr, "%s: %s\n", output, error ? error->message : "write failed");
+                ok = FALSE;
+            }
+            if (error) g_error_free(error);
+        }
+        document_free(doc);
+    }
+
+    for (guint i = 0; i < n; i++) {
+        if (slots[i].source) image_source_unref(slots[i].source);
+        g_free(slots[i].error);
+    }
+    g_free(sources);
+    g_free(slots);
+    g_ptr_array_unref(paths);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void preload_source(gpointer data, gpointer user_data) {
+    (void)user_data;
+    image_source_preload((ImageSource*)data);
+}
+
+static int run_memory_report(const char *path, int threads) {
+    GError *error = NULL;
+    Document *doc = document_load_from_file(path, &error);
+    if (!doc) {
+        fprintf(stderr, "%s: %s\n", path, error ? error->message : "load failed");
+        if (error) g_error_free(error);
+        return EXIT_FAILURE;
+    }
+    // Decode every image once so the report has their real compact sizes
+    // rather than RGBA estimates
+    GHashTable *sources = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (guint i = 0; i < doc->pages->len; i++) {
+        Page *page = (Page*)g_ptr_array_index(doc->pages, i);
+        for (GList *l = page->items; l; l = l->next) {
+            ImageSource *src = ((ImageItem*)l->data)->source;
+            g_hash_table_add(sources, src);
+            if (image_source_get_original(src)) g_hash_table_add(sources, image_source_get_original(src));
+        }
+    }
+    GThreadPool *pool = g_thread_pool_new(preload_source, NULL, MAX(1, threads), FALSE, NULL);
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, sources);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) g_thread_pool_push(pool, key, NULL);
+    g_thread_pool_free(pool, FALSE, TRUE);
+    g_hash_table_unref(sources);
+
+    DocumentMemory memory;
+    document_memory_measure(doc, &memory);
+    gchar *report = document_memory_format(&memory);
+    printf("%s\n%s", path, report);
+    g_free(report);
+    document_memory_clear(&memory);
+    document_free(doc);
+    return EXIT_SUCCESS;
+}
+
+// Value of "--name VALUE" or "--name=VALUE" at argv[*i], advancing *i past it.
+static const char *option_value(int argc, char **argv, int *i, const char *name) {
+    size_t n = strlen(name);
+    if (strncmp(argv[*i], name, n) != 0) return NULL;
+    if (argv[*i][n] == '=') return argv[*i] + n + 1;
+    if (argv[*i][n] != '\0' || *i + 1 >= argc) return NULL;
+    return argv[++*i];
+}
+
+void cli_setup_trace(int *argc, char **argv) {
+    g_return_if_fail(argc != NULL);
+    const char *path = NULL;
+    int out = 1;
+    for (int i = 1; i < *argc; i++) {
+        int start = i;
+        const char *value = option_value(*argc, argv, &i, "--trace");
+        if (value) path = value;
+        else if (i == start) argv[out++] = argv[i];
+    }
+    *argc = out;
+    argv[out] = NULL;
+    if (!path) path = g_getenv("CHEATSHEET_TRACE");
+    if (path && *path) trace_start(path);
+}
+
+gboolean cli_run(int argc, char **argv, int *status) {
+    g_return_val_if_fail(status != NULL, FALSE);
+    gboolean wanted = FALSE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--export") == 0 || strcmp(argv[i], "--compose") == 0 ||
+            g_str_has_prefix(argv[i], "--memory-report") || strcmp(argv[i], "--help") == 0 ||
+            strcmp(argv[i], "-h") == 0) wanted = TRUE;
+    }
+    if (!wanted) return FALSE;
+
+    PdfExportProfile profile = PDF_EXPORT_LOSSLESS;
+    double dpi = -1;
+    int threads = (int)g_get_num_processors();
+    GArray *jobs = g_array_new(FALSE, TRUE, sizeof(ExportJob));
+    GPtrArray *reports = g_ptr_array_new();
+    GPtrArray *compose_inputs = g_ptr_array_new();
+    GPtrArray *compose_outputs = g_ptr_array_new();
+    LayoutParams layout;
+    layout_params_init(&layout);
+    int columns = LAYOUT_DEFAULT_COLUMNS;
+    const char *value;
+    *status = EXIT_FAILURE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--export") == 0) {
+            if (i + 2 >= argc) {
+                fprintf(stderr, "--export needs an input document and an output file\n");
+                goto out;
+            }
+            ExportJob job = { argv[i + 1], argv[i + 2], FALSE };
+            g_array_append_val(jobs, job);
+            i += 2;
+        } else if (strcmp(argv[i], "--compose") == 0) {
+            while (i + 1 < argc && !g_str_has_prefix(argv[i + 1], "--")) g_ptr_array_add(compose_inputs, argv[++i]);
+        } else if ((value = option_value(argc, argv, &i, "--output"))) {
+            g_ptr_array_add(compose_outputs, (gpointer)value);
+        } else if ((value = option_value(argc, argv, &i, "--columns"))) {
+            columns = atoi(value);
+        } else if ((value = option_value(argc, argv, &i, "--margin"))) {
+            layout.margin = CLAMP(g_ascii_strtod(value, NULL), 0.0, A4_WIDTH_PT / 4);
+        } else if ((value = option_value(argc, argv, &i, "--memory-report"))) {
+            g_ptr_array_add(reports, (gpointer)value);
+        } else if ((value = option_value(argc, argv, &i, "--profile"))) {
+            if (!pdf_export_profile_from_string(value, &profile)) {
+                fprintf(stderr, "Unknown profile '%s'\n", value);
+                goto out;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--dpi"))) {
+            dpi = g_ascii_strtod(value, NULL);
+        } else if ((value = option_value(argc, argv, &i, "--jobs"))) {
+            threads = atoi(value);
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(stdout);
+            *status = EXIT_SUCCESS;
+            goto out;
+        } else {
+            fprintf(stderr, "Unknown argument '%s'\n", argv[i]);
+            usage(stderr);
+            goto out;
+        }
+    }
+
+    if ((compose_inputs->len > 0) != (compose_outputs->len > 0)) {
+        fprintf(stderr, "--compose needs images and at least one --output\n");
+        goto out;
+    }
+    layout_params_set_columns(&layout, columns);
+
+    PdfExportOptions options;
+    pdf_export_options_init_profile(&options, profile);
+    if (dpi >= 0) options.target_dpi = dpi;
+    double png_dpi = dpi > 0 ? dpi : PNG_EXPORT_DEFAULT_DPI;
+    *status = run_exports(jobs, &options, png_dpi, threads);
+    if (compose_inputs->len > 0 && run_compose(compose_inputs, compose_outputs, &layout, &options, png_dpi, threads) != EXIT_SUCCESS) {
+        *status = EXIT_FAILURE;
+    }
+    for (guint i = 0; i < reports->len; i++) {
+        if (i > 0) printf("\n");
+        if (run_memory_report((const char*)g_ptr_array_index(reports, i), threads) != EXIT_SUCCESS) *status = EXIT_FAILURE;
+    }
+out:
+    g_ptr_array_unref(compose_outputs);
+    g_ptr_array_unref(compose_inputs);
+    g_ptr_array_unref(reports);
+    g_array_unref(jobs);
+    return TRUE;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Command-line modes that run without a display. Returns FALSE if argv does
+// not ask for one, in which case the GUI starts as usual. Otherwise runs it
+// and stores the process exit status in *status.
+gboolean cli_run(int argc, char **argv, int *status);
+
+// Starts trace recording for --trace FILE (removed from argv so the GUI does
+// not see it) or, failing that, CHEATSHEET_TRACE=FILE. Call trace_stop()
+// before exiting to write the file.
+void cli_setup_trace(int *argc, char **argv);
+
+G_END_DECLS
@@ -1,9 +1,17 @@
 #include "document.h"
 
-static Page *page_new(void) {
+static guint next_stamp(void) {
+    static gint counter = 0;
+    return (guint)g_atomic_int_add(&counter, 1) + 1;
+}
+
+Page *page_new(void) {
     Page *p = g_new0(Page, 1);
     p->items = NULL;
     p->strokes = NULL;
+    p->ref_count = 1;
+    p->stamp = next_stamp();
+    p->uid = p->stamp;
     return p;
 }
 
@@ -19,9 +27,34 @@ static void page_free(Page *p) {
     g_free(p);
 }
 
+Page *page_ref(Page *page) {
+    g_return_val_if_fail(page != NULL, NULL);
+    g_atomic_int_inc(&page->ref_count);
+    return page;
+}
+
+void page_unref(Page *page) {
+    if (!page) return;
+    if (g_atomic_int_dec_and_test(&page->ref_count)) page_free(page);
+}
+
+Page *page_copy(const Page *page) {
+    g_return_val_if_fail(page != NULL, NULL);
+    Page *p = page_new();
+    for (GList *l = page->items; l; l = l->next) {
+        p->items = g_list_prepend(p->items, image_item_copy((ImageItem*)l->data));
+    }
+    p->items = g_list_reverse(p->items);
+    for (GList *l = page->strokes; l; l = l->next) {
+        p->strokes = g_list_prepend(p->strokes, stroke_copy((Stroke*)l->data));
+    }
+    p->strokes = g_list_reverse(p->strokes);
+    return p;
+}
+
 Document *document_new(void) {
     Document *d = g_new0(Document, 1);
-    d->pages = g_ptr_array_new_with_free_func((GDestroyNotify)page_free);
+    d->pages = g_ptr_array_new_with_free_func((GDestroyNotify)page_unref);
     d->current_page = 0;
     // start with a single page
     Page *first = page_new();
@@ -88,15 +121,70 @@ int document_page_count(const Document *doc) {
     return doc ? (int)doc->pages->len : 0;
 }
 
+int document_find_page(const Document *doc, guint uid) {
+    g_return_val_if_fail(doc != NULL, -1);
+    for (guint i = 0; i < doc->pages->len; i++) {
+        if (((Page*)g_ptr_array_index(doc->pages, i))->uid == uid) return (int)i;
+    }
+    return -1;
+}
+
+void document_replace_page(Document *doc, guint index, Page *page) {
+    g_return_if_fail(doc != NULL && page != NULL && index < doc->pages->len);
+    Page *old = (Page*)g_ptr_array_index(doc->pages, index);
+    g_ptr_array_index(doc->pages, index) = page;
+    page_unref(old);
+}
+
+Document *document_snapshot(Document *doc) {
+    g_return_val_if_fail(doc != NULL, NULL);
+    Document *snap = g_new0(Document, 1);
+    snap->pages = g_ptr_array_new_full(doc->pages->len, (GDestroyNotify)page_unref);
+    for (guint i = 0; i < doc->pages->len; i++) {
+        g_ptr_array_add(snap->pages, page_ref((Page*)g_ptr_array_index(doc->pages, i)));
+    }
+    snap->current_page = doc->current_page;
+    return snap;
+}
+
+Page *document_get_page_for_write(Document *doc, guint index) {
+    g_return_val_if_fail(doc != NULL && index < doc->pages->len, NULL);
+    Page *p = (Page*)g_ptr_array_index(doc->pages, index);
+    // Only the document can hand out new references, so a count of one means
+    // no snapshot can be reading this page.
+    if (g_atomic_int_get(&p->ref_count) == 1) {
+        p->stamp = next_stamp(); // the caller is about to change it
+        return p;
+    }
+    Page *clone = page_copy(p);
+    clone->uid = p->uid; // same page, so caches keyed by uid stay usable
+    g_ptr_array_index(doc->pages, index) = clone;
+    page_unref(p);
+    return clone;
+}
+
+Page *document_current_page_for_write(Document *doc) {
+    g_return_val_if_fail(doc != NULL, NULL);
+    return document_get_page_for_write(doc, (guint)CLAMP(doc->current_page, 0, (int)doc->pages->len - 1));
+}
+
 ImageItem *image_item_new(GdkPixbuf *pixbuf) {
     g_return_val_if_fail(pixbuf != NULL, NULL);
+    ImageSource *src = image_source_new_from_pixbuf(pixbuf);
+    ImageItem *it = image_item_new_from_source(src);
+    image_source_unref(src);
+    return it;
+}
+
+ImageItem *image_item_new_from_source(ImageSource *source) {
+    g_return_val_if_fail(source != NULL, NULL);
     ImageItem *it = g_new0(ImageItem, 1);
-    it->pixbuf = g_object_ref(pixbuf);
-    int w = gdk_pixbuf_get_width(pixbuf);
-    int h = gdk_pixbuf_get_height(pixbuf);
+    it->source = image_source_ref(source);
+    int w = image_source_get_width(source);
+    int h = image_source_get_height(source);
     it->crop_x = 0; it->crop_y = 0; it->crop_w = w; it->crop_h = h;
     // Default size: fit width to 1/2 A4 width, keep aspect
-    double target_w = A4_WIDTH_PT * 0.5;
+    double target_w = IMAGE_ITEM_DEFAULT_WIDTH_PT;
     double scale = target_w / (double)w;
     it->width = target_w;
     it->height = h * scale;
@@ -107,10 +195,19 @@ ImageItem *image_item_new(GdkPixbuf *pixbuf) {
 
 void image_item_free(ImageItem *item) {
     if (!item) return;
-    g_clear_object(&item->pixbuf);
+    g_clear_pointer(&item->source, image_source_unref);
     g_free(item);
 }
 
+ImageItem *image_item_copy(const ImageItem *item) {
+    g_return_val_if_fail(item != NULL, NULL);
+    ImageItem *it = g_new0(ImageItem, 1);
+    *it = *item;
+    // pixel data is immutable once loaded, so clones share it
+    if (it->source) image_source_ref(it->source);
+    return it;
+}
+
 void page_add_item(Page *page, ImageItem *item) {
     g_return_if_fail(page != NULL && item != NULL);
     // Append to end to bring to front
@@ -131,6 +228,16 @@ void page_bring_to_front(Page *page, ImageItem *item) {
     page->items = g_list_concat(page->items, link); // move to tail (front)
 }
 
+ImageItem *page_item_at(Page *page, double x, double y) {
+    g_return_val_if_fail(page != NULL, NULL);
+    // Iterate from front (tail) to back
+    for (GList *l = g_list_last(page->items); l; l = l->prev) {
+        ImageItem *it = (ImageItem*)l->data;
+        if (x >= it->x && y >= it->y && x <= it->x + it->width && y <= it->y + it->height) return it;
+    }
+    return NULL;
+}
+
 Stroke *stroke_new(double r, double g, double b, double a, double width) {
     Stroke *s = g_new0(Stroke, 1);
     s->points = g_array_new(FALSE, FALSE, sizeof(Point));
@@ -148,6 +255,15 @@ void stroke_free(Stroke *stroke) {
     g_free(stroke);
 }
 
+Stroke *stroke_copy(const Stroke *stroke) {
+    g_return_val_if_fail(stroke != NULL, NULL);
+    Stroke *s = stroke_new(stroke->r, stroke->g, stroke->b, stroke->a, stroke->width);
+    if (stroke->points && stroke->points->len > 0) {
+        g_array_append_vals(s->points, stroke->points->data, stroke->points->len);
+    }
+    return s;
+}
+
 void stroke_add_point(Stroke *stroke, double x, double y) {
     g_return_if_fail(stroke != NULL && stroke->points != NULL);
     Point p = {x, y};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <gtk/gtk.h>
+#include "image_source.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,6 +10,8 @@ extern "C" {
 // A4 size in typographic points (1pt = 1/72 inch)
 #define A4_WIDTH_PT  595.275590551 // 210mm
 #define A4_HEIGHT_PT 841.889763780 // 297mm
+// Width new image items are placed at
+#define IMAGE_ITEM_DEFAULT_WIDTH_PT (A4_WIDTH_PT * 0.5)
 
 typedef struct _Point {
     double x, y;
@@ -21,7 +24,7 @@ typedef struct _Stroke {
 } Stroke;
 
 typedef struct _ImageItem {
-    GdkPixbuf *pixbuf;          // referenced image
+    ImageSource *source;        // shared pixel data
     double x, y;                // top-left position in page points
     double width, height;       // size on page in points
     int crop_x, crop_y;         // crop origin in source pixels
@@ -31,6 +34,9 @@ typedef struct _ImageItem {
 typedef struct _Page {
     GList *items;               // list of ImageItem* (front at tail)
     GList *strokes;             // list of Stroke* (drawing strokes)
+    gint ref_count;             // shared between a document and its snapshots
+    guint stamp;                // unique per content version, renewed on every write access
+    guint uid;                  // identity of the page, kept by copy-on-write clones
 } Page;
 
 typedef struct _Document {
@@ -46,16 +52,40 @@ void document_move_page_up(Document *doc);
 void document_move_page_down(Document *doc);
 Page *document_current_page(Document *doc);
 int document_page_count(const Document *doc);
+// Index of the page with the given uid, or -1.
+int document_find_page(const Document *doc, guint uid);
+// Puts page at index, taking over the caller's reference.
+void document_replace_page(Document *doc, guint index, Page *page);
+
+// Copy-on-write snapshots. A snapshot shares every Page with the live document
+// and is O(pages) to take; it must be treated as read-only and may be handed to
+// a worker thread. Code that edits a page of the live document must fetch it
+// through document_get_page_for_write(), which clones the page first if a
+// snapshot still references it and gives it a new stamp so render caches
+// keyed on the old stamp stop matching.
+Document *document_snapshot(Document *doc);
+Page *document_get_page_for_write(Document *doc, guint index);
+Page *document_current_page_for_write(Document *doc);
+
+Page *page_new(void);
+Page *page_ref(Page *page);
+void page_unref(Page *page);
+Page *page_copy(const Page *page);
 
 ImageItem *image_item_new(GdkPixbuf *pixbuf);
+ImageItem *image_item_new_from_source(ImageSource *source);
 void image_item_free(ImageItem *item);
+ImageItem *image_item_copy(const ImageItem *item);
 
 void page_add_item(Page *page, ImageItem *item);
 void page_remove_item(Page *page, ImageItem *item);
 void page_bring_to_front(Page *page, ImageItem *item);
+// Topmost item containing the point (in page points), or NULL.
+ImageItem *page_item_at(Page *page, double x, double y);
 
 Stroke *stroke_new(double r, double g, double b, double a, double width);
 void stroke_free(Stroke *stroke);
+Stroke *stroke_copy(const Stroke *stroke);
 void stroke_add_point(Stroke *stroke, double x, double y);
 
 void page_add_stroke(Page *page, Stroke *stroke);
@@ -1,38 +1,142 @@
 #include "image_io.h"
+#include <string.h>
 
-GdkPixbuf *load_pixbuf_from_file(const char *path, GError **error) {
-    g_return_val_if_fail(path != NULL, NULL);
-    return gdk_pixbuf_new_from_file(path, error);
-}
-
-GdkPixbuf *clipboard_get_image_sync(GtkWidget *for_widget) {
-    GtkClipboard *cb = gtk_widget_get_clipboard(for_widget, GDK_SELECTION_CLIPBOARD);
-    if (!cb) return NULL;
-    // Prefer image directly
-    GdkPixbuf *img = gtk_clipboard_wait_for_image(cb);
-    if (img) return img;
-    // Try uris
-    gchar **uris = gtk_clipboard_wait_for_uris(cb);
-    if (uris && uris[0]) {
-        gchar *filename = g_filename_from_uri(uris[0], NULL, NULL);
-        if (filename) {
-            GError *err = NULL;
-            GdkPixbuf *pb = gdk_pixbuf_new_from_file(filename, &err);
-            g_free(filename);
-            g_strfreev(uris);
-            if (pb) return pb;
-            if (err) g_error_free(err);
+gboolean path_looks_like_image(const char *path) {
+    g_return_val_if_fail(path != NULL, FALSE);
+    gchar *name = g_path_get_basename(path);
+    gboolean ok = name[0] != '.' && !g_str_has_suffix(name, "~");
+    if (ok) {
+        gchar *type = g_content_type_guess(name, NULL, 0, NULL);
+        gchar *mime = g_content_type_get_mime_type(type);
+        ok = mime && g_str_has_prefix(mime, "image/");
+        g_free(mime);
+        g_free(type);
+    }
+    g_free(name);
+    return ok;
+}
+
+// Every step below gets the GTask as its user data and either passes it on
+// to the next request or completes it.
+
+typedef struct {
+    GtkClipboard *clipboard;
+    ImportPolicy policy;
+} PasteJob;
+
+static gboolean paste_cancelled(GTask *task) {
+    GError *error = NULL;
+    if (!g_cancellable_set_error_if_cancelled(g_task_get_cancellable(task), &error)) return FALSE;
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return TRUE;
+}
+
+static void on_paste_loaded(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    (void)source_object;
+    GTask *task = G_TASK(user_data);
+    GError *error = NULL;
+    ImageSource *src = import_policy_finish(res, &error);
+    if (src) g_task_return_pointer(task, src, (GDestroyNotify)image_source_unref);
+    else g_task_return_error(task, error);
+    g_object_unref(task);
+}
+
+static void paste_file(GTask *task, const char *path) {
+    PasteJob *job = (PasteJob*)g_task_get_task_data(task);
+    import_policy_load_file_async(&job->policy, path, g_task_get_cancellable(task), on_paste_loaded, task);
+}
+
+static void on_text(GtkClipboard *cb, const gchar *text, gpointer user_data) {
+    (void)cb;
+    GTask *task = G_TASK(user_data);
+    if (paste_cancelled(task)) return;
+    gchar *path = text ? g_strstrip(g_strdup(text)) : NULL;
+    if (path && g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+        paste_file(task, path);
+    } else {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "The clipboard holds no image");
+        g_object_unref(task);
+    }
+    g_free(path);
+}
+
+static void on_uris(GtkClipboard *cb, gchar **uris, gpointer user_data) {
+    GTask *task = G_TASK(user_data);
+    if (paste_cancelled(task)) return;
+    gchar *filename = uris && uris[0] ? g_filename_from_uri(uris[0], NULL, NULL) : NULL;
+    if (filename) paste_file(task, filename);
+    else gtk_clipboard_request_text(cb, on_text, task);
+    g_free(filename);
+}
+
+// Last resort for image targets we do not know by name: GTK decodes those on
+// the main thread, only the policy runs on the worker.
+static void on_image(GtkClipboard *cb, GdkPixbuf *pixbuf, gpointer user_data) {
+    GTask *task = G_TASK(user_data);
+    if (paste_cancelled(task)) return;
+    if (!pixbuf) {
+        gtk_clipboard_request_uris(cb, on_uris, task);
+        return;
+    }
+    PasteJob *job = (PasteJob*)g_task_get_task_data(task);
+    ImageSource *src = image_source_new_from_pixbuf(pixbuf);
+    import_policy_apply_async(&job->policy, src, g_task_get_cancellable(task), on_paste_loaded, task);
+    image_source_unref(src);
+}
+
+static void on_image_contents(GtkClipboard *cb, GtkSelectionData *data, gpointer user_data) {
+    GTask *task = G_TASK(user_data);
+    if (paste_cancelled(task)) return;
+    gint len = data ? gtk_selection_data_get_length(data) : -1;
+    if (len <= 0) {
+        gtk_clipboard_request_image(cb, on_image, task);
+        return;
+    }
+    // Encoded bytes are decoded on the worker, not here
+    PasteJob *job = (PasteJob*)g_task_get_task_data(task);
+    GBytes *bytes = g_bytes_new(gtk_selection_data_get_data(data), (gsize)len);
+    import_policy_load_bytes_async(&job->policy, bytes, g_task_get_cancellable(task), on_paste_loaded, task);
+    g_bytes_unref(bytes);
+}
+
+static void on_targets(GtkClipboard *cb, GdkAtom *atoms, gint n_atoms, gpointer user_data) {
+    GTask *task = G_TASK(user_data);
+    if (paste_cancelled(task)) return;
+    static const char *preferred[] = { "image/png", "image/jpeg", "image/webp", "image/gif", "image/bmp", "image/tiff" };
+    for (guint p = 0; p < G_N_ELEMENTS(preferred); p++) {
+        for (gint i = 0; i < n_atoms; i++) {
+            gchar *name = gdk_atom_name(atoms[i]);
+            gboolean match = g_strcmp0(name, preferred[p]) == 0;
+            g_free(name);
+            if (match) {
+                gtk_clipboard_request_contents(cb, atoms[i], on_image_contents, task);
+                return;
+            }
         }
     }
-    if (uris) g_strfreev(uris);
-    // Try text path
-    gchar *text = gtk_clipboard_wait_for_text(cb);
-    if (text) {
-        GError *err = NULL;
-        GdkPixbuf *pb = gdk_pixbuf_new_from_file(text, &err);
-        g_free(text);
-        if (pb) return pb;
-        if (err) g_error_free(err);
+    if (atoms && gtk_targets_include_image(atoms, n_atoms, FALSE)) gtk_clipboard_request_image(cb, on_image, task);
+    else gtk_clipboard_request_uris(cb, on_uris, task);
+}
+
+void clipboard_paste_async(GtkWidget *for_widget, const ImportPolicy *policy, GCancellable *cancellable,
+                           GAsyncReadyCallback callback, gpointer user_data) {
+    g_return_if_fail(GTK_IS_WIDGET(for_widget) && policy != NULL);
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_source_tag(task, clipboard_paste_async);
+    PasteJob *job = g_new0(PasteJob, 1);
+    job->clipboard = gtk_widget_get_clipboard(for_widget, GDK_SELECTION_CLIPBOARD);
+    job->policy = *policy;
+    g_task_set_task_data(task, job, g_free);
+    if (!job->clipboard) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No clipboard");
+        g_object_unref(task);
+        return;
     }
-    return NULL;
+    gtk_clipboard_request_targets(job->clipboard, on_targets, task);
+}
+
+ImageSource *clipboard_paste_finish(GAsyncResult *result, GError **error) {
+    g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+    return (ImageSource*)g_task_propagate_pointer(G_TASK(result), error);
 }
@@ -1,5 +1,17 @@
 #pragma once
 #include <gtk/gtk.h>
+#include "import_policy.h"
 
-GdkPixbuf *load_pixbuf_from_file(const char *path, GError **error);
-GdkPixbuf *clipboard_get_image_sync(GtkWidget *for_widget);
+// Whether path is named like an image file. Hidden and backup files, where
+// tools keep partly written files, never are.
+gboolean path_looks_like_image(const char *path);
+
+// Fetches an image from the clipboard without blocking: image data first,
+// then the first file URI, then text naming a file. Clipboard owners answer
+// through callbacks and the image is decoded and put through policy on a
+// worker thread. Cancelling drops the paste at the next step.
+void clipboard_paste_async(GtkWidget *for_widget, const ImportPolicy *policy, GCancellable *cancellable,
+                           GAsyncReadyCallback callback, gpointer user_data);
+// Returns a new reference to the pasted image, or NULL with error set:
+// G_IO_ERROR_NOT_FOUND if the clipboard holds no image.
+ImageSource *clipboard_paste_finish(GAsyncResult *result, GError **error);
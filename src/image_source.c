@@ -0,0 +1,668 @@
+#include "image_source.h"
+#include "pixconv.h"
+#include "trace.h"
+
+struct _ImageSource {
+    gint ref_count;
+    int width, height;
+    GBytes *encoded;            // compressed form, NULL until first needed for pasted pixels
+    GdkPixbuf *pixbuf;          // decoded pixels, RGB if opaque; NULL while evicted
+    GBytes *gray;               // decoded luminance (stride = width) instead of pixbuf for gray images
+    cairo_surface_t *surface;   // pixbuf converted for cairo, NULL until drawn
+    gsize decoded_bytes;        // accounted size of pixbuf and surface
+    gsize pixel_bytes;          // size of the pixbuf or gray store once decoded, kept across evictions
+    GList lru_link;             // position in the LRU queue while decoded
+    gboolean in_lru;
+    gboolean decode_failed;     // the compressed data is broken; never decoded again
+    ImageSource *original;      // full-resolution source this was scaled from
+    gchar *content_hash;        // checksum of encoded, computed on first request
+};
+
+// One lock guards the LRU queue, the usage counter and the pixbuf, gray,
+// surface and encoded fields of every source. Decoding, conversion and
+// encoding happen outside of it. A source is in the LRU exactly while its
+// pixbuf or gray pixels are set.
+static GMutex cache_lock;
+static GQueue lru = G_QUEUE_INIT;   // most recently used at head
+static gsize usage_bytes = 0;
+static gsize budget_bytes = 0;
+
+static gsize default_budget(void) {
+    static gsize budget = 0;
+    if (g_once_init_enter(&budget)) {
+        gsize mb = 1024;
+        const gchar *env = g_getenv("CHEATSHEET_IMAGE_BUDGET_MB");
+        if (env && *env) {
+            guint64 v = g_ascii_strtoull(env, NULL, 10);
+            if (v > 0) mb = (gsize)v;
+        }
+        g_once_init_leave(&budget, mb * 1024 * 1024);
+    }
+    return budget;
+}
+
+static gsize current_budget_locked(void) {
+    return budget_bytes ? budget_bytes : default_budget();
+}
+
+// Called after every change to usage_bytes so the trace shows the cache filling
+// and draining.
+static void sample_usage_locked(void) {
+    trace_counter("image.cache_bytes", (gint64)usage_bytes);
+}
+
+static void lru_touch_locked(ImageSource *src) {
+    if (src->in_lru) g_queue_unlink(&lru, &src->lru_link);
+    src->lru_link.data = src;
+    g_queue_push_head_link(&lru, &src->lru_link);
+    src->in_lru = TRUE;
+}
+
+static void lru_remove_locked(ImageSource *src) {
+    if (!src->in_lru) return;
+    g_queue_unlink(&lru, &src->lru_link);
+    src->in_lru = FALSE;
+}
+
+// Picks the smallest store for freshly decoded pixels: one byte per pixel for
+// opaque gray images, packed RGB for opaque RGBA ones, the pixbuf as it is
+// otherwise. Sets exactly one of *color and *gray. Called outside the lock.
+static void compact_pixels(GdkPixbuf *decoded, GdkPixbuf **color, GBytes **gray) {
+    TRACE_SCOPE("image.compact");
+    *color = NULL;
+    *gray = NULL;
+    int channels = gdk_pixbuf_get_n_channels(decoded);
+    if (gdk_pixbuf_get_bits_per_sample(decoded) != 8 || (channels != 3 && channels != 4)) {
+        *color = g_object_ref(decoded);
+        return;
+    }
+    int w = gdk_pixbuf_get_width(decoded), h = gdk_pixbuf_get_height(decoded);
+    int stride = gdk_pixbuf_get_rowstride(decoded);
+    const guint8 *px = gdk_pixbuf_read_pixels(decoded);
+    gboolean opaque = FALSE, is_gray = FALSE;
+    pixconv_analyze(px, stride, w, h, channels, &opaque, &is_gray);
+    if (opaque && is_gray) {
+        gsize size = (gsize)w * (gsize)h;
+        guint8 *lum = g_try_malloc(size);
+        if (lum) {
+            pixconv_to_gray(px, stride, channels, lum, w, w, h);
+            *gray = g_bytes_new_take(lum, size);
+            return;
+        }
+    } else if (opaque && channels == 4) {
+        GdkPixbuf *rgb = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, w, h);
+        if (rgb) {
+            pixconv_rgba_to_rgb(px, stride, gdk_pixbuf_get_pixels(rgb), gdk_pixbuf_get_rowstride(rgb), w, h);
+            *color = rgb;
+            return;
+        }
+    }
+    *color = g_object_ref(decoded);
+}
+
+static GdkPixbuf *expand_gray(GBytes *gray, int width, int height) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+    if (!pixbuf) return NULL;
+    pixconv_gray_to_rgb(g_bytes_get_data(gray, NULL), width, gdk_pixbuf_get_pixels(pixbuf),
+                        gdk_pixbuf_get_rowstride(pixbuf), width, height);
+    return pixbuf;
+}
+
+static cairo_surface_t *surface_from_gray(GBytes *gray, int width, int height) {
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+    cairo_surface_flush(surface);
+    pixconv_gray_to_rgb24(g_bytes_get_data(gray, NULL), width, cairo_image_surface_get_data(surface),
+                          cairo_image_surface_get_stride(surface), width, height);
+    cairo_surface_mark_dirty(surface);
+    return surface;
+}
+
+// Stores compacted pixels in the cache unless another thread decoded them
+// first.
+static void install_pixels_locked(ImageSource *src, GdkPixbuf *color, GBytes *gray) {
+    if (!src->pixbuf && !src->gray) {
+        if (gray) {
+            src->gray = g_bytes_ref(gray);
+            src->decoded_bytes = g_bytes_get_size(gray);
+        } else {
+            src->pixbuf = g_object_ref(color);
+            src->decoded_bytes = gdk_pixbuf_get_byte_length(color);
+        }
+        src->pixel_bytes = src->decoded_bytes;
+        usage_bytes += src->decoded_bytes;
+        sample_usage_locked();
+    }
+    lru_touch_locked(src);
+}
+
+// New references to whichever pixel store is cached; FALSE if neither is.
+static gboolean peek_pixels_locked(ImageSource *src, GdkPixbuf **color, GBytes **gray) {
+    *color = src->pixbuf ? g_object_ref(src->pixbuf) : NULL;
+    *gray = src->gray ? g_bytes_ref(src->gray) : NULL;
+    return *color || *gray;
+}
+
+// Consumes the references from peek_pixels_locked() and returns a pixbuf of
+// them. Gray pixels are expanded into a new RGB pixbuf that is not cached.
+static GdkPixbuf *pixels_to_pixbuf(ImageSource *src, GdkPixbuf *color, GBytes *gray) {
+    if (color) return color;
+    if (!gray) return NULL;
+    GdkPixbuf *pixbuf = expand_gray(gray, src->width, src->height);
+    g_bytes_unref(gray);
+    return pixbuf;
+}
+
+static gsize surface_bytes(cairo_surface_t *surface) {
+    return (gsize)cairo_image_surface_get_stride(surface) * (gsize)cairo_image_surface_get_height(surface);
+}
+
+static cairo_surface_t *install_surface_locked(ImageSource *src, cairo_surface_t *surface) {
+    if (!src->surface && (src->pixbuf || src->gray)) {
+        src->surface = cairo_surface_reference(surface);
+        gsize bytes = surface_bytes(surface);
+        src->decoded_bytes += bytes;
+        usage_bytes += bytes;
+        sample_usage_locked();
+    }
+    if (src->in_lru) lru_touch_locked(src);
+    return src->surface ? src->surface : surface;
+}
+
+static GdkPixbuf *decode_bytes(GBytes *bytes, GError **error) {
+    TRACE_SCOPE("image.decode");
+    GInputStream *stream = g_memory_input_stream_new_from_bytes(bytes);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream(stream, NULL, error);
+    g_object_unref(stream);
+    return pixbuf;
+}
+
+static GBytes *encode_png(GdkPixbuf *pixbuf, GError **error) {
+    TRACE_SCOPE("image.encode_png");
+    gchar *buffer = NULL;
+    gsize size = 0;
+    if (!gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &size, "png", error, NULL)) return NULL;
+    return g_bytes_new_take(buffer, size);
+}
+
+// Takes a reference unless the count already dropped to zero, in which case
+// the source is being freed.
+static gboolean ref_if_alive(ImageSource *src) {
+    for (;;) {
+        gint count = g_atomic_int_get(&src->ref_count);
+        if (count == 0) return FALSE;
+        if (g_atomic_int_compare_and_exchange(&src->ref_count, count, count + 1)) return TRUE;
+    }
+}
+
+// Drops the least recently used drawing surface other than keep's. A surface
+// takes 4 bytes per pixel on top of the compact pixels and is rebuilt from
+// them without decoding, so surfaces go before any pixels do. Returns FALSE
+// if there is none to drop.
+static gboolean drop_surface_locked(ImageSource *keep, cairo_surface_t **dropped) {
+    for (GList *l = lru.tail; l; l = l->prev) {
+        ImageSource *src = (ImageSource*)l->data;
+        if (src == keep || !src->surface) continue;
+        gsize bytes = surface_bytes(src->surface);
+        *dropped = src->surface;
+        src->surface = NULL;
+        src->decoded_bytes -= bytes;
+        usage_bytes -= bytes;
+        sample_usage_locked();
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Evict least recently used surfaces, then pixels, until usage fits the
+// budget. The source that triggered the check is never chosen. Sources that
+// were pasted as raw pixels are PNG-encoded first so they can be decoded
+// again later.
+static void enforce_budget(ImageSource *keep) {
+    for (;;) {
+        g_mutex_lock(&cache_lock);
+        if (usage_bytes <= current_budget_locked()) { g_mutex_unlock(&cache_lock); return; }
+        cairo_surface_t *dropped = NULL;
+        if (drop_surface_locked(keep, &dropped)) {
+            g_mutex_unlock(&cache_lock);
+            cairo_surface_destroy(dropped);
+            continue;
+        }
+        // A victim that has to be encoded outside the lock needs a reference.
+        // Sources whose last reference is being dropped are passed over; the
+        // freeing thread takes them out of the LRU as soon as it gets the lock.
+        ImageSource *victim = NULL;
+        for (GList *l = lru.tail; l; l = l->prev) {
+            ImageSource *candidate = (ImageSource*)l->data;
+            if (candidate == keep) continue;
+            if (candidate->encoded || ref_if_alive(candidate)) { victim = candidate; break; }
+        }
+        if (!victim) { g_mutex_unlock(&cache_lock); return; }
+
+        if (victim->encoded) {
+            GdkPixbuf *drop = victim->pixbuf;
+            GBytes *drop_gray = victim->gray;
+            cairo_surface_t *drop_surface = victim->surface;
+            victim->pixbuf = NULL;
+            victim->gray = NULL;
+            victim->surface = NULL;
+            usage_bytes -= victim->decoded_bytes;
+            sample_usage_locked();
+            victim->decoded_bytes = 0;
+            lru_remove_locked(victim);
+            g_mutex_unlock(&cache_lock);
+            if (drop) g_object_unref(drop);
+            if (drop_gray) g_bytes_unref(drop_gray);
+            if (drop_surface) cairo_surface_destroy(drop_surface);
+            continue;
+        }
+
+        GdkPixbuf *color = NULL;
+        GBytes *gray = NULL;
+        peek_pixels_locked(victim, &color, &gray);
+        g_mutex_unlock(&cache_lock);
+        GError *err = NULL;
+        GdkPixbuf *pixels = pixels_to_pixbuf(victim, color, gray);
+        GBytes *enc = pixels ? encode_png(pixels, &err) : NULL;
+        if (pixels) g_object_unref(pixels);
+        g_mutex_lock(&cache_lock);
+        if (enc && !victim->encoded) {
+            victim->encoded = enc;
+            enc = NULL;
+        } else if (!enc) {
+            // Cannot be restored once dropped, so keep it resident and stop
+            // considering it for eviction.
+            g_warning("Cannot evict image: %s", err ? err->message : "encoding failed");
+            lru_remove_locked(victim);
+        }
+        g_mutex_unlock(&cache_lock);
+        if (enc) g_bytes_unref(enc);
+        if (err) g_error_free(err);
+        image_source_unref(victim);
+    }
+}
+
+ImageSource *image_source_new_from_pixbuf(GdkPixbuf *pixbuf) {
+    g_return_val_if_fail(pixbuf != NULL, NULL);
+    ImageSource *src = g_new0(ImageSource, 1);
+    src->ref_count = 1;
+    src->width = gdk_pixbuf_get_width(pixbuf);
+    src->height = gdk_pixbuf_get_height(pixbuf);
+    GdkPixbuf *color = NULL;
+    GBytes *gray = NULL;
+    compact_pixels(pixbuf, &color, &gray);
+    g_mutex_lock(&cache_lock);
+    install_pixels_locked(src, color, gray);
+    g_mutex_unlock(&cache_lock);
+    if (color) g_object_unref(color);
+    if (gray) g_bytes_unref(gray);
+    enforce_budget(src);
+    return src;
+}
+
+static void on_size_prepared(GdkPixbufLoader *loader, int width, int height, gpointer user_data) {
+    (void)loader;
+    int *size = (int*)user_data;
+    size[0] = width;
+    size[1] = height;
+}
+
+ImageSource *image_source_new_from_bytes(GBytes *encoded, GError **error) {
+    g_return_val_if_fail(encoded != NULL, NULL);
+    // Feed the loader until it knows the image size; the pixels are decoded
+    // lazily on first use.
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+    int size[2] = {0, 0};
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(on_size_prepared), size);
+    gsize len = 0;
+    const guchar *data = g_bytes_get_data(encoded, &len);
+    gsize off = 0;
+    const gsize chunk = 16 * 1024;
+    while (off < len && size[0] <= 0) {
+        gsize n = MIN(chunk, len - off);
+        if (!gdk_pixbuf_loader_write(loader, data + off, n, error)) {
+            gdk_pixbuf_loader_close(loader, NULL);
+            g_object_unref(loader);
+            return NULL;
+        }
+        off += n;
+    }
+    GdkPixbuf *decoded = NULL;
+    if (off >= len) {
+        // The whole image went through the loader anyway, keep its result.
+        if (!gdk_pixbuf_loader_close(loader, error)) {
+            g_object_unref(loader);
+            return NULL;
+        }
+        decoded = gdk_pixbuf_loader_get_pixbuf(loader);
+        if (decoded) {
+            g_object_ref(decoded);
+            size[0] = gdk_pixbuf_get_width(decoded);
+            size[1] = gdk_pixbuf_get_height(decoded);
+        }
+    } else {
+        gdk_pixbuf_loader_close(loader, NULL); // stopped early on purpose
+    }
+    g_object_unref(loader);
+    if (size[0] <= 0 || size[1] <= 0) {
+        g_set_error(error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE, "Image has no size");
+        if (decoded) g_object_unref(decoded);
+        return NULL;
+    }
+
+    ImageSource *src = g_new0(ImageSource, 1);
+    src->ref_count = 1;
+    src->width = size[0];
+    src->height = size[1];
+    src->encoded = g_bytes_ref(encoded);
+    if (decoded) {
+        GdkPixbuf *color = NULL;
+        GBytes *gray = NULL;
+        compact_pixels(decoded, &color, &gray);
+        g_object_unref(decoded);
+        g_mutex_lock(&cache_lock);
+        install_pixels_locked(src, color, gray);
+        g_mutex_unlock(&cache_lock);
+        if (color) g_object_unref(color);
+        if (gray) g_bytes_unref(gray);
+        enforce_budget(src);
+    }
+    return src;
+}
+
+ImageSource *image_source_new_from_file(const char *path, GError **error) {
+    g_return_val_if_fail(path != NULL, NULL);
+    gchar *contents = NULL;
+    gsize len = 0;
+    if (!g_file_get_contents(path, &contents, &len, error)) return NULL;
+    GBytes *bytes = g_bytes_new_take(contents, len);
+    ImageSource *src = image_source_new_from_bytes(bytes, error);
+    g_bytes_unref(bytes);
+    return src;
+}
+
+static gboolean is_jpeg(GBytes *bytes) {
+    gsize len = 0;
+    const guchar *data = bytes ? g_bytes_get_data(bytes, &len) : NULL;
+    return len >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff;
+}
+
+ImageSource *image_source_new_scaled(ImageSource *src, int width, int height, GError **error) {
+    g_return_val_if_fail(src != NULL && width > 0 && height > 0, NULL);
+    TRACE_SCOPE("image.scale");
+    // Use the cached pixels if there are any, but do not put a decode of the
+    // full-size image into the cache just to throw it away again.
+    g_mutex_lock(&cache_lock);
+    GdkPixbuf *color = NULL;
+    GBytes *gray = NULL;
+    peek_pixels_locked(src, &color, &gray);
+    GBytes *encoded = src->encoded ? g_bytes_ref(src->encoded) : NULL;
+    g_mutex_unlock(&cache_lock);
+    GdkPixbuf *full = pixels_to_pixbuf(src, color, gray);
+    if (!full && encoded) full = decode_bytes(encoded, error);
+    if (!full) {
+        if (encoded) g_bytes_unref(encoded);
+        else g_set_error(error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_FAILED, "Image has no pixel data");
+        return NULL;
+    }
+    GdkPixbuf *scaled = gdk_pixbuf_scale_simple(full, width, height, GDK_INTERP_HYPER);
+    gboolean alpha = gdk_pixbuf_get_has_alpha(full);
+    g_object_unref(full);
+    if (!scaled) {
+        if (encoded) g_bytes_unref(encoded);
+        g_set_error(error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY, "Cannot scale image");
+        return NULL;
+    }
+
+    // Photos stay JPEG; a PNG of the scaled pixels could be larger than the
+    // original file. Everything else gets its PNG when first needed.
+    GBytes *scaled_encoded = NULL;
+    if (!alpha && is_jpeg(encoded)) {
+        gchar *buffer = NULL;
+        gsize size = 0;
+        if (gdk_pixbuf_save_to_buffer(scaled, &buffer, &size, "jpeg", NULL, "quality", "92", NULL)) {
+            scaled_encoded = g_bytes_new_take(buffer, size);
+        }
+    }
+    if (encoded) g_bytes_unref(encoded);
+
+    ImageSource *out = image_source_new_from_pixbuf(scaled);
+    g_object_unref(scaled);
+    if (scaled_encoded) {
+        g_mutex_lock(&cache_lock);
+        if (!out->encoded) {
+            out->encoded = scaled_encoded;
+            scaled_encoded = NULL;
+        }
+        g_mutex_unlock(&cache_lock);
+        if (scaled_encoded) g_bytes_unref(scaled_encoded);
+    }
+    return out;
+}
+
+void image_source_set_original(ImageSource *src, ImageSource *original) {
+    g_return_if_fail(src != NULL && original != src);
+    if (original) image_source_ref(original);
+    if (src->original) image_source_unref(src->original);
+    src->original = original;
+}
+
+ImageSource *image_source_get_original(ImageSource *src) {
+    g_return_val_if_fail(src != NULL, NULL);
+    return src->original;
+}
+
+ImageSource *image_source_ref(ImageSource *src) {
+    g_return_val_if_fail(src != NULL, NULL);
+    g_atomic_int_inc(&src->ref_count);
+    return src;
+}
+
+void image_source_unref(ImageSource *src) {
+    if (!src) return;
+    if (!g_atomic_int_dec_and_test(&src->ref_count)) return;
+    g_mutex_lock(&cache_lock);
+    lru_remove_locked(src);
+    usage_bytes -= src->decoded_bytes;
+    if (src->decoded_bytes) sample_usage_locked();
+    g_mutex_unlock(&cache_lock);
+    g_clear_object(&src->pixbuf);
+    g_clear_pointer(&src->gray, g_bytes_unref);
+    g_clear_pointer(&src->surface, cairo_surface_destroy);
+    if (src->encoded) g_bytes_unref(src->encoded);
+    if (src->original) image_source_unref(src->original);
+    g_free(src->content_hash);
+    g_free(src);
+}
+
+int image_source_get_width(ImageSource *src) { return src ? src->width : 0; }
+int image_source_get_height(ImageSource *src) { return src ? src->height : 0; }
+
+// Returns new references to the cached pixels in *color or *gray, decoding
+// and compacting them first if they were evicted.
+static gboolean load_pixels(ImageSource *src, GdkPixbuf **color, GBytes **gray) {
+    g_mutex_lock(&cache_lock);
+    if (peek_pixels_locked(src, color, gray)) {
+        lru_touch_locked(src);
+        g_mutex_unlock(&cache_lock);
+        return TRUE;
+    }
+    GBytes *encoded = src->encoded && !src->decode_failed ? g_bytes_ref(src->encoded) : NULL;
+    g_mutex_unlock(&cache_lock);
+    if (!encoded) return FALSE;
+
+    GError *err = NULL;
+    GdkPixbuf *decoded = decode_bytes(encoded, &err);
+    g_bytes_unref(encoded);
+    if (!decoded) {
+        // Remember it so every later draw, tile and export skips the decode;
+        // warn only once even if several threads failed at the same time
+        g_mutex_lock(&cache_lock);
+        gboolean first = !src->decode_failed;
+        src->decode_failed = TRUE;
+        g_mutex_unlock(&cache_lock);
+        if (first) g_warning("Failed to decode image: %s", err ? err->message : "unknown");
+        if (err) g_error_free(err);
+        return FALSE;
+    }
+    GdkPixbuf *new_color = NULL;
+    GBytes *new_gray = NULL;
+    compact_pixels(decoded, &new_color, &new_gray);
+    g_object_unref(decoded);
+    g_mutex_lock(&cache_lock);
+    install_pixels_locked(src, new_color, new_gray);
+    peek_pixels_locked(src, color, gray);
+    g_mutex_unlock(&cache_lock);
+    if (new_color) g_object_unref(new_color);
+    if (new_gray) g_bytes_unref(new_gray);
+    enforce_budget(src);
+    return TRUE;
+}
+
+gboolean image_source_decode_failed(ImageSource *src) {
+    g_return_val_if_fail(src != NULL, FALSE);
+    g_mutex_lock(&cache_lock);
+    gboolean failed = src->decode_failed;
+    g_mutex_unlock(&cache_lock);
+    return failed;
+}
+
+GdkPixbuf *image_source_get_pixbuf(ImageSource *src) {
+    g_return_val_if_fail(src != NULL, NULL);
+    GdkPixbuf *color = NULL;
+    GBytes *gray = NULL;
+    if (!load_pixels(src, &color, &gray)) return NULL;
+    return pixels_to_pixbuf(src, color, gray);
+}
+
+gboolean image_source_preload(ImageSource *src) {
+    g_return_val_if_fail(src != NULL, FALSE);
+    GdkPixbuf *color = NULL;
+    GBytes *gray = NULL;
+    if (!load_pixels(src, &color, &gray)) return FALSE;
+    if (color) g_object_unref(color);
+    if (gray) g_bytes_unref(gray);
+    return TRUE;
+}
+
+cairo_surface_t *image_source_get_surface(ImageSource *src) {
+    g_return_val_if_fail(src != NULL, NULL);
+    g_mutex_lock(&cache_lock);
+    if (src->surface) {
+        cairo_surface_t *s = cairo_surface_reference(src->surface);
+        lru_touch_locked(src);
+        g_mutex_unlock(&cache_lock);
+        return s;
+    }
+    g_mutex_unlock(&cache_lock);
+
+    // Cairo has no 8-bit gray format, so gray pixels become an RGB24 surface.
+    GdkPixbuf *color = NULL;
+    GBytes *gray = NULL;
+    if (!load_pixels(src, &color, &gray)) return NULL;
+    cairo_surface_t *converted = NULL;
+    if (color) {
+        converted = pixconv_surface_from_pixbuf(color, 0, 0, gdk_pixbuf_get_width(color),
+                                                gdk_pixbuf_get_height(color));
+        g_object_unref(color);
+    } else {
+        converted = surface_from_gray(gray, src->width, src->height);
+        g_bytes_unref(gray);
+    }
+    if (!converted) return NULL;
+    g_mutex_lock(&cache_lock);
+    cairo_surface_t *s = cairo_surface_reference(install_surface_locked(src, converted));
+    g_mutex_unlock(&cache_lock);
+    cairo_surface_destroy(converted);
+    enforce_budget(src);
+    return s;
+}
+
+GBytes *image_source_get_encoded(ImageSource *src, GError **error) {
+    g_return_val_if_fail(src != NULL, NULL);
+    g_mutex_lock(&cache_lock);
+    if (src->encoded) {
+        GBytes *enc = g_bytes_ref(src->encoded);
+        g_mutex_unlock(&cache_lock);
+        return enc;
+    }
+    GdkPixbuf *color = NULL;
+    GBytes *gray = NULL;
+    peek_pixels_locked(src, &color, &gray);
+    g_mutex_unlock(&cache_lock);
+    GdkPixbuf *pixels = pixels_to_pixbuf(src, color, gray);
+    if (!pixels) {
+        g_set_error(error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_FAILED, "Image has no pixel data");
+        return NULL;
+    }
+    GBytes *enc = encode_png(pixels, error);
+    g_object_unref(pixels);
+    if (!enc) return NULL;
+    g_mutex_lock(&cache_lock);
+    if (!src->encoded) src->encoded = g_bytes_ref(enc);
+    g_mutex_unlock(&cache_lock);
+    return enc;
+}
+
+GBytes *image_source_peek_encoded(ImageSource *src) {
+    g_return_val_if_fail(src != NULL, NULL);
+    g_mutex_lock(&cache_lock);
+    GBytes *enc = src->encoded ? g_bytes_ref(src->encoded) : NULL;
+    g_mutex_unlock(&cache_lock);
+    return enc;
+}
+
+const char *image_source_get_content_hash(ImageSource *src) {
+    g_return_val_if_fail(src != NULL, NULL);
+    g_mutex_lock(&cache_lock);
+    const char *hash = src->content_hash;
+    GBytes *enc = !hash && src->encoded ? g_bytes_ref(src->encoded) : NULL;
+    g_mutex_unlock(&cache_lock);
+    if (hash || !enc) return hash;
+
+    gchar *fresh = g_compute_checksum_for_bytes(G_CHECKSUM_SHA1, enc);
+    g_bytes_unref(enc);
+    g_mutex_lock(&cache_lock);
+    if (!src->content_hash) {
+        src->content_hash = fresh;
+        fresh = NULL;
+    }
+    hash = src->content_hash;
+    g_mutex_unlock(&cache_lock);
+    g_free(fresh);
+    return hash;
+}
+
+void image_source_get_memory(ImageSource *src, ImageSourceMemory *memory) {
+    g_return_if_fail(src != NULL && memory != NULL);
+    g_mutex_lock(&cache_lock);
+    memory->pixel_bytes = src->pixel_bytes ? src->pixel_bytes : (gsize)src->width * (gsize)src->height * 4;
+    memory->pixels_known = src->pixel_bytes != 0;
+    memory->resident_bytes = src->decoded_bytes;
+    memory->encoded_bytes = src->encoded ? g_bytes_get_size(src->encoded) : 0;
+    g_mutex_unlock(&cache_lock);
+}
+
+void image_source_set_budget(gsize bytes) {
+    g_mutex_lock(&cache_lock);
+    budget_bytes = bytes;
+    g_mutex_unlock(&cache_lock);
+    enforce_budget(NULL);
+}
+
+gsize image_source_get_budget(void) {
+    g_mutex_lock(&cache_lock);
+    gsize b = current_budget_locked();
+    g_mutex_unlock(&cache_lock);
+    return b;
+}
+
+gsize image_source_get_usage(void) {
+    g_mutex_lock(&cache_lock);
+    gsize u = usage_bytes;
+    g_mutex_unlock(&cache_lock);
+    return u;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <gtk/gtk.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pixel data behind an ImageItem. A source keeps its compressed form (the
+// original file bytes, or a PNG made on demand) and decoded pixels that may be
+// evicted under the global decoded-image budget and are decoded again on the
+// next access. Decoded pixels are stored compactly: opaque images as RGB and
+// gray ones as one byte per pixel, expanded only when a pixbuf or surface is
+// asked for. Sources are immutable apart from that cache and are
+// safe to share between threads and document snapshots.
+typedef struct _ImageSource ImageSource;
+
+ImageSource *image_source_new_from_pixbuf(GdkPixbuf *pixbuf);
+// Takes a reference on encoded; only the image header is read up front.
+ImageSource *image_source_new_from_bytes(GBytes *encoded, GError **error);
+ImageSource *image_source_new_from_file(const char *path, GError **error);
+// New source with src resampled to width x height using GDK_INTERP_HYPER.
+// Slow for large images; meant for worker threads.
+ImageSource *image_source_new_scaled(ImageSource *src, int width, int height, GError **error);
+ImageSource *image_source_ref(ImageSource *src);
+void image_source_unref(ImageSource *src);
+
+int image_source_get_width(ImageSource *src);
+int image_source_get_height(ImageSource *src);
+
+// Returns a new reference to the decoded pixels, decoding them if they were
+// evicted. Gray images come back as a fresh RGB pixbuf each time. Returns NULL
+// if the data cannot be decoded.
+GdkPixbuf *image_source_get_pixbuf(ImageSource *src);
+// TRUE once decoding the compressed data has failed. Such a source is not
+// decoded again; pixel and surface getters return NULL straight away.
+gboolean image_source_decode_failed(ImageSource *src);
+// Decodes the pixels into the cache without handing them out. Returns FALSE
+// if the data cannot be decoded.
+gboolean image_source_preload(ImageSource *src);
+// Returns a new reference to the pixels as a cairo image surface, converting
+// and caching it alongside the decoded pixels. Cached surfaces are the first
+// thing given back when over budget. The surface must not be modified.
+cairo_surface_t *image_source_get_surface(ImageSource *src);
+// Returns a new reference to the compressed form, encoding a PNG if needed.
+GBytes *image_source_get_encoded(ImageSource *src, GError **error);
+// Like image_source_get_encoded() but returns NULL instead of encoding.
+GBytes *image_source_peek_encoded(ImageSource *src);
+// Checksum of the compressed form, equal for sources loaded from the same
+// file data; NULL while there is none. Computed once; owned by src.
+const char *image_source_get_content_hash(ImageSource *src);
+
+// Full-resolution source a scaled source was made from, kept so an item can
+// be re-cropped later. Crop rectangles of an ImageItem are always in the
+// pixels of its own source; multiply by original width / width to map them.
+// Set it before the source is shared. get returns a borrowed pointer or NULL.
+void image_source_set_original(ImageSource *src, ImageSource *original);
+ImageSource *image_source_get_original(ImageSource *src);
+
+// Memory held for one source.
+typedef struct {
+    gsize pixel_bytes;          // decoded pixels in their compact form
+    gboolean pixels_known;      // FALSE until first decoded; pixel_bytes is then the RGBA size
+    gsize resident_bytes;       // pixels and surface held by the cache right now
+    gsize encoded_bytes;        // compressed form, 0 if not made yet
+} ImageSourceMemory;
+
+void image_source_get_memory(ImageSource *src, ImageSourceMemory *memory);
+
+// Decoded-image budget shared by all sources. The default is 1024 MB and can
+// be overridden with the CHEATSHEET_IMAGE_BUDGET_MB environment variable.
+void image_source_set_budget(gsize bytes);
+gsize image_source_get_budget(void);
+// Bytes of decoded pixels currently held by the cache.
+gsize image_source_get_usage(void);
+
+#ifdef __cplusplus
+}
+#endif
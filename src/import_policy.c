@@ -0,0 +1,118 @@
+#include "import_policy.h"
+#include "document.h"
+#include <math.h>
+
+void import_policy_init_default(ImportPolicy *policy) {
+    g_return_if_fail(policy != NULL);
+    policy->max_dpi = IMPORT_DEFAULT_MAX_DPI;
+    policy->keep_original = FALSE;
+    const gchar *env = g_getenv("CHEATSHEET_IMPORT_MAX_DPI");
+    if (env && *env) {
+        double v = g_ascii_strtod(env, NULL);
+        if (v >= 0) policy->max_dpi = v;
+    }
+    env = g_getenv("CHEATSHEET_IMPORT_KEEP_ORIGINAL");
+    if (env && *env) policy->keep_original = g_strcmp0(env, "0") != 0;
+}
+
+int import_policy_max_width(const ImportPolicy *policy) {
+    g_return_val_if_fail(policy != NULL, 0);
+    if (policy->max_dpi <= 0) return 0;
+    return MAX(1, (int)ceil(IMAGE_ITEM_DEFAULT_WIDTH_PT / 72.0 * policy->max_dpi));
+}
+
+ImageSource *import_policy_apply(const ImportPolicy *policy, ImageSource *src, GError **error) {
+    g_return_val_if_fail(policy != NULL && src != NULL, NULL);
+    int max_w = import_policy_max_width(policy);
+    int w = image_source_get_width(src), h = image_source_get_height(src);
+    if (max_w <= 0 || w <= max_w) return image_source_ref(src);
+
+    int new_h = MAX(1, (int)lround((double)h * max_w / w));
+    ImageSource *scaled = image_source_new_scaled(src, max_w, new_h, error);
+    if (!scaled) return NULL;
+    if (policy->keep_original) {
+        ImageSource *orig = image_source_get_original(src);
+        image_source_set_original(scaled, orig ? orig : src);
+    }
+    return scaled;
+}
+
+typedef struct {
+    ImportPolicy policy;
+    gchar *path;                // load from here when set,
+    GBytes *bytes;              // or decode these,
+    ImageSource *source;        // or apply to this
+} ImportJob;
+
+static void import_job_free(gpointer data) {
+    ImportJob *job = (ImportJob*)data;
+    g_free(job->path);
+    if (job->bytes) g_bytes_unref(job->bytes);
+    if (job->source) image_source_unref(job->source);
+    g_free(job);
+}
+
+static void import_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    (void)source_object;
+    ImportJob *job = (ImportJob*)task_data;
+    GError *err = NULL;
+    ImageSource *src = job->source ? image_source_ref(job->source)
+                     : job->bytes ? image_source_new_from_bytes(job->bytes, &err)
+                     : image_source_new_from_file(job->path, &err);
+    if (src && g_cancellable_set_error_if_cancelled(cancellable, &err)) g_clear_pointer(&src, image_source_unref);
+    if (src) {
+        ImageSource *out = import_policy_apply(&job->policy, src, &err);
+        image_source_unref(src);
+        src = out;
+    }
+    if (src) {
+        // Decode here rather than on the first draw, and catch files whose
+        // header is fine but whose pixels are not
+        if (!image_source_preload(src)) {
+            g_set_error(&err, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE, "Cannot decode image");
+            g_clear_pointer(&src, image_source_unref);
+        }
+    }
+    if (src) g_task_return_pointer(task, src, (GDestroyNotify)image_source_unref);
+    else g_task_return_error(task, err);
+}
+
+static void import_run(ImportJob *job, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data) {
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_source_tag(task, import_run);
+    g_task_set_task_data(task, job, import_job_free);
+    g_task_run_in_thread(task, import_thread);
+    g_object_unref(task);
+}
+
+void import_policy_load_file_async(const ImportPolicy *policy, const char *path, GCancellable *cancellable,
+                                   GAsyncReadyCallback callback, gpointer user_data) {
+    g_return_if_fail(policy != NULL && path != NULL);
+    ImportJob *job = g_new0(ImportJob, 1);
+    job->policy = *policy;
+    job->path = g_strdup(path);
+    import_run(job, cancellable, callback, user_data);
+}
+
+void import_policy_load_bytes_async(const ImportPolicy *policy, GBytes *bytes, GCancellable *cancellable,
+                                    GAsyncReadyCallback callback, gpointer user_data) {
+    g_return_if_fail(policy != NULL && bytes != NULL);
+    ImportJob *job = g_new0(ImportJob, 1);
+    job->policy = *policy;
+    job->bytes = g_bytes_ref(bytes);
+    import_run(job, cancellable, callback, user_data);
+}
+
+void import_policy_apply_async(const ImportPolicy *policy, ImageSource *src, GCancellable *cancellable,
+                               GAsyncReadyCallback callback, gpointer user_data) {
+    g_return_if_fail(policy != NULL && src != NULL);
+    ImportJob *job = g_new0(ImportJob, 1);
+    job->policy = *policy;
+    job->source = image_source_ref(src);
+    import_run(job, cancellable, callback, user_data);
+}
+
+ImageSource *import_policy_finish(GAsyncResult *result, GError **error) {
+    g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+    return (ImageSource*)g_task_propagate_pointer(G_TASK(result), error);
+}
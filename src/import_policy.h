@@ -0,0 +1,40 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "image_source.h"
+
+G_BEGIN_DECLS
+
+// What happens to images on their way into a document. Items are placed at
+// IMAGE_ITEM_DEFAULT_WIDTH_PT, so pixels beyond max_dpi at that width can
+// never be printed and only cost memory, render time and file size.
+typedef struct {
+    double max_dpi;             // 0 keeps the full resolution
+    gboolean keep_original;     // keep the full-resolution source for re-cropping
+} ImportPolicy;
+
+#define IMPORT_DEFAULT_MAX_DPI 300.0
+
+// 300 DPI without the original. CHEATSHEET_IMPORT_MAX_DPI and
+// CHEATSHEET_IMPORT_KEEP_ORIGINAL=1 override the defaults.
+void import_policy_init_default(ImportPolicy *policy);
+
+// Widest image, in pixels, the policy lets through; 0 means unlimited.
+int import_policy_max_width(const ImportPolicy *policy);
+
+// Returns a new reference to src if it is within the policy, otherwise a
+// downscaled copy. Blocks while resampling; prefer the async variants.
+ImageSource *import_policy_apply(const ImportPolicy *policy, ImageSource *src, GError **error);
+
+// Load path and apply the policy on a worker thread.
+void import_policy_load_file_async(const ImportPolicy *policy, const char *path, GCancellable *cancellable,
+                                   GAsyncReadyCallback callback, gpointer user_data);
+// Decode encoded image data and apply the policy on a worker thread.
+void import_policy_load_bytes_async(const ImportPolicy *policy, GBytes *bytes, GCancellable *cancellable,
+                                    GAsyncReadyCallback callback, gpointer user_data);
+// Apply the policy to src on a worker thread.
+void import_policy_apply_async(const ImportPolicy *policy, ImageSource *src, GCancellable *cancellable,
+                               GAsyncReadyCallback callback, gpointer user_data);
+// Finishes either async call; returns a new reference or NULL with error set.
+ImageSource *import_policy_finish(GAsyncResult *result, GError **error);
+
+G_END_DECLS
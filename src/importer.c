@@ -0,0 +1,105 @@
+#include "importer.h"
+
+typedef struct ImportBatch ImportBatch;
+
+typedef struct {
+    ImportBatch *batch;
+    gchar *path;
+    guint placeholder;
+    gboolean done;
+    ImageSource *source;        // NULL if loading failed
+    gchar *error;
+} ImportSlot;
+
+struct ImportBatch {
+    CheatCanvas *canvas;
+    ImportSlot *slots;
+    guint n_slots;
+    guint next;                 // first slot not yet added to the canvas
+    GPtrArray *errors;
+    ImporterDoneFunc done;
+    gpointer user_data;
+};
+
+static void import_batch_free(ImportBatch *batch) {
+    for (guint i = 0; i < batch->n_slots; i++) {
+        g_free(batch->slots[i].path);
+        g_free(batch->slots[i].error);
+        if (batch->slots[i].source) image_source_unref(batch->slots[i].source);
+    }
+    g_free(batch->slots);
+    g_ptr_array_unref(batch->errors);
+    g_object_unref(batch->canvas);
+    g_free(batch);
+}
+
+// TRUE if no slot after index can still add an item.
+static gboolean import_batch_is_last(ImportBatch *batch, guint index) {
+    for (guint i = index + 1; i < batch->n_slots; i++) {
+        if (!batch->slots[i].done || batch->slots[i].source) return FALSE;
+    }
+    return TRUE;
+}
+
+// Adds every finished file that has no unfinished file before it, so items
+// keep the order they were given in even though loads finish in any order.
+// Only the batch's last item is selected.
+static void import_batch_flush(ImportBatch *batch) {
+    while (batch->next < batch->n_slots && batch->slots[batch->next].done) {
+        guint index = batch->next++;
+        ImportSlot *slot = &batch->slots[index];
+        if (slot->source) {
+            cheat_canvas_replace_placeholder(batch->canvas, slot->placeholder, slot->source,
+                                             import_batch_is_last(batch, index));
+            g_clear_pointer(&slot->source, image_source_unref);
+        } else {
+            cheat_canvas_remove_placeholder(batch->canvas, slot->placeholder);
+            gchar *name = g_filename_display_basename(slot->path);
+            g_ptr_array_add(batch->errors, g_strdup_printf("%s: %s", name, slot->error ? slot->error : "unknown error"));
+            g_free(name);
+        }
+    }
+    if (batch->next < batch->n_slots) return;
+    if (batch->done) batch->done(batch->errors, batch->user_data);
+    import_batch_free(batch);
+}
+
+static void on_file_loaded(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    (void)source_object;
+    ImportSlot *slot = (ImportSlot*)user_data;
+    GError *err = NULL;
+    slot->source = import_policy_finish(res, &err);
+    if (!slot->source) slot->error = g_strdup(err ? err->message : "unknown error");
+    if (err) g_error_free(err);
+    slot->done = TRUE;
+    import_batch_flush(slot->batch);
+}
+
+void importer_import_files(CheatCanvas *canvas, const ImportPolicy *policy, const char * const *paths, guint n_paths,
+                           ImporterDoneFunc done, gpointer user_data) {
+    g_return_if_fail(CHEAT_IS_CANVAS(canvas) && policy != NULL);
+    if (n_paths == 0) {
+        if (done) {
+            GPtrArray *none = g_ptr_array_new_with_free_func(g_free);
+            done(none, user_data);
+            g_ptr_array_unref(none);
+        }
+        return;
+    }
+    ImportBatch *batch = g_new0(ImportBatch, 1);
+    batch->canvas = g_object_ref(canvas);
+    batch->slots = g_new0(ImportSlot, n_paths);
+    batch->n_slots = n_paths;
+    batch->errors = g_ptr_array_new_with_free_func(g_free);
+    batch->done = done;
+    batch->user_data = user_data;
+    for (guint i = 0; i < n_paths; i++) {
+        ImportSlot *slot = &batch->slots[i];
+        slot->batch = batch;
+        slot->path = g_strdup(paths[i]);
+        slot->placeholder = cheat_canvas_add_placeholder(canvas);
+    }
+    for (guint i = 0; i < n_paths; i++) {
+        import_policy_load_file_async(policy, batch->slots[i].path, NULL, on_file_loaded, &batch->slots[i]);
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "canvas.h"
+#include "import_policy.h"
+
+G_BEGIN_DECLS
+
+// Called once every file of a batch has been handled. errors holds one
+// "file: reason" string per file that could not be imported and is freed
+// after the call.
+typedef void (*ImporterDoneFunc)(GPtrArray *errors, gpointer user_data);
+
+// Loads image files on worker threads, all at once, and adds them to the
+// canvas in the given order as they become ready. Each file shows a
+// placeholder on the current page until then. done may be NULL.
+void importer_import_files(CheatCanvas *canvas, const ImportPolicy *policy, const char * const *paths, guint n_paths,
+                           ImporterDoneFunc done, gpointer user_data);
+
+G_END_DECLS
@@ -0,0 +1,94 @@
+#include "layout.h"
+#include "trace.h"
+
+void layout_params_init(LayoutParams *params) {
+    params->margin = LAYOUT_DEFAULT_MARGIN;
+    params->spacing = LAYOUT_DEFAULT_SPACING;
+    layout_params_set_columns(params, LAYOUT_DEFAULT_COLUMNS);
+}
+
+void layout_params_set_columns(LayoutParams *params, int columns) {
+    g_return_if_fail(params != NULL);
+    columns = MAX(1, columns);
+    double content = A4_WIDTH_PT - 2.0 * params->margin;
+    params->item_width = MAX(1.0, (content - (columns - 1) * params->spacing) / columns);
+}
+
+void shelf_packer_init(ShelfPacker *packer, const LayoutParams *params) {
+    g_return_if_fail(packer != NULL && params != NULL);
+    packer->params = *params;
+    packer->x = params->margin;
+    packer->y = params->margin;
+    packer->row_height = 0.0;
+}
+
+void shelf_packer_start_below(ShelfPacker *packer, const Page *page) {
+    g_return_if_fail(packer != NULL && page != NULL);
+    double bottom = -1.0;
+    for (GList *l = page->items; l; l = l->next) {
+        const ImageItem *it = (const ImageItem*)l->data;
+        bottom = MAX(bottom, it->y + it->height);
+    }
+    packer->x = packer->params.margin;
+    packer->row_height = 0.0;
+    if (bottom >= 0.0) packer->y = MAX(packer->params.margin, bottom + packer->params.spacing);
+}
+
+gboolean shelf_packer_place(ShelfPacker *packer, ImageItem *item) {
+    g_return_val_if_fail(packer != NULL && item != NULL, FALSE);
+    const LayoutParams *p = &packer->params;
+    double right = A4_WIDTH_PT - p->margin, bottom = A4_HEIGHT_PT - p->margin;
+    double aspect = item->width > 0.0 ? item->height / item->width : 1.0;
+    double w = MIN(p->item_width, right - p->margin);
+    double h = w * aspect;
+    if (h > bottom - p->margin) {
+        h = bottom - p->margin;
+        w = h / aspect;
+    }
+
+    double x = packer->x, y = packer->y, row_height = packer->row_height;
+    // Columns that exactly fill the width must not wrap on rounding
+    if (x > p->margin && x + w > right + 0.01) {
+        // Start a new row
+        x = p->margin;
+        y += row_height + p->spacing;
+        row_height = 0.0;
+    }
+    // A page with nothing on it yet always takes the item
+    gboolean empty = x <= p->margin && y <= p->margin;
+    if (y + h > bottom + 0.01 && !empty) return FALSE;
+
+    item->x = x;
+    item->y = y;
+    item->width = w;
+    item->height = h;
+    packer->x = x + w + p->spacing;
+    packer->y = y;
+    packer->row_height = MAX(row_height, h);
+    return TRUE;
+}
+
+int layout_flow_sources(Document *doc, ImageSource * const *sources, guint n_sources, const LayoutParams *params) {
+    g_return_val_if_fail(doc != NULL && params != NULL, 0);
+    if (n_sources == 0) return 0;
+    TRACE_SCOPE("layout.flow");
+    guint index = (guint)CLAMP(doc->current_page, 0, (int)doc->pages->len - 1);
+    Page *page = document_get_page_for_write(doc, index);
+    ShelfPacker packer;
+    shelf_packer_init(&packer, params);
+    shelf_packer_start_below(&packer, page);
+
+    int added = 0;
+    for (guint i = 0; i < n_sources; i++) {
+        if (!sources[i]) continue;
+        ImageItem *item = image_item_new_from_source(sources[i]);
+        if (!shelf_packer_place(&packer, item)) {
+            page = document_add_page(doc);
+            added++;
+            shelf_packer_init(&packer, params);
+            shelf_packer_place(&packer, item);
+        }
+        page_add_item(page, item);
+    }
+    return added;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "document.h"
+
+G_BEGIN_DECLS
+
+// Shelf packing of images onto A4 pages for bulk imports. Items go left to
+// right in rows as tall as their tallest item; a page is full when the next
+// item would cross the bottom margin. Items keep their aspect ratio and are
+// only ever scaled down, to fit inside the margins.
+typedef struct {
+    double margin;              // page edge to items, in points
+    double spacing;             // between items, in points
+    double item_width;          // width items are placed at if they fit
+} LayoutParams;
+
+#define LAYOUT_DEFAULT_MARGIN 28.0  // about 1 cm
+#define LAYOUT_DEFAULT_SPACING 8.0
+#define LAYOUT_DEFAULT_COLUMNS 2
+
+// Default margin and spacing, LAYOUT_DEFAULT_COLUMNS items per row.
+void layout_params_init(LayoutParams *params);
+// Sets item_width so that columns items fit side by side between the margins.
+void layout_params_set_columns(LayoutParams *params, int columns);
+
+typedef struct {
+    LayoutParams params;
+    double x, y;                // top-left of the next slot
+    double row_height;          // tallest item on the current row so far
+} ShelfPacker;
+
+// Starts packing at the top of an empty page.
+void shelf_packer_init(ShelfPacker *packer, const LayoutParams *params);
+// Moves the packer to a fresh row below every item already on page.
+void shelf_packer_start_below(ShelfPacker *packer, const Page *page);
+// Sizes item and moves it to the next free slot. Returns FALSE and leaves the
+// item alone if the page is full; an empty page always has room.
+gboolean shelf_packer_place(ShelfPacker *packer, ImageItem *item);
+
+// Adds an item for every non-NULL source to doc, packed below what is on the
+// current page and carrying on over pages appended with document_add_page()
+// as pages fill. The current page ends up on the last page written. Returns
+// the number of pages added.
+int layout_flow_sources(Document *doc, ImageSource * const *sources, guint n_sources, const LayoutParams *params);
+
+G_END_DECLS
@@ -1,18 +1,45 @@
 #include <gtk/gtk.h>
 #include "document.h"
 #include "canvas.h"
+#include "cli.h"
+#include "thumbnails.h"
 #include "image_io.h"
+#include "import_policy.h"
+#include "importer.h"
+#include "memory_report.h"
 #include "pdf_export.h"
+#include "png_export.h"
 #include "serialize.h"
+#include "trace.h"
+#include "watch_folder.h"
 
 typedef struct AppState {
     GtkApplication *app;
     GtkWidget *window;
     CheatCanvas *canvas;
+    CheatThumbnails *thumbnails;
     Document *doc;
+    ImportPolicy import_policy;
+    GCancellable *paste_cancellable; // the paste in flight, if any
+    PdfExportProfile export_profile; // last profile picked in the export dialog
+    GCancellable *export_cancellable; // set while a PDF export is running
+    GtkWidget *export_button;
+    GtkWidget *png_export_button;
+    GtkWidget *export_progress;
+    GtkWidget *export_cancel_button;
+    GCancellable *load_cancellable; // set while the autosave is loading
+    GArray *load_uids;           // uid of the page standing in for each saved page
+    GPtrArray *page_buttons;     // page navigation and reorder buttons
+    int pages_loaded;
+    GtkWidget *load_progress;
+    WatchFolder *watch_folder;   // set while a folder is watched for new images
+    GtkWidget *watch_button;
     GtkWidget *page_label;
+    GtkWidget *memory_label;
     guint autosave_timer_id;
     gchar *autosave_path;
+    gboolean autosave_running;   // a snapshot is being written on a worker thread
+    gboolean autosave_pending;   // another save was requested meanwhile
     GtkWidget *draw_button;
     GtkWidget *color_button;
     GtkWidget *width_spin;
@@ -25,19 +52,64 @@ static void update_page_label(AppState *st) {
     gchar *txt = g_strdup_printf("Page %d / %d", idx, total);
     gtk_label_set_text(GTK_LABEL(st->page_label), txt);
     g_free(txt);
+    // Page structure or the current page changed; keep the sidebar in step
+    if (st->thumbnails) cheat_thumbnails_refresh(st->thumbnails);
+}
+
+static gboolean update_memory_label(gpointer user_data) {
+    AppState *st = (AppState*)user_data;
+    gchar *used = g_format_size(image_source_get_usage());
+    gchar *budget = g_format_size(image_source_get_budget());
+    gchar *txt = g_strdup_printf("Images: %s / %s", used, budget);
+    gtk_label_set_text(GTK_LABEL(st->memory_label), txt);
+    gtk_widget_set_tooltip_text(st->memory_label, "Decoded image memory (set CHEATSHEET_IMAGE_BUDGET_MB to change the budget)");
+    g_free(txt);
+    g_free(budget);
+    g_free(used);
+    return G_SOURCE_CONTINUE;
 }
 
 // Forward declarations
 static void on_undo_stroke(GtkWidget *btn, gpointer u);
 static void on_clear_strokes(GtkWidget *btn, gpointer u);
 
-static void autosave_document(AppState *st) {
-    if (!st->doc || !st->autosave_path) return;
+static void autosave_document(AppState *st);
+
+static void autosave_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable) {
+    (void)source; (void)cancellable;
+    const gchar *path = g_object_get_data(G_OBJECT(task), "path");
     GError *error = NULL;
-    if (!document_save_to_file(st->doc, st->autosave_path, &error)) {
+    if (document_save_to_file((Document*)task_data, path, &error)) g_task_return_boolean(task, TRUE);
+    else g_task_return_error(task, error);
+}
+
+static void on_autosave_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+    (void)source;
+    AppState *st = (AppState*)user_data;
+    GError *error = NULL;
+    if (!g_task_propagate_boolean(G_TASK(res), &error)) {
         g_warning("Auto-save failed: %s", error ? error->message : "unknown error");
         if (error) g_error_free(error);
     }
+    st->autosave_running = FALSE;
+    if (st->autosave_pending) {
+        st->autosave_pending = FALSE;
+        autosave_document(st);
+    }
+}
+
+// Saves a snapshot of the document on a worker thread so the UI keeps running
+// while images are encoded. Requests made during a save are coalesced.
+static void autosave_document(AppState *st) {
+    if (!st->doc || !st->autosave_path) return;
+    // A partly loaded document must not replace the file it comes from
+    if (st->autosave_running || st->load_cancellable) { st->autosave_pending = TRUE; return; }
+    st->autosave_running = TRUE;
+    GTask *task = g_task_new(NULL, NULL, on_autosave_done, st);
+    g_task_set_task_data(task, document_snapshot(st->doc), (GDestroyNotify)document_free);
+    g_object_set_data_full(G_OBJECT(task), "path", g_strdup(st->autosave_path), g_free);
+    g_task_run_in_thread(task, autosave_thread);
+    g_object_unref(task);
 }
 
 static gboolean autosave_timer_callback(gpointer user_data) {
@@ -46,9 +118,15 @@ static gboolean autosave_timer_callback(gpointer user_data) {
     return G_SOURCE_CONTINUE; // Keep timer running
 }
 
+static void end_loading(AppState *st);
+
 static void on_action_new(GtkWidget *btn, gpointer user_data) {
     (void)btn;
     AppState *st = (AppState*)user_data;
+    if (st->load_cancellable) {
+        g_cancellable_cancel(st->load_cancellable);
+        end_loading(st);
+    }
     
     // Auto-save current document before creating new one
     autosave_document(st);
@@ -56,12 +134,55 @@ static void on_action_new(GtkWidget *btn, gpointer user_data) {
     if (st->doc) document_free(st->doc);
     st->doc = document_new();
     cheat_canvas_set_document(st->canvas, st->doc);
+    cheat_thumbnails_set_document(st->thumbnails, st->doc);
     update_page_label(st);
     
     // Save the new empty document
     autosave_document(st);
 }
 
+static void show_import_error(AppState *st, GError *err) {
+    GtkWidget *md = gtk_message_dialog_new(GTK_WINDOW(st->window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                                          "Failed to load image: %s", err ? err->message : "unknown error");
+    gtk_dialog_run(GTK_DIALOG(md));
+    gtk_widget_destroy(md);
+}
+
+// A paste that is still waiting for the clipboard owner or the decoder is
+// dropped when a newer one starts.
+static void on_paste_done(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    (void)source_object;
+    AppState *st = (AppState*)user_data;
+    if (g_task_get_cancellable(G_TASK(res)) == st->paste_cancellable) g_clear_object(&st->paste_cancellable);
+    GError *err = NULL;
+    ImageSource *src = clipboard_paste_finish(res, &err);
+    if (src) {
+        cheat_canvas_add_source(st->canvas, src);
+        image_source_unref(src);
+    } else if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+               !g_error_matches(err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+        show_import_error(st, err);
+    }
+    if (err) g_error_free(err);
+}
+
+// Files that failed are reported together once the whole batch is in.
+static void on_files_imported(GPtrArray *errors, gpointer user_data) {
+    AppState *st = (AppState*)user_data;
+    if (errors->len == 0) return;
+    GString *msg = g_string_new(NULL);
+    for (guint i = 0; i < errors->len; i++) {
+        if (i) g_string_append_c(msg, '\n');
+        g_string_append(msg, (const char*)g_ptr_array_index(errors, i));
+    }
+    GtkWidget *md = gtk_message_dialog_new(GTK_WINDOW(st->window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                                          errors->len == 1 ? "Failed to load image" : "Failed to load %u images", errors->len);
+    gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(md), "%s", msg->str);
+    gtk_dialog_run(GTK_DIALOG(md));
+    gtk_widget_destroy(md);
+    g_string_free(msg, TRUE);
+}
+
 static void import_image_from_file(AppState *st) {
     GtkWidget *dlg = gtk_file_chooser_dialog_new("Import Image", GTK_WINDOW(st->window), GTK_FILE_CHOOSER_ACTION_OPEN,
                                                  "Cancel", GTK_RESPONSE_CANCEL, "Open", GTK_RESPONSE_ACCEPT, NULL);
@@ -69,21 +190,15 @@ static void import_image_from_file(AppState *st) {
     gtk_file_filter_set_name(ff, "Images");
     gtk_file_filter_add_pixbuf_formats(ff);
     gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dlg), ff);
+    gtk_file_chooser_set_select_multiple(GTK_FILE_CHOOSER(dlg), TRUE);
     if (gtk_dialog_run(GTK_DIALOG(dlg)) == GTK_RESPONSE_ACCEPT) {
-        char *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg));
-        GError *err = NULL;
-        GdkPixbuf *pb = load_pixbuf_from_file(path, &err);
-        if (pb) {
-            cheat_canvas_add_pixbuf(st->canvas, pb);
-            g_object_unref(pb);
-        } else {
-            GtkWidget *md = gtk_message_dialog_new(GTK_WINDOW(st->window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
-                                                  "Failed to load image: %s", err ? err->message : "unknown error");
-            gtk_dialog_run(GTK_DIALOG(md));
-            gtk_widget_destroy(md);
-            if (err) g_error_free(err);
-        }
-        g_free(path);
+        GSList *files = gtk_file_chooser_get_filenames(GTK_FILE_CHOOSER(dlg));
+        GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+        for (GSList *l = files; l; l = l->next) g_ptr_array_add(paths, l->data);
+        g_slist_free(files);
+        importer_import_files(st->canvas, &st->import_policy, (const char * const *)paths->pdata, paths->len,
+                              on_files_imported, st);
+        g_ptr_array_unref(paths);
     }
     gtk_widget_destroy(dlg);
 }
@@ -93,40 +208,200 @@ static void on_action_import(GtkWidget *btn, gpointer user_data) {
     import_image_from_file((AppState*)user_data);
 }
 
+// A burst of new files in the watched folder, packed in one go
+static void on_folder_images(ImageSource * const *sources, guint n_sources, gpointer user_data) {
+    AppState *st = (AppState*)user_data;
+    cheat_canvas_flow_sources(st->canvas, sources, n_sources);
+    autosave_document(st);
+}
+
+// Pictures/Screenshots if there is one, as most screenshot tools use it
+static gchar *default_watch_dir(void) {
+    const gchar *pictures = g_get_user_special_dir(G_USER_DIRECTORY_PICTURES);
+    if (!pictures) pictures = g_get_home_dir();
+    gchar *dir = g_build_filename(pictures, "Screenshots", NULL);
+    if (g_file_test(dir, G_FILE_TEST_IS_DIR)) return dir;
+    g_free(dir);
+    return g_strdup(pictures);
+}
+
+static void on_watch_toggled(GtkToggleButton *b, gpointer user_data) {
+    AppState *st = (AppState*)user_data;
+    if (!gtk_toggle_button_get_active(b)) {
+        g_clear_pointer(&st->watch_folder, watch_folder_free);
+        gtk_widget_set_tooltip_text(st->watch_button, "Add new images from a folder as they appear");
+        return;
+    }
+    if (st->watch_folder) return;
+    GtkWidget *dlg = gtk_file_chooser_dialog_new("Watch Folder", GTK_WINDOW(st->window), GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
+                                                 "Cancel", GTK_RESPONSE_CANCEL, "Watch", GTK_RESPONSE_ACCEPT, NULL);
+    gchar *initial = default_watch_dir();
+    gtk_file_chooser_set_current_folder(GTK_FILE_CHOOSER(dlg), initial);
+    g_free(initial);
+    gchar *dir = NULL;
+    if (gtk_dialog_run(GTK_DIALOG(dlg)) == GTK_RESPONSE_ACCEPT) dir = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg));
+    gtk_widget_destroy(dlg);
+
+    GError *err = NULL;
+    if (dir) st->watch_folder = watch_folder_new(dir, &st->import_policy, on_folder_images, st, &err);
+    if (st->watch_folder) {
+        gchar *tip = g_strdup_printf("Adding new images from %s", dir);
+        gtk_widget_set_tooltip_text(st->watch_button, tip);
+        g_free(tip);
+    } else {
+        if (err) {
+            GtkWidget *md = gtk_message_dialog_new(GTK_WINDOW(st->window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                                                  "Cannot watch %s: %s", dir, err->message);
+            gtk_dialog_run(GTK_DIALOG(md));
+            gtk_widget_destroy(md);
+            g_error_free(err);
+        }
+        gtk_toggle_button_set_active(b, FALSE);
+    }
+    g_free(dir);
+}
+
 static void on_action_paste(GtkWidget *btn, gpointer user_data) {
     (void)btn;
     AppState *st = (AppState*)user_data;
-    GdkPixbuf *pb = clipboard_get_image_sync(GTK_WIDGET(st->window));
-    if (pb) {
-        cheat_canvas_add_pixbuf(st->canvas, pb);
-        g_object_unref(pb);
+    if (st->paste_cancellable) {
+        g_cancellable_cancel(st->paste_cancellable);
+        g_object_unref(st->paste_cancellable);
     }
+    st->paste_cancellable = g_cancellable_new();
+    clipboard_paste_async(GTK_WIDGET(st->window), &st->import_policy, st->paste_cancellable, on_paste_done, st);
+}
+
+static void on_export_progress(int pages_done, int pages_total, gpointer user_data) {
+    AppState *st = (AppState*)user_data;
+    gchar *txt = g_strdup_printf("Page %d / %d", pages_done, pages_total);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(st->export_progress), pages_total > 0 ? (double)pages_done / pages_total : 1.0);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(st->export_progress), txt);
+    g_free(txt);
+}
+
+// Exports run on a snapshot, so editing can go on meanwhile; only one export
+// runs at a time.
+static void begin_export(AppState *st) {
+    st->export_cancellable = g_cancellable_new();
+    gtk_widget_set_sensitive(st->export_button, FALSE);
+    gtk_widget_set_sensitive(st->png_export_button, FALSE);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(st->export_progress), 0.0);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(st->export_progress), "Exporting…");
+    gtk_widget_show(st->export_progress);
+    gtk_widget_show(st->export_cancel_button);
+}
+
+static void end_export(AppState *st, gboolean ok, GError *err, const char *what) {
+    if (!ok && !g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        GtkWidget *md = gtk_message_dialog_new(GTK_WINDOW(st->window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                                              "Failed to export %s: %s", what, err ? err->message : "unknown error");
+        gtk_dialog_run(GTK_DIALOG(md));
+        gtk_widget_destroy(md);
+    }
+    if (err) g_error_free(err);
+    g_clear_object(&st->export_cancellable);
+    gtk_widget_hide(st->export_progress);
+    gtk_widget_hide(st->export_cancel_button);
+    gtk_widget_set_sensitive(st->export_button, TRUE);
+    gtk_widget_set_sensitive(st->png_export_button, TRUE);
+}
+
+static void on_export_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+    (void)source;
+    GError *err = NULL;
+    gboolean ok = export_document_to_pdf_finish(res, &err);
+    end_export((AppState*)user_data, ok, err, "PDF");
+}
+
+static void on_png_export_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+    (void)source;
+    GError *err = NULL;
+    gboolean ok = export_document_to_png_finish(res, &err);
+    end_export((AppState*)user_data, ok, err, "PNG");
+}
+
+static void on_export_cancel(GtkWidget *btn, gpointer user_data) {
+    (void)btn;
+    AppState *st = (AppState*)user_data;
+    if (st->export_cancellable) g_cancellable_cancel(st->export_cancellable);
 }
 
 static void on_action_export_pdf(GtkWidget *btn, gpointer user_data) {
     (void)btn;
     AppState *st = (AppState*)user_data;
+    // One export at a time, and never of a partly loaded document
+    if (st->export_cancellable || st->load_cancellable) return;
     GtkWidget *dlg = gtk_file_chooser_dialog_new("Export PDF", GTK_WINDOW(st->window), GTK_FILE_CHOOSER_ACTION_SAVE,
                                                  "Cancel", GTK_RESPONSE_CANCEL, "Export", GTK_RESPONSE_ACCEPT, NULL);
     gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dlg), "cheatsheet.pdf");
+    GtkWidget *quality_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    GtkWidget *profile_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(profile_combo), "lossless", "Lossless");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(profile_combo), "balanced", "Balanced (300 DPI, photos as JPEG)");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(profile_combo), "small", "Small (150 DPI, photos as JPEG)");
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(profile_combo), pdf_export_profile_to_string(st->export_profile));
+    gtk_box_pack_start(GTK_BOX(quality_box), gtk_label_new("Quality:"), FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(quality_box), profile_combo, FALSE, FALSE, 0);
+    gtk_widget_show_all(quality_box);
+    gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(dlg), quality_box);
     if (gtk_dialog_run(GTK_DIALOG(dlg)) == GTK_RESPONSE_ACCEPT) {
         char *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg));
-        GError *err = NULL;
-        if (!export_document_to_pdf(st->doc, path, &err)) {
-            GtkWidget *md = gtk_message_dialog_new(GTK_WINDOW(st->window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
-                                                  "Failed to export PDF: %s", err ? err->message : "unknown error");
-            gtk_dialog_run(GTK_DIALOG(md));
-            gtk_widget_destroy(md);
-            if (err) g_error_free(err);
-        }
+        const char *profile_id = gtk_combo_box_get_active_id(GTK_COMBO_BOX(profile_combo));
+        if (profile_id) pdf_export_profile_from_string(profile_id, &st->export_profile);
+        PdfExportOptions options;
+        pdf_export_options_init_profile(&options, st->export_profile);
+        begin_export(st);
+        export_document_to_pdf_async(st->doc, path, &options, st->export_cancellable, on_export_progress, st,
+                                     on_export_done, st);
         g_free(path);
     }
     gtk_widget_destroy(dlg);
 }
 
+// One PNG per page: "name.png" becomes name-01.png, name-02.png, ...
+static void on_action_export_png(GtkWidget *btn, gpointer user_data) {
+    (void)btn;
+    AppState *st = (AppState*)user_data;
+    // One export at a time, and never of a partly loaded document
+    if (st->export_cancellable || st->load_cancellable) return;
+    GtkWidget *dlg = gtk_file_chooser_dialog_new("Export Pages as PNG", GTK_WINDOW(st->window), GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                 "Cancel", GTK_RESPONSE_CANCEL, "Export", GTK_RESPONSE_ACCEPT, NULL);
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dlg), "cheatsheet.png");
+    GtkWidget *dpi_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    GtkWidget *dpi_spin = gtk_spin_button_new_with_range(36, 600, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(dpi_spin), PNG_EXPORT_DEFAULT_DPI);
+    gtk_box_pack_start(GTK_BOX(dpi_box), gtk_label_new("Resolution (DPI):"), FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(dpi_box), dpi_spin, FALSE, FALSE, 0);
+    gtk_widget_show_all(dpi_box);
+    gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(dlg), dpi_box);
+    if (gtk_dialog_run(GTK_DIALOG(dlg)) == GTK_RESPONSE_ACCEPT) {
+        char *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg));
+        double dpi = gtk_spin_button_get_value(GTK_SPIN_BUTTON(dpi_spin));
+        begin_export(st);
+        export_document_to_png_async(st->doc, path, dpi, st->export_cancellable, on_export_progress, st,
+                                     on_png_export_done, st);
+        g_free(path);
+    }
+    gtk_widget_destroy(dlg);
+}
+
+// Pages must not be added, moved or removed while the loader has not yet
+// placed the stand-ins for the saved pages around the page shown at startup.
+static gboolean pages_locked(AppState *st) {
+    return st->load_cancellable && !st->load_uids;
+}
+
+static void set_page_buttons_sensitive(AppState *st, gboolean sensitive) {
+    for (guint i = 0; i < st->page_buttons->len; i++) {
+        gtk_widget_set_sensitive(GTK_WIDGET(g_ptr_array_index(st->page_buttons, i)), sensitive);
+    }
+}
+
 static void on_action_prev_page(GtkWidget *btn, gpointer user_data) {
     (void)btn;
     AppState *st = (AppState*)user_data;
+    if (pages_locked(st)) return;
     cheat_canvas_prev_page(st->canvas);
     update_page_label(st);
 }
@@ -134,6 +409,7 @@ static void on_action_prev_page(GtkWidget *btn, gpointer user_data) {
 static void on_action_next_page(GtkWidget *btn, gpointer user_data) {
     (void)btn;
     AppState *st = (AppState*)user_data;
+    if (pages_locked(st)) return;
     cheat_canvas_next_page(st->canvas);
     update_page_label(st);
 }
@@ -141,7 +417,7 @@ static void on_action_next_page(GtkWidget *btn, gpointer user_data) {
 static void on_action_delete_page(GtkWidget *btn, gpointer user_data) {
     (void)btn;
     AppState *st = (AppState*)user_data;
-    if (!st->doc) return;
+    if (!st->doc || pages_locked(st)) return;
     if (document_page_count(st->doc) <= 1) return; // Keep at least one page
     
     document_remove_current_page(st->doc);
@@ -153,7 +429,7 @@ static void on_action_delete_page(GtkWidget *btn, gpointer user_data) {
 static void on_action_move_page_up(GtkWidget *btn, gpointer user_data) {
     (void)btn;
     AppState *st = (AppState*)user_data;
-    if (!st->doc) return;
+    if (!st->doc || pages_locked(st)) return;
     
     document_move_page_up(st->doc);
     cheat_canvas_set_document(st->canvas, st->doc);
@@ -164,7 +440,7 @@ static void on_action_move_page_up(GtkWidget *btn, gpointer user_data) {
 static void on_action_move_page_down(GtkWidget *btn, gpointer user_data) {
     (void)btn;
     AppState *st = (AppState*)user_data;
-    if (!st->doc) return;
+    if (!st->doc || pages_locked(st)) return;
     
     document_move_page_down(st->doc);
     cheat_canvas_set_document(st->canvas, st->doc);
@@ -172,6 +448,54 @@ static void on_action_move_page_down(GtkWidget *btn, gpointer user_data) {
     autosave_document(st);
 }
 
+// Writes the overlay statistics next to the other per-user data and says where.
+static void save_perf_stats(AppState *st) {
+    gchar *dir = g_build_filename(g_get_user_cache_dir(), "cheatsheet-maker", NULL);
+    g_mkdir_with_parents(dir, 0755);
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *stamp = g_date_time_format(now, "perf-%Y%m%d-%H%M%S.json");
+    gchar *path = g_build_filename(dir, stamp, NULL);
+    GError *err = NULL;
+    gboolean ok = cheat_canvas_write_perf_stats(st->canvas, path, &err);
+    GtkWidget *md = gtk_message_dialog_new(GTK_WINDOW(st->window), GTK_DIALOG_MODAL,
+                                          ok ? GTK_MESSAGE_INFO : GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                                          ok ? "Performance statistics saved to %s" : "Failed to save performance statistics: %s",
+                                          ok ? path : err->message);
+    gtk_dialog_run(GTK_DIALOG(md));
+    gtk_widget_destroy(md);
+    if (err) g_error_free(err);
+    g_free(path);
+    g_free(stamp);
+    g_date_time_unref(now);
+    g_free(dir);
+}
+
+// Shows where the document's memory goes, page by page
+static void on_action_memory_report(GtkWidget *btn, gpointer u) {
+    (void)btn;
+    AppState *st = (AppState*)u;
+    DocumentMemory memory;
+    document_memory_measure(st->doc, &memory);
+    memory.cache_bytes = cheat_canvas_get_cache_bytes(st->canvas) + cheat_thumbnails_get_cache_bytes(st->thumbnails);
+    gchar *report = document_memory_format(&memory);
+    document_memory_clear(&memory);
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Memory Report", GTK_WINDOW(st->window), GTK_DIALOG_MODAL,
+                                                    "_Close", GTK_RESPONSE_CLOSE, NULL);
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 760, 480);
+    GtkWidget *view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(view), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(view), TRUE);
+    gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(view)), report, -1);
+    GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scroll), view);
+    gtk_box_pack_start(GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), scroll, TRUE, TRUE, 0);
+    gtk_widget_show_all(dialog);
+    gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+    g_free(report);
+}
+
 static gboolean on_key_press(GtkWidget *w, GdkEventKey *ev, gpointer user_data) {
     (void)w;
     AppState *st = (AppState*)user_data;
@@ -184,6 +508,8 @@ static gboolean on_key_press(GtkWidget *w, GdkEventKey *ev, gpointer user_data)
     if ((state & GDK_CONTROL_MASK) && key == GDK_KEY_minus) { cheat_canvas_zoom_out(st->canvas); return TRUE; }
     if ((state & GDK_CONTROL_MASK) && key == GDK_KEY_0) { cheat_canvas_zoom_reset(st->canvas); return TRUE; }
     if ((state & GDK_CONTROL_MASK) && key == GDK_KEY_z) { on_undo_stroke(NULL, st); return TRUE; }
+    if (key == GDK_KEY_F12 && (state & GDK_SHIFT_MASK)) { save_perf_stats(st); return TRUE; }
+    if (key == GDK_KEY_F12) { cheat_canvas_set_perf_hud(st->canvas, !cheat_canvas_get_perf_hud(st->canvas)); return TRUE; }
     if (key == GDK_KEY_Delete || key == GDK_KEY_BackSpace) { cheat_canvas_delete_selection(st->canvas); return TRUE; }
     if (key == GDK_KEY_c || key == GDK_KEY_C) { cheat_canvas_toggle_crop_mode(st->canvas); return TRUE; }
     if (key == GDK_KEY_d || key == GDK_KEY_D) { 
@@ -207,20 +533,16 @@ static void on_drag_data_received(GtkWidget *w, GdkDragContext *ctx, gint x, gin
     if (gtk_selection_data_get_length(data) <= 0) return;
     gchar **uris = gtk_selection_data_get_uris(data);
     if (!uris) return;
+    // Decoded on worker threads; items appear in drop order as they load
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
     for (int i = 0; uris[i]; i++) {
         gchar *filename = g_filename_from_uri(uris[i], NULL, NULL);
-        if (filename) {
-            GError *err = NULL;
-            GdkPixbuf *pb = gdk_pixbuf_new_from_file(filename, &err);
-            if (pb) {
-                cheat_canvas_add_pixbuf(st->canvas, pb);
-                g_object_unref(pb);
-            }
-            if (err) { g_error_free(err); }
-            g_free(filename);
-        }
+        if (filename) g_ptr_array_add(paths, filename);
     }
     g_strfreev(uris);
+    importer_import_files(st->canvas, &st->import_policy, (const char * const *)paths->pdata, paths->len,
+                          on_files_imported, st);
+    g_ptr_array_unref(paths);
 }
 
 static void setup_dnd(GtkWidget *widget, AppState *st) {
@@ -245,6 +567,38 @@ static void on_draw_toggled(GtkToggleButton *b, gpointer u) {
     cheat_canvas_toggle_draw_mode(st->canvas);
 }
 
+static void on_continuous_toggled(GtkToggleButton *b, gpointer u) {
+    AppState *st = (AppState*)u;
+    if (!st || !st->canvas) return;
+    cheat_canvas_set_continuous(st->canvas, gtk_toggle_button_get_active(b));
+}
+
+static void on_canvas_page_changed(CheatCanvas *canvas, gpointer u) {
+    (void)canvas;
+    update_page_label((AppState*)u);
+}
+
+static void on_canvas_content_changed(CheatCanvas *canvas, gpointer u) {
+    (void)canvas;
+    AppState *st = (AppState*)u;
+    cheat_thumbnails_refresh(st->thumbnails);
+}
+
+static void on_thumbnail_activated(CheatThumbnails *thumbs, int index, gpointer u) {
+    (void)thumbs;
+    AppState *st = (AppState*)u;
+    cheat_canvas_go_to_page(st->canvas, index);
+    update_page_label(st);
+}
+
+static void on_thumbnail_moved(CheatThumbnails *thumbs, int from, int to, gpointer u) {
+    (void)thumbs; (void)from; (void)to;
+    AppState *st = (AppState*)u;
+    cheat_canvas_set_document(st->canvas, st->doc);
+    update_page_label(st);
+    autosave_document(st);
+}
+
 static void on_color_set(GtkColorButton *btn, gpointer u) {
     AppState *st = (AppState*)u;
     if (!st || !st->canvas) return;
@@ -276,24 +630,109 @@ static void on_clear_strokes(GtkWidget *btn, gpointer u) {
     autosave_document(st);
 }
 
+// Puts a page that finished loading in place of the page standing in for it,
+// keeping anything added to the stand-in meanwhile.
+static void absorb_loaded_page(AppState *st, guint uid, Page *page) {
+    int pos = document_find_page(st->doc, uid);
+    if (pos < 0) return; // deleted while loading
+    Page *stand_in = (Page*)g_ptr_array_index(st->doc->pages, pos);
+    // Only the loader still references page and it never reads it again
+    Page *loaded = page_ref(page);
+    for (GList *l = stand_in->items; l; l = l->next) page_add_item(loaded, image_item_copy((ImageItem*)l->data));
+    for (GList *l = stand_in->strokes; l; l = l->next) page_add_stroke(loaded, stroke_copy((Stroke*)l->data));
+    document_replace_page(st->doc, (guint)pos, loaded);
+    if (pos == st->doc->current_page) cheat_canvas_set_document(st->canvas, st->doc);
+    else gtk_widget_queue_draw(GTK_WIDGET(st->canvas));
+}
+
+static void on_page_loaded(Page *page, int index, int page_count, int current_page, gpointer user_data) {
+    AppState *st = (AppState*)user_data;
+    if (!st->load_uids) {
+        // The saved current page arrives first. The page shown since startup
+        // stands in for it, blank pages for the others around it.
+        st->load_uids = g_array_sized_new(FALSE, FALSE, sizeof(guint), (guint)page_count);
+        int at = st->doc->current_page;
+        // Read before any insertion moves current_page off the shown page
+        guint shown_uid = document_current_page(st->doc)->uid;
+        for (int i = 0; i < page_count; i++) {
+            guint uid = shown_uid;
+            if (i != current_page) {
+                Page *stand_in = page_new();
+                uid = stand_in->uid;
+                g_ptr_array_insert(st->doc->pages, at + i, stand_in);
+            }
+            g_array_append_val(st->load_uids, uid);
+        }
+        st->doc->current_page = at + current_page;
+        gtk_widget_set_sensitive(GTK_WIDGET(st->canvas), TRUE);
+        set_page_buttons_sensitive(st, TRUE);
+    }
+    absorb_loaded_page(st, g_array_index(st->load_uids, guint, index), page);
+    st->pages_loaded++;
+    gchar *txt = g_strdup_printf("Loading page %d / %d", st->pages_loaded, page_count);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(st->load_progress), (double)st->pages_loaded / page_count);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(st->load_progress), txt);
+    g_free(txt);
+    update_page_label(st);
+}
+
+static void end_loading(AppState *st) {
+    g_clear_object(&st->load_cancellable);
+    if (st->load_uids) g_array_unref(st->load_uids);
+    st->load_uids = NULL;
+    gtk_widget_hide(st->load_progress);
+    gtk_widget_set_sensitive(GTK_WIDGET(st->canvas), TRUE);
+    gtk_widget_set_sensitive(st->export_button, TRUE);
+    gtk_widget_set_sensitive(st->png_export_button, TRUE);
+    gtk_widget_set_sensitive(st->watch_button, TRUE);
+    set_page_buttons_sensitive(st, TRUE);
+    if (st->autosave_pending && !st->autosave_running) {
+        st->autosave_pending = FALSE;
+        autosave_document(st);
+    }
+}
+
+static void on_document_loaded(GObject *source, GAsyncResult *res, gpointer user_data) {
+    (void)source;
+    AppState *st = (AppState*)user_data;
+    GError *error = NULL;
+    if (!document_load_finish(res, &error)) {
+        gboolean cancelled = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+        // No autosave yet on first start; keep the empty document
+        if (!cancelled) g_debug("Could not load autosave: %s", error->message);
+        g_error_free(error);
+        if (cancelled) return; // already cleaned up by whoever cancelled
+    }
+    end_loading(st);
+}
+
+// The window comes up with an empty page while the autosave loads in the
+// background; the canvas is usable once the saved current page is in.
+static void begin_loading(AppState *st) {
+    st->load_cancellable = g_cancellable_new();
+    gtk_widget_set_sensitive(GTK_WIDGET(st->canvas), FALSE);
+    gtk_widget_set_sensitive(st->export_button, FALSE);
+    gtk_widget_set_sensitive(st->png_export_button, FALSE);
+    // New pages must not be appended before the saved ones are placed
+    gtk_widget_set_sensitive(st->watch_button, FALSE);
+    set_page_buttons_sensitive(st, FALSE);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(st->load_progress), 0.0);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(st->load_progress), "Loading…");
+    gtk_widget_show(st->load_progress);
+    document_load_async(st->autosave_path, st->load_cancellable, on_page_loaded, st, on_document_loaded, st);
+}
+
 static void activate(GtkApplication* app, gpointer user_data) {
     (void)user_data;
     AppState *st = g_new0(AppState, 1);
     st->app = app;
+    st->page_buttons = g_ptr_array_new();
     st->autosave_timer_id = 0;
     st->autosave_path = get_autosave_path();
+    import_policy_init_default(&st->import_policy);
     
-    // Try to load autosaved document
-    GError *error = NULL;
-    st->doc = document_load_from_file(st->autosave_path, &error);
-    if (!st->doc) {
-        // If load fails (e.g., no autosave file), create new document
-        if (error) {
-            g_debug("Could not load autosave: %s", error->message);
-            g_error_free(error);
-        }
-        st->doc = document_new();
-    }
+    // The autosave is loaded into this once the window is up
+    st->doc = document_new();
 
     GtkWidget *win = gtk_application_window_new(app);
     gtk_window_set_title(GTK_WINDOW(win), "Cheatsheet Maker");
@@ -326,6 +765,11 @@ static void activate(GtkApplication* app, gpointer user_data) {
     g_signal_connect(btn_paste, "clicked", G_CALLBACK(on_action_paste), st);
     gtk_box_pack_start(GTK_BOX(toolbar), btn_paste, FALSE, FALSE, 4);
 
+    st->watch_button = gtk_toggle_button_new_with_label("Watch Folder");
+    gtk_widget_set_tooltip_text(st->watch_button, "Add new images from a folder as they appear");
+    g_signal_connect(st->watch_button, "toggled", G_CALLBACK(on_watch_toggled), st);
+    gtk_box_pack_start(GTK_BOX(toolbar), st->watch_button, FALSE, FALSE, 4);
+
     GtkWidget *btn_crop = gtk_toggle_button_new_with_label("Crop");
     // Connect with AppState so we can access canvas reliably
     g_signal_connect(btn_crop, "toggled", G_CALLBACK(on_crop_toggled), st);
@@ -361,9 +805,14 @@ static void activate(GtkApplication* app, gpointer user_data) {
     g_signal_connect(btn_clear, "clicked", G_CALLBACK(on_clear_strokes), st);
     gtk_box_pack_start(GTK_BOX(toolbar), btn_clear, FALSE, FALSE, 4);
 
-    GtkWidget *btn_export = gtk_button_new_with_label("Export PDF");
-    g_signal_connect(btn_export, "clicked", G_CALLBACK(on_action_export_pdf), st);
-    gtk_box_pack_start(GTK_BOX(toolbar), btn_export, FALSE, FALSE, 4);
+    st->export_button = gtk_button_new_with_label("Export PDF");
+    g_signal_connect(st->export_button, "clicked", G_CALLBACK(on_action_export_pdf), st);
+    gtk_box_pack_start(GTK_BOX(toolbar), st->export_button, FALSE, FALSE, 4);
+
+    st->png_export_button = gtk_button_new_with_label("Export PNG");
+    gtk_widget_set_tooltip_text(st->png_export_button, "Export every page as a PNG image");
+    g_signal_connect(st->png_export_button, "clicked", G_CALLBACK(on_action_export_png), st);
+    gtk_box_pack_start(GTK_BOX(toolbar), st->png_export_button, FALSE, FALSE, 4);
 
     GtkWidget *sp = gtk_separator_new(GTK_ORIENTATION_VERTICAL);
     gtk_box_pack_start(GTK_BOX(toolbar), sp, FALSE, FALSE, 8);
@@ -371,6 +820,7 @@ static void activate(GtkApplication* app, gpointer user_data) {
     GtkWidget *btn_prev = gtk_button_new_with_label("◀ Prev");
     g_signal_connect(btn_prev, "clicked", G_CALLBACK(on_action_prev_page), st);
     gtk_box_pack_start(GTK_BOX(toolbar), btn_prev, FALSE, FALSE, 4);
+    g_ptr_array_add(st->page_buttons, btn_prev);
 
     st->page_label = gtk_label_new("");
     gtk_box_pack_start(GTK_BOX(toolbar), st->page_label, FALSE, FALSE, 8);
@@ -378,6 +828,12 @@ static void activate(GtkApplication* app, gpointer user_data) {
     GtkWidget *btn_next = gtk_button_new_with_label("Next ▶");
     g_signal_connect(btn_next, "clicked", G_CALLBACK(on_action_next_page), st);
     gtk_box_pack_start(GTK_BOX(toolbar), btn_next, FALSE, FALSE, 4);
+    g_ptr_array_add(st->page_buttons, btn_next);
+
+    GtkWidget *btn_scroll = gtk_toggle_button_new_with_label("Scroll View");
+    gtk_widget_set_tooltip_text(btn_scroll, "Show all pages in one scrolling column (Ctrl+wheel zooms)");
+    g_signal_connect(btn_scroll, "toggled", G_CALLBACK(on_continuous_toggled), st);
+    gtk_box_pack_start(GTK_BOX(toolbar), btn_scroll, FALSE, FALSE, 4);
 
     GtkWidget *sp2 = gtk_separator_new(GTK_ORIENTATION_VERTICAL);
     gtk_box_pack_start(GTK_BOX(toolbar), sp2, FALSE, FALSE, 8);
@@ -385,34 +841,89 @@ static void activate(GtkApplication* app, gpointer user_data) {
     GtkWidget *btn_delete_page = gtk_button_new_with_label("Delete Page");
     g_signal_connect(btn_delete_page, "clicked", G_CALLBACK(on_action_delete_page), st);
     gtk_box_pack_start(GTK_BOX(toolbar), btn_delete_page, FALSE, FALSE, 4);
+    g_ptr_array_add(st->page_buttons, btn_delete_page);
 
     GtkWidget *btn_move_up = gtk_button_new_with_label("▲ Move Up");
     g_signal_connect(btn_move_up, "clicked", G_CALLBACK(on_action_move_page_up), st);
     gtk_box_pack_start(GTK_BOX(toolbar), btn_move_up, FALSE, FALSE, 4);
+    g_ptr_array_add(st->page_buttons, btn_move_up);
 
     GtkWidget *btn_move_down = gtk_button_new_with_label("▼ Move Down");
     g_signal_connect(btn_move_down, "clicked", G_CALLBACK(on_action_move_page_down), st);
     gtk_box_pack_start(GTK_BOX(toolbar), btn_move_down, FALSE, FALSE, 4);
+    g_ptr_array_add(st->page_buttons, btn_move_down);
+
+    st->memory_label = gtk_label_new("");
+    gtk_box_pack_end(GTK_BOX(toolbar), st->memory_label, FALSE, FALSE, 8);
+    GtkWidget *btn_memory = gtk_button_new_with_label("Memory");
+    gtk_widget_set_tooltip_text(btn_memory, "Show memory use and file size per page");
+    g_signal_connect(btn_memory, "clicked", G_CALLBACK(on_action_memory_report), st);
+    gtk_box_pack_end(GTK_BOX(toolbar), btn_memory, FALSE, FALSE, 4);
+
+    // Export progress, only visible while an export runs
+    st->export_cancel_button = gtk_button_new_with_label("Cancel Export");
+    g_signal_connect(st->export_cancel_button, "clicked", G_CALLBACK(on_export_cancel), st);
+    gtk_widget_set_no_show_all(st->export_cancel_button, TRUE);
+    gtk_box_pack_end(GTK_BOX(toolbar), st->export_cancel_button, FALSE, FALSE, 4);
+    st->export_progress = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(st->export_progress), TRUE);
+    gtk_widget_set_valign(st->export_progress, GTK_ALIGN_CENTER);
+    gtk_widget_set_no_show_all(st->export_progress, TRUE);
+    gtk_box_pack_end(GTK_BOX(toolbar), st->export_progress, FALSE, FALSE, 4);
+    st->load_progress = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(st->load_progress), TRUE);
+    gtk_widget_set_valign(st->load_progress, GTK_ALIGN_CENTER);
+    gtk_widget_set_no_show_all(st->load_progress, TRUE);
+    gtk_box_pack_end(GTK_BOX(toolbar), st->load_progress, FALSE, FALSE, 4);
+
+    // Page thumbnails on the left, canvas on the right
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox, TRUE, TRUE, 0);
+
+    st->thumbnails = CHEAT_THUMBNAILS(cheat_thumbnails_new(st->doc));
+    GtkWidget *sidebar = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(sidebar), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(sidebar), GTK_WIDGET(st->thumbnails));
+    g_signal_connect(st->thumbnails, "page-activated", G_CALLBACK(on_thumbnail_activated), st);
+    g_signal_connect(st->thumbnails, "page-moved", G_CALLBACK(on_thumbnail_moved), st);
+    gtk_box_pack_start(GTK_BOX(hbox), sidebar, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), gtk_separator_new(GTK_ORIENTATION_VERTICAL), FALSE, FALSE, 0);
 
     // Pack canvas after toolbar for proper layout
-    gtk_box_pack_start(GTK_BOX(vbox), canvas, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), canvas, TRUE, TRUE, 0);
 
     // DnD
     setup_dnd(canvas, st);
+    g_signal_connect(st->canvas, "page-changed", G_CALLBACK(on_canvas_page_changed), st);
+    g_signal_connect(st->canvas, "content-changed", G_CALLBACK(on_canvas_content_changed), st);
 
     g_signal_connect(win, "key-press-event", G_CALLBACK(on_key_press), st);
 
     // Setup auto-save timer (every 30 seconds)
     st->autosave_timer_id = g_timeout_add_seconds(30, autosave_timer_callback, st);
 
+    // Refresh decoded image memory usage every couple of seconds
+    g_timeout_add_seconds(2, update_memory_label, st);
+
     update_page_label(st);
+    update_memory_label(st);
     gtk_widget_show_all(win);
+    begin_loading(st);
 }
 
 int main(int argc, char **argv) {
+    cli_setup_trace(&argc, argv);
+    // Batch exports never touch GTK, so they work without a display
+    int cli_status = 0;
+    if (cli_run(argc, argv, &cli_status)) {
+        trace_stop();
+        return cli_status;
+    }
+
     GtkApplication *app = gtk_application_new("com.example.cheatsheet", G_APPLICATION_DEFAULT_FLAGS);
     g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
     int status = g_application_run(G_APPLICATION(app), argc, argv);
     g_object_unref(app);
+    trace_stop();
     return status;
 }
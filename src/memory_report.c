@@ -0,0 +1,162 @@
+#include "memory_report.h"
+#include "serialize.h"
+#include "trace.h"
+#include <string.h>
+
+// Per distinct source: how often and where it is used
+typedef struct {
+    ImageSourceMemory memory;
+    int items;                  // item references, as image or as original
+    int first_page;
+    gboolean other_pages;       // also used on a page after first_page
+    gboolean original;          // referenced as some image's original
+} SourceUse;
+
+static void note_source(GHashTable *uses, ImageSource *src, int page, gboolean original) {
+    SourceUse *use = (SourceUse*)g_hash_table_lookup(uses, src);
+    if (!use) {
+        use = g_new0(SourceUse, 1);
+        image_source_get_memory(src, &use->memory);
+        use->first_page = page;
+        g_hash_table_insert(uses, src, use);
+    }
+    use->items++;
+    if (page != use->first_page) use->other_pages = TRUE;
+    if (original) use->original = TRUE;
+}
+
+// Adds src to the page totals unless the page already counted it.
+static void add_page_source(PageMemory *pm, GHashTable *seen, GHashTable *uses, ImageSource *src) {
+    if (!g_hash_table_add(seen, src)) return;
+    const SourceUse *use = (const SourceUse*)g_hash_table_lookup(uses, src);
+    pm->image_bytes += use->memory.pixel_bytes;
+    pm->resident_bytes += use->memory.resident_bytes;
+    if (!use->other_pages) pm->unique_image_bytes += use->memory.pixel_bytes;
+}
+
+static gsize stroke_bytes(const Stroke *stroke) {
+    return sizeof(Stroke) + sizeof(GList) + sizeof(GArray) + (gsize)stroke->points->len * sizeof(Point);
+}
+
+void document_memory_measure(Document *doc, DocumentMemory *memory) {
+    g_return_if_fail(doc != NULL && memory != NULL);
+    TRACE_SCOPE("document.memory");
+    memset(memory, 0, sizeof(*memory));
+    memory->pages = g_array_sized_new(FALSE, TRUE, sizeof(PageMemory), doc->pages->len);
+
+    GHashTable *uses = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    for (guint i = 0; i < doc->pages->len; i++) {
+        Page *page = (Page*)g_ptr_array_index(doc->pages, i);
+        for (GList *l = page->items; l; l = l->next) {
+            ImageItem *item = (ImageItem*)l->data;
+            note_source(uses, item->source, (int)i, FALSE);
+            ImageSource *original = image_source_get_original(item->source);
+            if (original) note_source(uses, original, (int)i, TRUE);
+        }
+    }
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, uses);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const SourceUse *use = (const SourceUse*)value;
+        gsize bytes = use->memory.pixel_bytes;
+        memory->images++;
+        memory->image_bytes += bytes;
+        memory->item_image_bytes += bytes * (gsize)use->items;
+        memory->resident_bytes += use->memory.resident_bytes;
+        memory->encoded_bytes += use->memory.encoded_bytes;
+        if (use->items > 1) {
+            memory->shared_images++;
+            memory->shared_image_bytes += bytes;
+        }
+        if (use->original) memory->original_bytes += bytes;
+        if (!use->memory.pixels_known) memory->estimated = TRUE;
+    }
+
+    GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+    // Braces and the current page index around the pages
+    memory->saved_bytes = 32;
+    for (guint i = 0; i < doc->pages->len; i++) {
+        Page *page = (Page*)g_ptr_array_index(doc->pages, i);
+        PageMemory pm = {0};
+        g_hash_table_remove_all(seen);
+        for (GList *l = page->items; l; l = l->next) {
+            ImageItem *item = (ImageItem*)l->data;
+            pm.items++;
+            add_page_source(&pm, seen, uses, item->source);
+            ImageSource *original = image_source_get_original(item->source);
+            if (original) add_page_source(&pm, seen, uses, original);
+        }
+        for (GList *l = page->strokes; l; l = l->next) {
+            Stroke *stroke = (Stroke*)l->data;
+            pm.strokes++;
+            pm.points += stroke->points->len;
+            pm.stroke_bytes += stroke_bytes(stroke);
+        }
+        pm.saved_bytes = page_estimate_saved_size(page);
+
+        memory->items += pm.items;
+        memory->points += pm.points;
+        memory->stroke_bytes += pm.stroke_bytes;
+        memory->saved_bytes += pm.saved_bytes;
+        g_array_append_val(memory->pages, pm);
+    }
+    g_hash_table_unref(seen);
+    g_hash_table_unref(uses);
+}
+
+void document_memory_clear(DocumentMemory *memory) {
+    g_return_if_fail(memory != NULL);
+    if (memory->pages) g_array_unref(memory->pages);
+    memset(memory, 0, sizeof(*memory));
+}
+
+// Appends "label: size" with the size formatted by g_format_size()
+static void append_size(GString *out, const char *label, gsize bytes) {
+    gchar *size = g_format_size(bytes);
+    g_string_append_printf(out, "%-28s %s\n", label, size);
+    g_free(size);
+}
+
+gchar *document_memory_format(const DocumentMemory *memory) {
+    g_return_val_if_fail(memory != NULL && memory->pages != NULL, NULL);
+    GString *out = g_string_new(NULL);
+    g_string_append_printf(out, "Pages: %u  Items: %d  Images: %d (%d shared)  Stroke points: %" G_GSIZE_FORMAT "\n\n",
+                           memory->pages->len, memory->items, memory->images, memory->shared_images, memory->points);
+
+    append_size(out, memory->estimated ? "Decoded images (estimated):" : "Decoded images:", memory->image_bytes);
+    append_size(out, "  shared between items:", memory->shared_image_bytes);
+    append_size(out, "  without sharing:", memory->item_image_bytes);
+    append_size(out, "  originals for cropping:", memory->original_bytes);
+    append_size(out, "  in the cache now:", memory->resident_bytes);
+    append_size(out, "Compressed image data:", memory->encoded_bytes);
+    append_size(out, "Strokes:", memory->stroke_bytes);
+    append_size(out, "Render caches:", memory->cache_bytes);
+    append_size(out, "Estimated file size:", memory->saved_bytes);
+
+    gchar *usage = g_format_size(image_source_get_usage());
+    gchar *budget = g_format_size(image_source_get_budget());
+    g_string_append_printf(out, "%-28s %s of %s\n\n", "Image cache (all documents):", usage, budget);
+    g_free(budget);
+    g_free(usage);
+
+    g_string_append_printf(out, "%5s %6s %8s %8s %11s %11s %11s %11s %11s\n",
+                           "Page", "Items", "Strokes", "Points", "Images", "Unique", "Cached", "Strokes", "File");
+    for (guint i = 0; i < memory->pages->len; i++) {
+        const PageMemory *pm = &g_array_index(memory->pages, PageMemory, i);
+        gchar *images = g_format_size(pm->image_bytes);
+        gchar *unique = g_format_size(pm->unique_image_bytes);
+        gchar *cached = g_format_size(pm->resident_bytes);
+        gchar *strokes = g_format_size(pm->stroke_bytes);
+        gchar *saved = g_format_size(pm->saved_bytes);
+        g_string_append_printf(out, "%5u %6d %8d %8" G_GSIZE_FORMAT " %11s %11s %11s %11s %11s\n",
+                               i + 1, pm->items, pm->strokes, pm->points, images, unique, cached, strokes, saved);
+        g_free(saved);
+        g_free(strokes);
+        g_free(cached);
+        g_free(unique);
+        g_free(images);
+    }
+    return g_string_free(out, FALSE);
+}
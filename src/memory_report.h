@@ -0,0 +1,48 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "document.h"
+
+G_BEGIN_DECLS
+
+// Where the memory of a document goes, page by page. Image bytes are decoded
+// pixels in their compact form whether or not they are cached right now;
+// sources that were never decoded are counted at their RGBA size and mark the
+// report as estimated. Every image counts its kept original as well.
+typedef struct {
+    int items;
+    int strokes;
+    gsize points;
+    gsize image_bytes;          // distinct images drawn on the page
+    gsize unique_image_bytes;   // part of image_bytes used on no other page
+    gsize resident_bytes;       // part of image_bytes decoded in the cache now
+    gsize stroke_bytes;         // stroke structs and point arrays
+    gsize saved_bytes;          // estimated share of the saved file
+} PageMemory;
+
+typedef struct {
+    GArray *pages;              // PageMemory, one per page
+    int items;
+    int images;                 // distinct image sources, originals included
+    int shared_images;          // of those, used by more than one item
+    gsize image_bytes;          // every distinct image once
+    gsize shared_image_bytes;   // part of image_bytes used by more than one item
+    gsize item_image_bytes;     // summed per item, as if nothing were shared
+    gsize original_bytes;       // part of image_bytes kept only for re-cropping
+    gsize resident_bytes;       // part of image_bytes decoded in the cache now
+    gsize encoded_bytes;        // compressed image data held in memory
+    gsize points;
+    gsize stroke_bytes;
+    gsize saved_bytes;          // estimated size of the saved file
+    gboolean estimated;         // some images were never decoded
+    gsize cache_bytes;          // rendered bitmaps; left for the caller to fill in
+} DocumentMemory;
+
+// Fills in memory for doc. Only reads the pages, so a snapshot may be
+// measured on another thread. Free with document_memory_clear().
+void document_memory_measure(Document *doc, DocumentMemory *memory);
+void document_memory_clear(DocumentMemory *memory);
+
+// Plain-text report: document totals followed by one row per page.
+gchar *document_memory_format(const DocumentMemory *memory);
+
+G_END_DECLS
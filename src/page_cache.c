@@ -0,0 +1,126 @@
+#include "page_cache.h"
+
+typedef struct {
+    guint stamp;
+    double zoom;
+    int scale;
+    cairo_surface_t *surface;
+} PageCacheEntry;
+
+struct _PageCache {
+    GQueue entries;             // PageCacheEntry*, most recently used at head
+    guint capacity;
+};
+
+static void entry_free(PageCacheEntry *e) {
+    cairo_surface_destroy(e->surface);
+    g_free(e);
+}
+
+PageCache *page_cache_new(guint capacity) {
+    PageCache *cache = g_new0(PageCache, 1);
+    g_queue_init(&cache->entries);
+    cache->capacity = MAX(1u, capacity);
+    return cache;
+}
+
+void page_cache_free(PageCache *cache) {
+    if (!cache) return;
+    page_cache_clear(cache);
+    g_free(cache);
+}
+
+static GList *find_entry(PageCache *cache, guint stamp, double zoom, int scale) {
+    for (GList *l = cache->entries.head; l; l = l->next) {
+        PageCacheEntry *e = (PageCacheEntry*)l->data;
+        if (e->stamp == stamp && e->zoom == zoom && e->scale == scale) return l;
+    }
+    return NULL;
+}
+
+cairo_surface_t *page_cache_lookup(PageCache *cache, const Page *page, double zoom, int scale) {
+    g_return_val_if_fail(cache != NULL && page != NULL, NULL);
+    GList *link = find_entry(cache, page->stamp, zoom, scale);
+    if (!link) return NULL;
+    g_queue_unlink(&cache->entries, link);
+    g_queue_push_head_link(&cache->entries, link);
+    return ((PageCacheEntry*)link->data)->surface;
+}
+
+cairo_surface_t *page_cache_lookup_any_zoom(PageCache *cache, const Page *page, int scale, double *zoom) {
+    g_return_val_if_fail(cache != NULL && page != NULL, NULL);
+    for (GList *l = cache->entries.head; l; l = l->next) {
+        PageCacheEntry *e = (PageCacheEntry*)l->data;
+        if (e->stamp != page->stamp || e->scale != scale) continue;
+        if (zoom) *zoom = e->zoom;
+        return e->surface;
+    }
+    return NULL;
+}
+
+gboolean page_cache_contains(PageCache *cache, guint stamp, double zoom, int scale) {
+    g_return_val_if_fail(cache != NULL, FALSE);
+    return find_entry(cache, stamp, zoom, scale) != NULL;
+}
+
+void page_cache_insert(PageCache *cache, guint stamp, double zoom, int scale, cairo_surface_t *surface) {
+    g_return_if_fail(cache != NULL && surface != NULL);
+    GList *link = find_entry(cache, stamp, zoom, scale);
+    if (link) {
+        PageCacheEntry *e = (PageCacheEntry*)link->data;
+        cairo_surface_destroy(e->surface);
+        e->surface = cairo_surface_reference(surface);
+        g_queue_unlink(&cache->entries, link);
+        g_queue_push_head_link(&cache->entries, link);
+        return;
+    }
+    PageCacheEntry *e = g_new0(PageCacheEntry, 1);
+    e->stamp = stamp;
+    e->zoom = zoom;
+    e->scale = scale;
+    e->surface = cairo_surface_reference(surface);
+    g_queue_push_head(&cache->entries, e);
+    while (cache->entries.length > cache->capacity) {
+        entry_free((PageCacheEntry*)g_queue_pop_tail(&cache->entries));
+    }
+}
+
+void page_cache_set_capacity(PageCache *cache, guint capacity) {
+    g_return_if_fail(cache != NULL);
+    cache->capacity = MAX(1u, capacity);
+    while (cache->entries.length > cache->capacity) {
+        entry_free((PageCacheEntry*)g_queue_pop_tail(&cache->entries));
+    }
+}
+
+void page_cache_retain(PageCache *cache, const guint *stamps, guint n_stamps) {
+    g_return_if_fail(cache != NULL);
+    GList *l = cache->entries.head;
+    while (l) {
+        GList *next = l->next;
+        PageCacheEntry *e = (PageCacheEntry*)l->data;
+        gboolean keep = FALSE;
+        for (guint i = 0; i < n_stamps && !keep; i++) keep = stamps[i] == e->stamp;
+        if (!keep) {
+            g_queue_delete_link(&cache->entries, l);
+            entry_free(e);
+        }
+        l = next;
+    }
+}
+
+void page_cache_clear(PageCache *cache) {
+    g_return_if_fail(cache != NULL);
+    PageCacheEntry *e;
+    while ((e = (PageCacheEntry*)g_queue_pop_head(&cache->entries))) entry_free(e);
+}
+
+gsize page_cache_get_bytes(PageCache *cache) {
+    g_return_val_if_fail(cache != NULL, 0);
+    gsize bytes = 0;
+    for (GList *l = cache->entries.head; l; l = l->next) {
+        cairo_surface_t *s = ((PageCacheEntry*)l->data)->surface;
+        bytes += (gsize)cairo_image_surface_get_stride(s) * (gsize)cairo_image_surface_get_height(s);
+    }
+    return bytes;
+}
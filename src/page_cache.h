@@ -0,0 +1,31 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "document.h"
+
+G_BEGIN_DECLS
+
+// Small LRU of rendered page bitmaps, keyed by page stamp, zoom and device
+// scale. Only used from the main thread.
+typedef struct _PageCache PageCache;
+
+PageCache *page_cache_new(guint capacity);
+void page_cache_free(PageCache *cache);
+
+// Returns a borrowed surface, or NULL if the page is not cached in its
+// current state at this zoom.
+cairo_surface_t *page_cache_lookup(PageCache *cache, const Page *page, double zoom, int scale);
+// Returns a borrowed bitmap of the page in its current state at any zoom,
+// storing that zoom in *zoom, or NULL. Used as a stand-in while zooming.
+cairo_surface_t *page_cache_lookup_any_zoom(PageCache *cache, const Page *page, int scale, double *zoom);
+gboolean page_cache_contains(PageCache *cache, guint stamp, double zoom, int scale);
+// Takes a reference on surface.
+void page_cache_insert(PageCache *cache, guint stamp, double zoom, int scale, cairo_surface_t *surface);
+void page_cache_clear(PageCache *cache);
+// Bytes of page bitmaps held.
+gsize page_cache_get_bytes(PageCache *cache);
+// Changes the number of bitmaps kept, dropping the least recently used ones.
+void page_cache_set_capacity(PageCache *cache, guint capacity);
+// Drops every bitmap whose page stamp is not in stamps.
+void page_cache_retain(PageCache *cache, const guint *stamps, guint n_stamps);
+
+G_END_DECLS
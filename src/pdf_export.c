@@ -1,18 +1,154 @@
 #include "pdf_export.h"
+#include "pixconv.h"
+#include "render.h"
+#include "trace.h"
 #include <cairo-pdf.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
 
-static void cairo_draw_image_item(cairo_t *cr, ImageItem *it) {
-    GdkPixbuf *sub = gdk_pixbuf_new_subpixbuf(it->pixbuf, it->crop_x, it->crop_y, it->crop_w, it->crop_h);
+static const char *sniff_mime_type(GBytes *bytes) {
+    gsize len = 0;
+    const guchar *d = g_bytes_get_data(bytes, &len);
+    if (len >= 3 && d[0] == 0xff && d[1] == 0xd8 && d[2] == 0xff) return CAIRO_MIME_TYPE_JPEG;
+    if (len >= 8 && memcmp(d, "\x89PNG\r\n\x1a\n", 8) == 0) return CAIRO_MIME_TYPE_PNG;
+    return NULL;
+}
+
+static gboolean has_transparency(GdkPixbuf *pb) {
+    if (!gdk_pixbuf_get_has_alpha(pb)) return FALSE;
+    int w = gdk_pixbuf_get_width(pb), h = gdk_pixbuf_get_height(pb);
+    int stride = gdk_pixbuf_get_rowstride(pb);
+    const guint8 *px = gdk_pixbuf_read_pixels(pb);
+    for (int y = 0; y < h; y++) {
+        const guint8 *row = px + (gsize)y * stride;
+        for (int x = 0; x < w; x++) if (row[x * 4 + 3] != 255) return TRUE;
+    }
+    return FALSE;
+}
+
+// Photos have many distinct colours and few identical neighbouring pixels;
+// screenshots, diagrams and text are the opposite. Looks at a grid of at most
+// about 64k pixels, with colours reduced to 15 bits.
+static gboolean looks_like_photo(GdkPixbuf *pb) {
+    int w = gdk_pixbuf_get_width(pb), h = gdk_pixbuf_get_height(pb);
+    int n = gdk_pixbuf_get_n_channels(pb);
+    int stride = gdk_pixbuf_get_rowstride(pb);
+    const guint8 *px = gdk_pixbuf_read_pixels(pb);
+    if (w < 16 || h < 16) return FALSE;
+    int step = MAX(1, (int)sqrt((double)w * h / 65536.0));
+    guint32 seen[32768 / 32] = {0};
+    guint samples = 0, distinct = 0, equal = 0;
+    for (int y = 0; y < h; y += step) {
+        const guint8 *row = px + (gsize)y * stride;
+        for (int x = 0; x + 1 < w; x += step) {
+            const guint8 *p = row + x * n, *q = p + n;
+            if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2]) equal++;
+            guint c = ((guint)(p[0] >> 3) << 10) | ((guint)(p[1] >> 3) << 5) | (guint)(p[2] >> 3);
+            if (!(seen[c >> 5] & (1u << (c & 31)))) {
+                seen[c >> 5] |= 1u << (c & 31);
+                distinct++;
+            }
+            samples++;
+        }
+    }
+    return distinct >= 1024 && equal * 2 < samples;
+}
+
+// The JPEG saver drops an alpha channel, which is fine for opaque images.
+static GBytes *encode_jpeg(GdkPixbuf *pb, int quality) {
+    TRACE_SCOPE("image.encode_jpeg");
+    gchar *q = g_strdup_printf("%d", CLAMP(quality, 1, 100));
+    gchar *buffer = NULL;
+    gsize size = 0;
+    gboolean ok = gdk_pixbuf_save_to_buffer(pb, &buffer, &size, "jpeg", NULL, "quality", q, NULL);
+    g_free(q);
+    return ok ? g_bytes_new_take(buffer, size) : NULL;
+}
+
+static void attach_bytes(cairo_surface_t *surface, const char *mime, GBytes *bytes) {
+    gsize len = 0;
+    const guchar *data = g_bytes_get_data(bytes, &len);
+    cairo_surface_set_mime_data(surface, mime, data, len, (cairo_destroy_func_t)g_bytes_unref, g_bytes_ref(bytes));
+}
+
+// Items drawn from the same image data, crop and size get the same pixels, so
+// a unique id lets the PDF embed them once as a shared image. The id is keyed
+// on the compressed data rather than the source, since every item loaded from
+// a file has a source of its own. Compressed data
+// attached as JPEG is written as-is by the PDF backend instead of compressing
+// the pixels again: the source file when the whole source is used unscaled,
+// otherwise a fresh encode if the options allow lossy photos.
+static void attach_image_data(cairo_surface_t *surface, ImageItem *it, GdkPixbuf *pixels, const PdfExportOptions *options) {
+    int w = gdk_pixbuf_get_width(pixels), h = gdk_pixbuf_get_height(pixels);
+    const char *hash = image_source_get_content_hash(it->source);
+    gchar *key = hash ? g_strdup(hash) : g_strdup_printf("%p", (void*)it->source);
+    gchar *id = g_strdup_printf("cheatsheet-%s-%d,%d,%d,%d-%dx%d-q%d", key,
+                                it->crop_x, it->crop_y, it->crop_w, it->crop_h, w, h, options->jpeg_quality);
+    g_free(key);
+    cairo_surface_set_mime_data(surface, CAIRO_MIME_TYPE_UNIQUE_ID, (const guchar*)id, strlen(id), g_free, id);
+
+    gboolean whole = it->crop_x == 0 && it->crop_y == 0 && w == image_source_get_width(it->source) &&
+                     h == image_source_get_height(it->source);
+    GBytes *encoded = whole ? image_source_peek_encoded(it->source) : NULL;
+    const char *mime = encoded ? sniff_mime_type(encoded) : NULL;
+    if (g_strcmp0(mime, CAIRO_MIME_TYPE_JPEG) != 0 && options->jpeg_quality > 0 &&
+        !has_transparency(pixels) && looks_like_photo(pixels)) {
+        GBytes *jpeg = encode_jpeg(pixels, options->jpeg_quality);
+        if (jpeg) {
+            if (encoded) g_bytes_unref(encoded);
+            encoded = jpeg;
+            mime = CAIRO_MIME_TYPE_JPEG;
+        }
+    }
+    if (encoded && mime) attach_bytes(surface, mime, encoded);
+    if (encoded) g_bytes_unref(encoded);
+}
+
+// Pixels embedded for an item: the crop rectangle, downsampled to the target
+// DPI at the item's placed size. Runs on worker threads.
+static cairo_surface_t *prepare_image(ImageItem *it, const PdfExportOptions *options) {
+    TRACE_SCOPE("pdf.prepare_image");
+    GdkPixbuf *pixbuf = image_source_get_pixbuf(it->source);
+    if (!pixbuf) return NULL;
+    if (it->crop_x < 0 || it->crop_y < 0 || it->crop_w <= 0 || it->crop_h <= 0 ||
+        it->crop_x + it->crop_w > gdk_pixbuf_get_width(pixbuf) ||
+        it->crop_y + it->crop_h > gdk_pixbuf_get_height(pixbuf)) {
+        g_object_unref(pixbuf);
+        return NULL;
+    }
+    int tw = it->crop_w, th = it->crop_h;
+    if (options->target_dpi > 0) {
+        tw = MIN(tw, MAX(1, (int)ceil(it->width / 72.0 * options->target_dpi)));
+        th = MIN(th, MAX(1, (int)ceil(it->height / 72.0 * options->target_dpi)));
+    }
+    // Only the cropped part is converted and embedded
+    GdkPixbuf *pixels = gdk_pixbuf_new_subpixbuf(pixbuf, it->crop_x, it->crop_y, it->crop_w, it->crop_h);
+    g_object_unref(pixbuf);
+    if (tw != it->crop_w || th != it->crop_h) {
+        // BILINEAR averages over the covered area when reducing
+        GdkPixbuf *scaled = gdk_pixbuf_scale_simple(pixels, tw, th, GDK_INTERP_BILINEAR);
+        g_object_unref(pixels);
+        if (!scaled) return NULL;
+        pixels = scaled;
+    }
+    cairo_surface_t *surface = pixconv_surface_from_pixbuf(pixels, 0, 0, tw, th);
+    if (surface) attach_image_data(surface, it, pixels, options);
+    g_object_unref(pixels);
+    return surface;
+}
+
+static void cairo_draw_image_surface(cairo_t *cr, ImageItem *it, cairo_surface_t *surface) {
+    int w = cairo_image_surface_get_width(surface);
+    int h = cairo_image_surface_get_height(surface);
     cairo_save(cr);
     cairo_translate(cr, it->x, it->y);
-    double sx = it->width / (double)it->crop_w;
-    double sy = it->height / (double)it->crop_h;
-    cairo_scale(cr, sx, sy);
-    gdk_cairo_set_source_pixbuf(cr, sub, 0, 0);
-    cairo_rectangle(cr, 0, 0, it->crop_w, it->crop_h);
+    cairo_scale(cr, it->width / (double)w, it->height / (double)h);
+    cairo_set_source_surface(cr, surface, 0, 0);
+    cairo_rectangle(cr, 0, 0, w, h);
     cairo_fill(cr);
     cairo_restore(cr);
-    g_object_unref(sub);
 }
 
 static void cairo_draw_stroke(cairo_t *cr, Stroke *stroke) {
@@ -36,19 +172,107 @@ static void cairo_draw_stroke(cairo_t *cr, Stroke *stroke) {
     cairo_restore(cr);
 }
 
-gboolean export_document_to_pdf(Document *doc, const char *filename, GError **error) {
-    g_return_val_if_fail(doc != NULL && filename != NULL, FALSE);
+void pdf_export_options_init(PdfExportOptions *options) {
+    pdf_export_options_init_profile(options, PDF_EXPORT_LOSSLESS);
+}
 
-    cairo_surface_t *surface = cairo_pdf_surface_create(filename, A4_WIDTH_PT, A4_HEIGHT_PT);
-    cairo_status_t status = cairo_surface_status(surface);
-    if (status != CAIRO_STATUS_SUCCESS) {
-        if (error) *error = g_error_new_literal(g_quark_from_static_string("pdf-export"), status, cairo_status_to_string(status));
-        cairo_surface_destroy(surface);
-        return FALSE;
+void pdf_export_options_init_profile(PdfExportOptions *options, PdfExportProfile profile) {
+    g_return_if_fail(options != NULL);
+    switch (profile) {
+    case PDF_EXPORT_BALANCED:
+        options->target_dpi = PDF_EXPORT_DEFAULT_DPI;
+        options->jpeg_quality = 85;
+        break;
+    case PDF_EXPORT_SMALL:
+        options->target_dpi = 150.0;
+        options->jpeg_quality = 70;
+        break;
+    case PDF_EXPORT_LOSSLESS:
+    default:
+        // Full resolution, as exports were before profiles existed
+        options->target_dpi = 0.0;
+        options->jpeg_quality = 0;
+        break;
     }
-    cairo_t *cr = cairo_create(surface);
+}
+
+static const char *profile_names[] = { "lossless", "balanced", "small" };
+
+const char *pdf_export_profile_to_string(PdfExportProfile profile) {
+    g_return_val_if_fail((guint)profile < G_N_ELEMENTS(profile_names), NULL);
+    return profile_names[profile];
+}
+
+gboolean pdf_export_profile_from_string(const char *name, PdfExportProfile *profile) {
+    g_return_val_if_fail(name != NULL && profile != NULL, FALSE);
+    for (guint i = 0; i < G_N_ELEMENTS(profile_names); i++) {
+        if (g_ascii_strcasecmp(name, profile_names[i]) == 0) {
+            *profile = (PdfExportProfile)i;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+typedef struct ExportState ExportState;
+
+typedef struct {
+    ExportState *state;
+    ImageItem *item;            // borrowed; the document is not edited during export
+    cairo_surface_t *surface;   // result, NULL if the image could not be prepared
+    gboolean done;
+} ImageJob;
+
+struct ExportState {
+    GMutex lock;
+    GCond cond;                 // signalled when a job is done
+    PdfExportOptions options;
+};
+
+static void image_job_run(gpointer data) {
+    ImageJob *job = (ImageJob*)data;
+    cairo_surface_t *surface = prepare_image(job->item, &job->state->options);
+    g_mutex_lock(&job->state->lock);
+    job->surface = surface;
+    job->done = TRUE;
+    g_cond_broadcast(&job->state->cond);
+    g_mutex_unlock(&job->state->lock);
+}
+
+static GQuark pdf_export_quark(void) {
+    return g_quark_from_static_string("pdf-export");
+}
+
+// Waits for a job started with render_run_async(); returns its surface.
+static cairo_surface_t *image_job_wait(ExportState *state, ImageJob *job) {
+    g_mutex_lock(&state->lock);
+    while (!job->done) g_cond_wait(&state->cond, &state->lock);
+    g_mutex_unlock(&state->lock);
+    cairo_surface_t *surface = job->surface;
+    job->surface = NULL;
+    return surface;
+}
 
+// Writes the pages to cr, stopping early if cancellable fires.
+static gboolean write_pages(cairo_t *cr, Document *doc, ExportState *state, GCancellable *cancellable,
+                            PdfExportProgressFunc progress, gpointer progress_data, GError **error) {
+    // One job per image in drawing order. Workers run ahead of the page
+    // writer by at most max_in_flight images so memory stays bounded.
+    GPtrArray *jobs = g_ptr_array_new_with_free_func(g_free);
     for (guint i = 0; i < doc->pages->len; i++) {
+        Page *p = (Page*)g_ptr_array_index(doc->pages, i);
+        for (GList *l = p->items; l; l = l->next) {
+            ImageJob *job = g_new0(ImageJob, 1);
+            job->state = state;
+            job->item = (ImageItem*)l->data;
+            g_ptr_array_add(jobs, job);
+        }
+    }
+    const guint max_in_flight = 2 * MAX(1u, g_get_num_processors());
+    guint submitted = 0, next = 0;
+    gboolean cancelled = FALSE;
+
+    for (guint i = 0; i < doc->pages->len && !cancelled; i++) {
         Page *p = (Page*)g_ptr_array_index(doc->pages, i);
         // white background
         cairo_save(cr);
@@ -56,19 +280,167 @@ gboolean export_document_to_pdf(Document *doc, const char *filename, GError **er
         cairo_paint(cr);
         cairo_restore(cr);
         // draw images
-        for (GList *l = p->items; l; l = l->next) {
-            ImageItem *it = (ImageItem*)l->data;
-            cairo_draw_image_item(cr, it);
+        for (GList *l = p->items; l; l = l->next, next++) {
+            if (g_cancellable_is_cancelled(cancellable)) { cancelled = TRUE; break; }
+            while (submitted < jobs->len && submitted < next + max_in_flight) {
+                render_run_async(image_job_run, g_ptr_array_index(jobs, submitted++));
+            }
+            ImageJob *job = (ImageJob*)g_ptr_array_index(jobs, next);
+            cairo_surface_t *surface = image_job_wait(state, job);
+            if (surface) {
+                cairo_draw_image_surface(cr, job->item, surface);
+                cairo_surface_destroy(surface);
+            }
         }
+        if (cancelled) break;
         // draw strokes
         for (GList *l = p->strokes; l; l = l->next) {
             Stroke *s = (Stroke*)l->data;
             cairo_draw_stroke(cr, s);
         }
         if (i + 1 < doc->pages->len) cairo_show_page(cr);
+        if (progress) progress((int)i + 1, (int)doc->pages->len, progress_data);
+    }
+
+    // Jobs still running reference the state; let them finish
+    for (; next < submitted; next++) {
+        cairo_surface_t *surface = image_job_wait(state, (ImageJob*)g_ptr_array_index(jobs, next));
+        if (surface) cairo_surface_destroy(surface);
     }
+    g_ptr_array_unref(jobs);
+    if (cancelled) g_cancellable_set_error_if_cancelled(cancellable, error);
+    return !cancelled;
+}
+
+gboolean export_document_to_pdf_full(Document *doc, const char *filename, const PdfExportOptions *options,
+                                     GCancellable *cancellable, PdfExportProgressFunc progress,
+                                     gpointer progress_data, GError **error) {
+    g_return_val_if_fail(doc != NULL && filename != NULL, FALSE);
+    TRACE_SCOPE("pdf.export");
+    PdfExportOptions defaults;
+    if (!options) {
+        pdf_export_options_init(&defaults);
+        options = &defaults;
+    }
+
+    // Written next to the target and renamed at the end, so a failed or
+    // cancelled export neither leaves a partial file nor clobbers an old one
+    gchar *tmp_path = g_strdup_printf("%s.part", filename);
+    cairo_surface_t *surface = cairo_pdf_surface_create(tmp_path, A4_WIDTH_PT, A4_HEIGHT_PT);
+    cairo_status_t status = cairo_surface_status(surface);
+    if (status != CAIRO_STATUS_SUCCESS) {
+        g_set_error_literal(error, pdf_export_quark(), status, cairo_status_to_string(status));
+        cairo_surface_destroy(surface);
+        g_unlink(tmp_path);
+        g_free(tmp_path);
+        return FALSE;
+    }
+    cairo_t *cr = cairo_create(surface);
+
+    ExportState state;
+    g_mutex_init(&state.lock);
+    g_cond_init(&state.cond);
+    state.options = *options;
+    gboolean ok = write_pages(cr, doc, &state, cancellable, progress, progress_data, error);
+    g_cond_clear(&state.cond);
+    g_mutex_clear(&state.lock);
+
     cairo_destroy(cr);
     cairo_surface_finish(surface);
+    status = cairo_surface_status(surface);
     cairo_surface_destroy(surface);
-    return TRUE;
+    if (ok && status != CAIRO_STATUS_SUCCESS) {
+        g_set_error_literal(error, pdf_export_quark(), status, cairo_status_to_string(status));
+        ok = FALSE;
+    }
+    if (ok && g_rename(tmp_path, filename) != 0) {
+        int saved = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved), "Cannot write %s: %s", filename, g_strerror(saved));
+        ok = FALSE;
+    }
+    if (!ok) g_unlink(tmp_path);
+    g_free(tmp_path);
+    return ok;
+}
+
+gboolean export_document_to_pdf(Document *doc, const char *filename, const PdfExportOptions *options, GError **error) {
+    return export_document_to_pdf_full(doc, filename, options, NULL, NULL, NULL, error);
+}
+
+typedef struct {
+    Document *snapshot;
+    gchar *filename;
+    PdfExportOptions options;
+    PdfExportProgressFunc progress;
+    gpointer progress_data;
+    GMainContext *context;      // where progress is reported
+} AsyncExport;
+
+typedef struct {
+    PdfExportProgressFunc progress;
+    gpointer progress_data;
+    int done, total;
+} ProgressUpdate;
+
+static void async_export_free(gpointer data) {
+    AsyncExport *ae = (AsyncExport*)data;
+    document_free(ae->snapshot);
+    g_free(ae->filename);
+    g_main_context_unref(ae->context);
+    g_free(ae);
+}
+
+static gboolean deliver_progress(gpointer data) {
+    ProgressUpdate *u = (ProgressUpdate*)data;
+    u->progress(u->done, u->total, u->progress_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void relay_progress(int done, int total, gpointer data) {
+    AsyncExport *ae = (AsyncExport*)data;
+    ProgressUpdate *u = g_new0(ProgressUpdate, 1);
+    u->progress = ae->progress;
+    u->progress_data = ae->progress_data;
+    u->done = done;
+    u->total = total;
+    g_main_context_invoke_full(ae->context, G_PRIORITY_DEFAULT, deliver_progress, u, g_free);
+}
+
+static void export_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    (void)source_object;
+    AsyncExport *ae = (AsyncExport*)task_data;
+    GError *error = NULL;
+    if (export_document_to_pdf_full(ae->snapshot, ae->filename, &ae->options, cancellable,
+                                    ae->progress ? relay_progress : NULL, ae, &error)) {
+        g_task_return_boolean(task, TRUE);
+    } else {
+        g_task_return_error(task, error);
+    }
+}
+
+void export_document_to_pdf_async(Document *doc, const char *filename, const PdfExportOptions *options,
+                                  GCancellable *cancellable, PdfExportProgressFunc progress, gpointer progress_data,
+                                  GAsyncReadyCallback callback, gpointer user_data) {
+    g_return_if_fail(doc != NULL && filename != NULL);
+    AsyncExport *ae = g_new0(AsyncExport, 1);
+    ae->snapshot = document_snapshot(doc);
+    ae->filename = g_strdup(filename);
+    if (options) ae->options = *options;
+    else pdf_export_options_init(&ae->options);
+    ae->progress = progress;
+    ae->progress_data = progress_data;
+    ae->context = g_main_context_ref_thread_default();
+
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_source_tag(task, export_document_to_pdf_async);
+    g_task_set_task_data(task, ae, async_export_free);
+    // Stops at the next image or page when cancelled
+    g_task_set_return_on_cancel(task, FALSE);
+    g_task_run_in_thread(task, export_thread);
+    g_object_unref(task);
+}
+
+gboolean export_document_to_pdf_finish(GAsyncResult *result, GError **error) {
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    return g_task_propagate_boolean(G_TASK(result), error);
 }
@@ -2,5 +2,50 @@
 #include <gtk/gtk.h>
 #include "document.h"
 
-// Export the whole document to a multi-page PDF at A4 size. Returns TRUE on success.
-gboolean export_document_to_pdf(Document *doc, const char *filename, GError **error);
+typedef struct {
+    // Images are cropped and downsampled to this many pixels per inch of
+    // their placed size before embedding; 0 embeds the cropped pixels as they
+    // are. Images are never upsampled.
+    double target_dpi;
+    // JPEG quality (1-100) for opaque images that look like photos; 0 keeps
+    // every image lossless. Screenshots and diagrams are never made lossy.
+    int jpeg_quality;
+} PdfExportOptions;
+
+// Presets: lossless (full resolution), balanced (300 DPI, photos as JPEG 85)
+// and small (150 DPI, photos as JPEG 70).
+typedef enum {
+    PDF_EXPORT_LOSSLESS,
+    PDF_EXPORT_BALANCED,
+    PDF_EXPORT_SMALL
+} PdfExportProfile;
+
+#define PDF_EXPORT_DEFAULT_DPI 300.0     // of the balanced profile
+
+// Same as the lossless profile.
+void pdf_export_options_init(PdfExportOptions *options);
+void pdf_export_options_init_profile(PdfExportOptions *options, PdfExportProfile profile);
+// Profile names as used on the command line: "lossless", "balanced", "small".
+const char *pdf_export_profile_to_string(PdfExportProfile profile);
+gboolean pdf_export_profile_from_string(const char *name, PdfExportProfile *profile);
+
+// Called after each page has been written.
+typedef void (*PdfExportProgressFunc)(int pages_done, int pages_total, gpointer user_data);
+
+// Export the whole document to a multi-page PDF at A4 size. options may be
+// NULL for the defaults. Images are prepared on the render worker pool while
+// pages are written in order. Returns TRUE on success.
+gboolean export_document_to_pdf(Document *doc, const char *filename, const PdfExportOptions *options, GError **error);
+// Same, stopping with G_IO_ERROR_CANCELLED when cancellable fires. progress
+// (may be NULL) runs on the exporting thread. The PDF is written to a
+// temporary file and only replaces filename on success.
+gboolean export_document_to_pdf_full(Document *doc, const char *filename, const PdfExportOptions *options,
+                                     GCancellable *cancellable, PdfExportProgressFunc progress,
+                                     gpointer progress_data, GError **error);
+
+// Exports a snapshot of doc on a worker thread, so doc may be edited or freed
+// meanwhile. progress is called in the caller's thread-default main context.
+void export_document_to_pdf_async(Document *doc, const char *filename, const PdfExportOptions *options,
+                                  GCancellable *cancellable, PdfExportProgressFunc progress, gpointer progress_data,
+                                  GAsyncReadyCallback callback, gpointer user_data);
+gboolean export_document_to_pdf_finish(GAsyncResult *result, GError **error);
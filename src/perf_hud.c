@@ -0,0 +1,304 @@
+#include "perf_hud.h"
+#include <json-glib/json-glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rolling window of samples in milliseconds.
+typedef struct {
+    double samples[PERF_HUD_WINDOW];
+    guint next;                 // ring position of the next sample
+    guint count;                // valid samples, up to PERF_HUD_WINDOW
+    guint64 total;              // samples ever added
+} Series;
+
+// A drawn frame waiting for the frame clock to report when it was shown.
+typedef struct {
+    gint64 frame_counter;
+    gint64 input_us;            // earliest input this frame shows, 0 if none
+    gint64 painted_us;          // end of the draw, used if presentation is unknown
+} PendingFrame;
+
+struct _PerfHud {
+    gboolean visible;
+    Series draw;                // on_draw duration
+    Series latency;             // input event to presented frame
+    guint64 frames, dropped;
+    gint64 input_us;            // earliest input not drawn yet, 0 if none
+    gint64 last_present_us;
+    GdkFrameClock *clock;
+    gulong after_paint_id;
+    GQueue pending;             // PendingFrame*, oldest first
+};
+
+// Upper bounds of the histogram buckets in ms; one more bucket holds the rest.
+static const double bucket_bounds[] = { 1, 2, 4, 8, 16.7, 33.3, 50, 100, 250, 500 };
+#define N_BUCKETS (G_N_ELEMENTS(bucket_bounds) + 1)
+
+static void series_add(Series *s, double ms) {
+    s->samples[s->next] = ms;
+    s->next = (s->next + 1) % PERF_HUD_WINDOW;
+    if (s->count < PERF_HUD_WINDOW) s->count++;
+    s->total++;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Copies the window into out in ascending order; returns the sample count.
+static guint series_sorted(const Series *s, double *out) {
+    memcpy(out, s->samples, s->count * sizeof(double));
+    qsort(out, s->count, sizeof(double), compare_double);
+    return s->count;
+}
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const double *sorted, guint n, double p) {
+    if (n == 0) return 0;
+    guint rank = (guint)(p / 100.0 * n + 0.999999);
+    return sorted[CLAMP(rank, 1, n) - 1];
+}
+
+PerfHud *perf_hud_new(void) {
+    PerfHud *hud = g_new0(PerfHud, 1);
+    g_queue_init(&hud->pending);
+    return hud;
+}
+
+static void drop_pending(PerfHud *hud) {
+    g_queue_clear_full(&hud->pending, g_free);
+    hud->input_us = 0;
+}
+
+static void detach_clock(PerfHud *hud) {
+    if (!hud->clock) return;
+    g_signal_handler_disconnect(hud->clock, hud->after_paint_id);
+    g_clear_object(&hud->clock);
+    hud->after_paint_id = 0;
+    drop_pending(hud);
+}
+
+void perf_hud_free(PerfHud *hud) {
+    if (!hud) return;
+    detach_clock(hud);
+    g_free(hud);
+}
+
+void perf_hud_set_visible(PerfHud *hud, gboolean visible) {
+    g_return_if_fail(hud != NULL);
+    hud->visible = visible;
+    if (!visible) drop_pending(hud);
+}
+
+gboolean perf_hud_get_visible(PerfHud *hud) {
+    return hud && hud->visible;
+}
+
+void perf_hud_reset(PerfHud *hud) {
+    g_return_if_fail(hud != NULL);
+    memset(&hud->draw, 0, sizeof(hud->draw));
+    memset(&hud->latency, 0, sizeof(hud->latency));
+    hud->frames = hud->dropped = 0;
+    hud->last_present_us = 0;
+    drop_pending(hud);
+}
+
+void perf_hud_input(PerfHud *hud, guint32 event_time) {
+    if (!hud || !hud->visible) return;
+    gint64 now = g_get_monotonic_time();
+    // Event times are milliseconds of the monotonic clock on Wayland and on
+    // Xorg; if they are not, latency is counted from delivery instead.
+    guint32 age = (guint32)(now / 1000) - event_time;
+    gint64 t = age < 1000 ? now - (gint64)age * 1000 : now;
+    if (!hud->input_us || t < hud->input_us) hud->input_us = t;
+}
+
+static void finish_frame(PerfHud *hud, PendingFrame *f, gint64 present, gint64 interval) {
+    if (f->input_us) {
+        series_add(&hud->latency, MAX(0, present - f->input_us) / 1000.0);
+        // Input that was waiting over several refreshes without a new frame
+        // reaching the screen means those refreshes were missed.
+        if (interval <= 0) interval = G_USEC_PER_SEC / 60;
+        gint64 waited = present - MAX(f->input_us, hud->last_present_us);
+        gint64 missed = waited / interval - 1;
+        if (missed > 0) hud->dropped += (guint64)missed;
+    }
+    hud->last_present_us = MAX(hud->last_present_us, present);
+}
+
+static void resolve_frames(PerfHud *hud) {
+    gint64 now = g_get_monotonic_time();
+    while (!g_queue_is_empty(&hud->pending)) {
+        PendingFrame *f = g_queue_peek_head(&hud->pending);
+        GdkFrameTimings *t = gdk_frame_clock_get_timings(hud->clock, f->frame_counter);
+        gint64 present = 0, interval = 0;
+        if (t && gdk_frame_timings_get_complete(t)) {
+            present = gdk_frame_timings_get_presentation_time(t);
+            interval = gdk_frame_timings_get_refresh_interval(t);
+        } else if (t && now - f->painted_us < G_USEC_PER_SEC) {
+            break; // the compositor has not reported it yet
+        }
+        // Backends without presentation times: count to the end of the draw
+        if (present <= 0) present = f->painted_us;
+        finish_frame(hud, f, present, interval);
+        g_free(g_queue_pop_head(&hud->pending));
+    }
+}
+
+static void on_after_paint(GdkFrameClock *clock, gpointer user_data) {
+    (void)clock;
+    resolve_frames((PerfHud*)user_data);
+}
+
+void perf_hud_frame(PerfHud *hud, GtkWidget *widget, gint64 draw_start) {
+    if (!hud || !hud->visible) return;
+    gint64 now = g_get_monotonic_time();
+    series_add(&hud->draw, (now - draw_start) / 1000.0);
+    hud->frames++;
+
+    GdkFrameClock *clock = gtk_widget_get_frame_clock(widget);
+    if (clock != hud->clock) {
+        detach_clock(hud);
+        if (clock) {
+            hud->clock = g_object_ref(clock);
+            hud->after_paint_id = g_signal_connect(clock, "after-paint", G_CALLBACK(on_after_paint), hud);
+        }
+    }
+    PendingFrame *f = g_new0(PendingFrame, 1);
+    f->frame_counter = clock ? gdk_frame_clock_get_frame_counter(clock) : 0;
+    f->input_us = hud->input_us;
+    f->painted_us = now;
+    hud->input_us = 0;
+    if (clock) {
+        g_queue_push_tail(&hud->pending, f);
+    } else {
+        finish_frame(hud, f, now, 0);
+        g_free(f);
+    }
+}
+
+static void page_counts(Page *page, int *items, int *strokes, int *points) {
+    *items = *strokes = *points = 0;
+    if (!page) return;
+    *items = (int)g_list_length(page->items);
+    for (GList *l = page->strokes; l; l = l->next) {
+        (*strokes)++;
+        *points += (int)((Stroke*)l->data)->points->len;
+    }
+}
+
+static void format_series(char *buf, gsize size, const char *label, const Series *s) {
+    double sorted[PERF_HUD_WINDOW];
+    guint n = series_sorted(s, sorted);
+    if (n == 0) {
+        g_snprintf(buf, size, "%-8s no samples yet", label);
+        return;
+    }
+    g_snprintf(buf, size, "%-8s p50 %6.1f  p95 %6.1f  p99 %6.1f  max %6.1f ms", label, percentile(sorted, n, 50),
+               percentile(sorted, n, 95), percentile(sorted, n, 99), sorted[n - 1]);
+}
+
+void perf_hud_draw(PerfHud *hud, cairo_t *cr, Page *page) {
+    if (!hud || !hud->visible) return;
+    char lines[5][128];
+    format_series(lines[0], sizeof(lines[0]), "draw", &hud->draw);
+    format_series(lines[1], sizeof(lines[1]), "latency", &hud->latency);
+    g_snprintf(lines[2], sizeof(lines[2]), "%-8s %" G_GUINT64_FORMAT " drawn, %" G_GUINT64_FORMAT " dropped",
+               "frames", hud->frames, hud->dropped);
+    int items, strokes, points;
+    page_counts(page, &items, &strokes, &points);
+    g_snprintf(lines[3], sizeof(lines[3]), "%-8s %d items, %d strokes, %d points", "page", items, strokes, points);
+    g_snprintf(lines[4], sizeof(lines[4]), "F12 hides, Shift+F12 saves the statistics");
+
+    cairo_save(cr);
+    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 12);
+    double width = 0, line_h = 16, pad = 8;
+    for (guint i = 0; i < G_N_ELEMENTS(lines); i++) {
+        cairo_text_extents_t ext;
+        cairo_text_extents(cr, lines[i], &ext);
+        width = MAX(width, ext.x_advance);
+    }
+    cairo_rectangle(cr, pad, pad, width + 2 * pad, G_N_ELEMENTS(lines) * line_h + pad);
+    cairo_set_source_rgba(cr, 0, 0, 0, 0.75);
+    cairo_fill(cr);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    for (guint i = 0; i < G_N_ELEMENTS(lines); i++) {
+        cairo_move_to(cr, 2 * pad, pad + (i + 1) * line_h);
+        cairo_show_text(cr, lines[i]);
+    }
+    cairo_restore(cr);
+}
+
+static void add_series_json(JsonBuilder *b, const char *name, const Series *s) {
+    double sorted[PERF_HUD_WINDOW];
+    guint n = series_sorted(s, sorted);
+    double sum = 0;
+    guint64 buckets[N_BUCKETS] = { 0 };
+    for (guint i = 0; i < n; i++) {
+        guint k = 0;
+        while (k < G_N_ELEMENTS(bucket_bounds) && sorted[i] > bucket_bounds[k]) k++;
+        buckets[k]++;
+        sum += sorted[i];
+    }
+    json_builder_set_member_name(b, name);
+    json_builder_begin_object(b);
+    json_builder_set_member_name(b, "samples");
+    json_builder_add_int_value(b, n);
+    json_builder_set_member_name(b, "total_samples");
+    json_builder_add_int_value(b, (gint64)s->total);
+    if (n > 0) {
+        const double ps[] = { 50, 90, 95, 99 };
+        const char *names[] = { "p50", "p90", "p95", "p99" };
+        json_builder_set_member_name(b, "min");
+        json_builder_add_double_value(b, sorted[0]);
+        json_builder_set_member_name(b, "mean");
+        json_builder_add_double_value(b, sum / n);
+        for (guint i = 0; i < G_N_ELEMENTS(ps); i++) {
+            json_builder_set_member_name(b, names[i]);
+            json_builder_add_double_value(b, percentile(sorted, n, ps[i]));
+        }
+        json_builder_set_member_name(b, "max");
+        json_builder_add_double_value(b, sorted[n - 1]);
+    }
+    // Bucket k counts samples above bound k-1 and up to bound k (ms)
+    json_builder_set_member_name(b, "histogram");
+    json_builder_begin_array(b);
+    for (guint k = 0; k < N_BUCKETS; k++) {
+        json_builder_begin_object(b);
+        json_builder_set_member_name(b, "le");
+        if (k < G_N_ELEMENTS(bucket_bounds)) json_builder_add_double_value(b, bucket_bounds[k]);
+        else json_builder_add_string_value(b, "+Inf");
+        json_builder_set_member_name(b, "count");
+        json_builder_add_int_value(b, (gint64)buckets[k]);
+        json_builder_end_object(b);
+    }
+    json_builder_end_array(b);
+    json_builder_end_object(b);
+}
+
+gboolean perf_hud_write(PerfHud *hud, const char *path, GError **error) {
+    g_return_val_if_fail(hud != NULL && path != NULL, FALSE);
+    JsonBuilder *b = json_builder_new();
+    json_builder_begin_object(b);
+    json_builder_set_member_name(b, "window");
+    json_builder_add_int_value(b, PERF_HUD_WINDOW);
+    json_builder_set_member_name(b, "frames");
+    json_builder_add_int_value(b, (gint64)hud->frames);
+    json_builder_set_member_name(b, "dropped_frames");
+    json_builder_add_int_value(b, (gint64)hud->dropped);
+    add_series_json(b, "draw_ms", &hud->draw);
+    add_series_json(b, "input_latency_ms", &hud->latency);
+    json_builder_end_object(b);
+
+    JsonGenerator *gen = json_generator_new();
+    JsonNode *root = json_builder_get_root(b);
+    json_generator_set_root(gen, root);
+    json_generator_set_pretty(gen, TRUE);
+    gboolean ok = json_generator_to_file(gen, path, error);
+    json_node_free(root);
+    g_object_unref(gen);
+    g_object_unref(b);
+    return ok;
+}
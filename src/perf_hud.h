@@ -0,0 +1,36 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "document.h"
+
+G_BEGIN_DECLS
+
+// Frame-time and input-latency statistics for the canvas, drawn as an overlay
+// and written out as JSON. Samples are only taken while the overlay is shown
+// and percentiles cover the last PERF_HUD_WINDOW samples of each series.
+// Only used from the main thread.
+typedef struct _PerfHud PerfHud;
+
+#define PERF_HUD_WINDOW 1024
+
+PerfHud *perf_hud_new(void);
+void perf_hud_free(PerfHud *hud);
+
+void perf_hud_set_visible(PerfHud *hud, gboolean visible);
+gboolean perf_hud_get_visible(PerfHud *hud);
+// Forget all samples and counters.
+void perf_hud_reset(PerfHud *hud);
+
+// Hooks for the widget. perf_hud_input() is for input that changed the
+// picture (event_time from the GdkEvent); its latency runs until the next
+// frame is presented. perf_hud_frame() is called at the end of each draw
+// with the draw start time from g_get_monotonic_time().
+void perf_hud_input(PerfHud *hud, guint32 event_time);
+void perf_hud_frame(PerfHud *hud, GtkWidget *widget, gint64 draw_start);
+
+// Draws the overlay in widget coordinates; page may be NULL.
+void perf_hud_draw(PerfHud *hud, cairo_t *cr, Page *page);
+
+// Writes percentiles and histograms of every series to path as JSON.
+gboolean perf_hud_write(PerfHud *hud, const char *path, GError **error);
+
+G_END_DECLS
@@ -0,0 +1,334 @@
+#include "pixconv.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXCONV_X86 1
+#include <immintrin.h>
+#endif
+
+// Same rounding as GDK: t = c * a + 0x80; c' = ((t >> 8) + t) >> 8. An alpha
+// of zero gives an all-zero pixel, which this formula produces on its own.
+
+typedef void (*RowFunc)(const guint8 *src, guint32 *dst, int width);
+typedef void (*AnalyzeFunc)(const guint8 *src, int width, gboolean *opaque, gboolean *gray);
+
+static void rgba_row_scalar(const guint8 *src, guint32 *dst, int width) {
+    for (int x = 0; x < width; x++, src += 4) {
+        guint a = src[3];
+        guint t;
+        t = src[0] * a + 0x80; guint r = ((t >> 8) + t) >> 8;
+        t = src[1] * a + 0x80; guint g = ((t >> 8) + t) >> 8;
+        t = src[2] * a + 0x80; guint b = ((t >> 8) + t) >> 8;
+        dst[x] = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+}
+
+static void rgb_row_scalar(const guint8 *src, guint32 *dst, int width) {
+    for (int x = 0; x < width; x++, src += 3) {
+        dst[x] = 0xff000000u | ((guint32)src[0] << 16) | ((guint32)src[1] << 8) | src[2];
+    }
+}
+
+// Analysis: clears *opaque once an alpha byte below 255 is seen and *gray once
+// a pixel has R, G and B differing. Rows stop early once both are cleared.
+
+static void analyze_rgba_scalar(const guint8 *src, int width, gboolean *opaque, gboolean *gray) {
+    for (int x = 0; x < width && (*opaque || *gray); x++, src += 4) {
+        if (src[3] != 255) *opaque = FALSE;
+        if (src[0] != src[1] || src[1] != src[2]) *gray = FALSE;
+    }
+}
+
+static void analyze_rgb_scalar(const guint8 *src, int width, gboolean *opaque, gboolean *gray) {
+    (void)opaque;
+    for (int x = 0; x < width && *gray; x++, src += 3) {
+        if (src[0] != src[1] || src[1] != src[2]) *gray = FALSE;
+    }
+}
+
+#ifdef PIXCONV_X86
+
+// Pixels are widened to 16-bit lanes, where the products (at most
+// 255 * 255 + 0x80) and the rounding step fit without overflow. The alpha
+// lane is multiplied by 255, which leaves it unchanged. Little-endian x86
+// stores ARGB32 words as B, G, R, A bytes, so R and B trade places.
+
+__attribute__((target("sse2")))
+static inline __m128i premul_sse2(__m128i px16, __m128i alpha_lane_255, __m128i rgb_mask) {
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_or_si128(_mm_and_si128(a, rgb_mask), alpha_lane_255);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(px16, a), _mm_set1_epi16(0x80));
+    __m128i d = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(t, 8), t), 8);
+    // R, G, B, A -> B, G, R, A
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(d, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+__attribute__((target("sse2")))
+static void rgba_row_sse2(const guint8 *src, guint32 *dst, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_lane_255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        __m128i lo = premul_sse2(_mm_unpacklo_epi8(v, zero), alpha_lane_255, rgb_mask);
+        __m128i hi = premul_sse2(_mm_unpackhi_epi8(v, zero), alpha_lane_255, rgb_mask);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    rgba_row_scalar(src + x * 4, dst + x, width - x);
+}
+
+__attribute__((target("avx2")))
+static void rgba_row_avx2(const guint8 *src, guint32 *dst, int width) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_lane_255 = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+    const __m256i rgb_mask = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+    const __m256i round = _mm256_set1_epi16(0x80);
+    // R, G, B, A -> B, G, R, A within each pixel
+    const __m256i swap_rb = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                             2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + x * 4)), swap_rb);
+        // unpack and pack both work per 128-bit lane, so pixel order survives
+        __m256i halves[2] = { _mm256_unpacklo_epi8(v, zero), _mm256_unpackhi_epi8(v, zero) };
+        for (int i = 0; i < 2; i++) {
+            __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(halves[i], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm256_or_si256(_mm256_and_si256(a, rgb_mask), alpha_lane_255);
+            __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(halves[i], a), round);
+            halves[i] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_srli_epi16(t, 8), t), 8);
+        }
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_packus_epi16(halves[0], halves[1]));
+    }
+    rgba_row_scalar(src + x * 4, dst + x, width - x);
+}
+
+// Without a byte shuffle, spreading 3-byte pixels over 4-byte words does not
+// beat the scalar loop on SSE2, so RGB input only has an AVX2 kernel.
+__attribute__((target("avx2")))
+static void rgb_row_avx2(const guint8 *src, guint32 *dst, int width) {
+    // Four 3-byte pixels per 128-bit lane, each to B, G, R, 0
+    const __m256i spread = _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+                                            2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m256i opaque = _mm256_set1_epi32((int)0xff000000u);
+    int x = 0;
+    // The second load reads 16 bytes starting at pixel 4, i.e. 4 bytes past
+    // pixel 7, so stop while that still lies inside the row
+    for (; x + 10 <= width; x += 8) {
+        const guint8 *p = src + x * 3;
+        __m128i lo = _mm_loadu_si128((const __m128i*)p);
+        __m128i hi = _mm_loadu_si128((const __m128i*)(p + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, spread), opaque);
+        _mm256_storeu_si256((__m256i*)(dst + x), v);
+    }
+    rgb_row_scalar(src + x * 3, dst + x, width - x);
+}
+
+// Alpha: OR-ing every byte but alpha with 0xff leaves all ones only when
+// alpha is 255. Gray: shifting each 32-bit pixel right by 8 lines G up with R
+// and B with G, so bytes 0 and 1 of each pixel compare equal only for gray.
+__attribute__((target("sse2")))
+static void analyze_rgba_sse2(const guint8 *src, int width, gboolean *opaque, gboolean *gray) {
+    const __m128i not_alpha = _mm_set1_epi32(0x00ffffff);
+    const __m128i ones = _mm_set1_epi32(-1);
+    int x = 0;
+    for (; x + 4 <= width && (*opaque || *gray); x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(v, not_alpha), ones)) != 0xffff) *opaque = FALSE;
+        if ((_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_srli_epi32(v, 8))) & 0x3333) != 0x3333) *gray = FALSE;
+    }
+    analyze_rgba_scalar(src + x * 4, width - x, opaque, gray);
+}
+
+__attribute__((target("avx2")))
+static void analyze_rgba_avx2(const guint8 *src, int width, gboolean *opaque, gboolean *gray) {
+    const __m256i not_alpha = _mm256_set1_epi32(0x00ffffff);
+    const __m256i ones = _mm256_set1_epi32(-1);
+    int x = 0;
+    for (; x + 8 <= width && (*opaque || *gray); x += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+        if ((guint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_or_si256(v, not_alpha), ones)) != 0xffffffffu) *opaque = FALSE;
+        if (((guint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_srli_epi32(v, 8))) & 0x33333333u) != 0x33333333u) *gray = FALSE;
+    }
+    analyze_rgba_scalar(src + x * 4, width - x, opaque, gray);
+}
+
+// Packed RGB: comparing the row with itself one byte on checks R == G and
+// G == B at byte offsets 0 and 1 of every 3-byte pixel. Each step covers
+// whole pixels (5 or 10) and reads one byte past them, so the loop stops
+// while that byte is still inside the row.
+#define GRAY_MASK_5PX 0x36dbu          // bits 0,1,3,4,...,12,13
+#define GRAY_MASK_10PX 0x1b6db6dbu     // same pattern over 30 bytes
+
+__attribute__((target("sse2")))
+static void analyze_rgb_sse2(const guint8 *src, int width, gboolean *opaque, gboolean *gray) {
+    int x = 0;
+    for (; x + 6 <= width && *gray; x += 5) {
+        const guint8 *p = src + x * 3;
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + 1));
+        if (((guint)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & GRAY_MASK_5PX) != GRAY_MASK_5PX) *gray = FALSE;
+    }
+    analyze_rgb_scalar(src + x * 3, width - x, opaque, gray);
+}
+
+__attribute__((target("avx2")))
+static void analyze_rgb_avx2(const guint8 *src, int width, gboolean *opaque, gboolean *gray) {
+    int x = 0;
+    for (; x + 11 <= width && *gray; x += 10) {
+        const guint8 *p = src + x * 3;
+        __m256i a = _mm256_loadu_si256((const __m256i*)p);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + 1));
+        if (((guint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)) & GRAY_MASK_10PX) != GRAY_MASK_10PX) *gray = FALSE;
+    }
+    analyze_rgb_scalar(src + x * 3, width - x, opaque, gray);
+}
+
+#endif
+
+typedef struct {
+    const char *name;
+    RowFunc rgba;
+    RowFunc rgb;
+    AnalyzeFunc analyze_rgba;
+    AnalyzeFunc analyze_rgb;
+} Kernels;
+
+static const Kernels scalar_kernels = { "scalar", rgba_row_scalar, rgb_row_scalar, analyze_rgba_scalar, analyze_rgb_scalar };
+#ifdef PIXCONV_X86
+static const Kernels sse2_kernels = { "sse2", rgba_row_sse2, rgb_row_scalar, analyze_rgba_sse2, analyze_rgb_sse2 };
+static const Kernels avx2_kernels = { "avx2", rgba_row_avx2, rgb_row_avx2, analyze_rgba_avx2, analyze_rgb_avx2 };
+#endif
+
+static const Kernels *active = NULL;
+
+static gboolean cpu_has(const char *name) {
+#ifdef PIXCONV_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+static const Kernels *kernels(void) {
+    if (g_once_init_enter(&active)) {
+        const Kernels *k = &scalar_kernels;
+#ifdef PIXCONV_X86
+        if (cpu_has("avx2")) k = &avx2_kernels;
+        else if (cpu_has("sse2")) k = &sse2_kernels;
+#endif
+        g_once_init_leave(&active, k);
+    }
+    return active;
+}
+
+const char *pixconv_get_impl(void) {
+    return kernels()->name;
+}
+
+gboolean pixconv_set_impl(const char *name) {
+    g_return_val_if_fail(name != NULL, FALSE);
+    kernels();
+    if (!cpu_has(name)) return FALSE;
+    if (strcmp(name, "scalar") == 0) active = &scalar_kernels;
+#ifdef PIXCONV_X86
+    else if (strcmp(name, "sse2") == 0) active = &sse2_kernels;
+    else if (strcmp(name, "avx2") == 0) active = &avx2_kernels;
+#endif
+    else return FALSE;
+    return TRUE;
+}
+
+static void convert_rows(RowFunc row, const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        row(src + (gsize)y * src_stride, (guint32*)(dst + (gsize)y * dst_stride), width);
+    }
+}
+
+void pixconv_rgba_to_argb32(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height) {
+    g_return_if_fail(src != NULL && dst != NULL);
+    convert_rows(kernels()->rgba, src, src_stride, dst, dst_stride, width, height);
+}
+
+void pixconv_rgb_to_rgb24(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height) {
+    g_return_if_fail(src != NULL && dst != NULL);
+    convert_rows(kernels()->rgb, src, src_stride, dst, dst_stride, width, height);
+}
+
+cairo_surface_t *pixconv_surface_from_pixbuf(GdkPixbuf *pixbuf, int x, int y, int width, int height) {
+    g_return_val_if_fail(GDK_IS_PIXBUF(pixbuf), NULL);
+    int pw = gdk_pixbuf_get_width(pixbuf), ph = gdk_pixbuf_get_height(pixbuf);
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > pw || y + height > ph) return NULL;
+    int channels = gdk_pixbuf_get_n_channels(pixbuf);
+    if (gdk_pixbuf_get_bits_per_sample(pixbuf) != 8 || (channels != 3 && channels != 4)) return NULL;
+
+    cairo_format_t format = channels == 4 ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24;
+    cairo_surface_t *surface = cairo_image_surface_create(format, width, height);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+    int src_stride = gdk_pixbuf_get_rowstride(pixbuf);
+    const guint8 *src = gdk_pixbuf_read_pixels(pixbuf) + (gsize)y * src_stride + (gsize)x * channels;
+    cairo_surface_flush(surface);
+    guint8 *dst = cairo_image_surface_get_data(surface);
+    int dst_stride = cairo_image_surface_get_stride(surface);
+    if (channels == 4) pixconv_rgba_to_argb32(src, src_stride, dst, dst_stride, width, height);
+    else pixconv_rgb_to_rgb24(src, src_stride, dst, dst_stride, width, height);
+    cairo_surface_mark_dirty(surface);
+    return surface;
+}
+
+void pixconv_analyze(const guint8 *src, int stride, int width, int height, int channels, gboolean *opaque, gboolean *gray) {
+    g_return_if_fail(src != NULL && opaque != NULL && gray != NULL && (channels == 3 || channels == 4));
+    const Kernels *k = kernels();
+    AnalyzeFunc row = channels == 4 ? k->analyze_rgba : k->analyze_rgb;
+    *opaque = TRUE;
+    *gray = TRUE;
+    for (int y = 0; y < height && (*opaque || *gray); y++) row(src + (gsize)y * stride, width, opaque, gray);
+}
+
+// The compaction and expansion loops are simple enough for the compiler to
+// vectorize on its own.
+
+void pixconv_rgba_to_rgb(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height) {
+    g_return_if_fail(src != NULL && dst != NULL);
+    for (int y = 0; y < height; y++) {
+        const guint8 *s = src + (gsize)y * src_stride;
+        guint8 *d = dst + (gsize)y * dst_stride;
+        for (int x = 0; x < width; x++) {
+            d[x * 3 + 0] = s[x * 4 + 0];
+            d[x * 3 + 1] = s[x * 4 + 1];
+            d[x * 3 + 2] = s[x * 4 + 2];
+        }
+    }
+}
+
+void pixconv_to_gray(const guint8 *src, int src_stride, int channels, guint8 *dst, int dst_stride, int width, int height) {
+    g_return_if_fail(src != NULL && dst != NULL);
+    for (int y = 0; y < height; y++) {
+        const guint8 *s = src + (gsize)y * src_stride;
+        guint8 *d = dst + (gsize)y * dst_stride;
+        for (int x = 0; x < width; x++) d[x] = s[x * channels];
+    }
+}
+
+void pixconv_gray_to_rgb(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height) {
+    g_return_if_fail(src != NULL && dst != NULL);
+    for (int y = 0; y < height; y++) {
+        const guint8 *s = src + (gsize)y * src_stride;
+        guint8 *d = dst + (gsize)y * dst_stride;
+        for (int x = 0; x < width; x++) d[x * 3 + 0] = d[x * 3 + 1] = d[x * 3 + 2] = s[x];
+    }
+}
+
+void pixconv_gray_to_rgb24(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height) {
+    g_return_if_fail(src != NULL && dst != NULL);
+    for (int y = 0; y < height; y++) {
+        const guint8 *s = src + (gsize)y * src_stride;
+        guint32 *d = (guint32*)(dst + (gsize)y * dst_stride);
+        for (int x = 0; x < width; x++) d[x] = 0xff000000u | (guint32)s[x] * 0x010101u;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+// Conversion from GdkPixbuf pixel layout (R, G, B[, A] bytes, straight alpha)
+// to cairo's native-endian words: premultiplied ARGB32 for RGBA input, RGB24
+// for RGB input. Results are bit-exact with gdk_cairo_surface_create_from_pixbuf().
+// SSE2 and AVX2 kernels are picked at runtime when the CPU supports them.
+
+void pixconv_rgba_to_argb32(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height);
+void pixconv_rgb_to_rgb24(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height);
+
+// New image surface holding the given sub-rectangle of pixbuf, or NULL if the
+// rectangle is empty or the surface cannot be allocated.
+cairo_surface_t *pixconv_surface_from_pixbuf(GdkPixbuf *pixbuf, int x, int y, int width, int height);
+
+// Sets *opaque if every alpha byte is 255 (always for 3 channels) and *gray
+// if every pixel has R == G == B. Stops scanning once both are known false.
+void pixconv_analyze(const guint8 *src, int stride, int width, int height, int channels, gboolean *opaque, gboolean *gray);
+
+// Compact storage: RGBA to packed RGB (alpha dropped), RGB or RGBA to one
+// luminance byte taken from R (for images that are gray), and back.
+void pixconv_rgba_to_rgb(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height);
+void pixconv_to_gray(const guint8 *src, int src_stride, int channels, guint8 *dst, int dst_stride, int width, int height);
+void pixconv_gray_to_rgb(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height);
+void pixconv_gray_to_rgb24(const guint8 *src, int src_stride, guint8 *dst, int dst_stride, int width, int height);
+
+// Name of the kernel set in use: "avx2", "sse2" or "scalar".
+const char *pixconv_get_impl(void);
+// Force a kernel set, e.g. for benchmarks. Returns FALSE if the CPU lacks it.
+gboolean pixconv_set_impl(const char *name);
+
+G_END_DECLS
@@ -0,0 +1,178 @@
+#include "png_export.h"
+#include "render.h"
+#include "trace.h"
+#include <glib/gstdio.h>
+#include <string.h>
+
+typedef struct PngBatch PngBatch;
+
+typedef struct {
+    PngBatch *batch;
+    Page *page;                 // borrowed; the document is not edited during export
+    gchar *path;
+    cairo_status_t status;
+    gboolean done;
+} PngJob;
+
+struct PngBatch {
+    GMutex lock;
+    GCond cond;                 // signalled when a job is done
+    double zoom;
+};
+
+gchar *png_export_page_path(const char *base, int index, int count) {
+    g_return_val_if_fail(base != NULL, NULL);
+    int digits = 2;
+    for (int n = count; n >= 100; n /= 10) digits++;
+    const char *dot = strrchr(base, '.');
+    const char *slash = strrchr(base, G_DIR_SEPARATOR);
+    if (!dot || (slash && dot < slash)) dot = base + strlen(base);
+    return g_strdup_printf("%.*s-%0*d%s", (int)(dot - base), base, digits, index + 1, *dot ? dot : ".png");
+}
+
+static void png_job_free(gpointer data) {
+    PngJob *job = (PngJob*)data;
+    g_free(job->path);
+    g_free(job);
+}
+
+static void png_job_run(gpointer data) {
+    TRACE_SCOPE("png.page");
+    PngJob *job = (PngJob*)data;
+    cairo_status_t status = CAIRO_STATUS_NO_MEMORY;
+    cairo_surface_t *surface = render_page_to_surface(job->page, job->batch->zoom, 1);
+    if (surface) {
+        status = cairo_surface_write_to_png(surface, job->path);
+        cairo_surface_destroy(surface);
+    }
+    g_mutex_lock(&job->batch->lock);
+    job->status = status;
+    job->done = TRUE;
+    g_cond_broadcast(&job->batch->cond);
+    g_mutex_unlock(&job->batch->lock);
+}
+
+gboolean export_document_to_png(Document *doc, const char *base, double dpi, GCancellable *cancellable,
+                                PngExportProgressFunc progress, gpointer progress_data, GError **error) {
+    g_return_val_if_fail(doc != NULL && base != NULL, FALSE);
+    TRACE_SCOPE("png.export");
+    if (dpi <= 0) dpi = PNG_EXPORT_DEFAULT_DPI;
+
+    PngBatch batch;
+    g_mutex_init(&batch.lock);
+    g_cond_init(&batch.cond);
+    batch.zoom = dpi / 72.0;
+    int count = (int)doc->pages->len;
+    GPtrArray *jobs = g_ptr_array_new_with_free_func(png_job_free);
+    for (int i = 0; i < count; i++) {
+        PngJob *job = g_new0(PngJob, 1);
+        job->batch = &batch;
+        job->page = (Page*)g_ptr_array_index(doc->pages, i);
+        job->path = png_export_page_path(base, i, count);
+        g_ptr_array_add(jobs, job);
+    }
+
+    // Each page in flight holds a full bitmap, so keep about one per core
+    const guint max_in_flight = MAX(1u, g_get_num_processors());
+    guint submitted = 0;
+    gboolean ok = TRUE;
+    for (guint next = 0; next < jobs->len; next++) {
+        if (ok && g_cancellable_set_error_if_cancelled(cancellable, error)) ok = FALSE;
+        while (ok && submitted < jobs->len && submitted < next + max_in_flight) {
+            render_run_async(png_job_run, g_ptr_array_index(jobs, submitted++));
+        }
+        if (next >= submitted) break;
+        PngJob *job = (PngJob*)g_ptr_array_index(jobs, next);
+        g_mutex_lock(&batch.lock);
+        while (!job->done) g_cond_wait(&batch.cond, &batch.lock);
+        g_mutex_unlock(&batch.lock);
+        if (ok && job->status != CAIRO_STATUS_SUCCESS) {
+            g_set_error(error, g_quark_from_static_string("png-export"), job->status, "Cannot write %s: %s",
+                        job->path, cairo_status_to_string(job->status));
+            ok = FALSE;
+        }
+        if (ok && progress) progress((int)next + 1, count, progress_data);
+    }
+    // Every page started has finished by now; don't leave a partial set behind
+    if (!ok) {
+        for (guint i = 0; i < submitted; i++) g_unlink(((PngJob*)g_ptr_array_index(jobs, i))->path);
+    }
+    g_ptr_array_unref(jobs);
+    g_cond_clear(&batch.cond);
+    g_mutex_clear(&batch.lock);
+    return ok;
+}
+
+typedef struct {
+    Document *snapshot;
+    gchar *base;
+    double dpi;
+    PngExportProgressFunc progress;
+    gpointer progress_data;
+    GMainContext *context;      // where progress is reported
+} AsyncPngExport;
+
+typedef struct {
+    PngExportProgressFunc progress;
+    gpointer progress_data;
+    int done, total;
+} PngProgressUpdate;
+
+static void async_png_export_free(gpointer data) {
+    AsyncPngExport *ae = (AsyncPngExport*)data;
+    document_free(ae->snapshot);
+    g_free(ae->base);
+    g_main_context_unref(ae->context);
+    g_free(ae);
+}
+
+static gboolean deliver_progress(gpointer data) {
+    PngProgressUpdate *u = (PngProgressUpdate*)data;
+    u->progress(u->done, u->total, u->progress_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void relay_progress(int done, int total, gpointer data) {
+    AsyncPngExport *ae = (AsyncPngExport*)data;
+    PngProgressUpdate *u = g_new0(PngProgressUpdate, 1);
+    u->progress = ae->progress;
+    u->progress_data = ae->progress_data;
+    u->done = done;
+    u->total = total;
+    g_main_context_invoke_full(ae->context, G_PRIORITY_DEFAULT, deliver_progress, u, g_free);
+}
+
+static void png_export_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    (void)source_object;
+    AsyncPngExport *ae = (AsyncPngExport*)task_data;
+    GError *error = NULL;
+    if (export_document_to_png(ae->snapshot, ae->base, ae->dpi, cancellable, ae->progress ? relay_progress : NULL, ae,
+                               &error)) {
+        g_task_return_boolean(task, TRUE);
+    } else {
+        g_task_return_error(task, error);
+    }
+}
+
+void export_document_to_png_async(Document *doc, const char *base, double dpi, GCancellable *cancellable,
+                                  PngExportProgressFunc progress, gpointer progress_data,
+                                  GAsyncReadyCallback callback, gpointer user_data) {
+    g_return_if_fail(doc != NULL && base != NULL);
+    AsyncPngExport *ae = g_new0(AsyncPngExport, 1);
+    ae->snapshot = document_snapshot(doc);
+    ae->base = g_strdup(base);
+    ae->dpi = dpi;
+    ae->progress = progress;
+    ae->progress_data = progress_data;
+    ae->context = g_main_context_ref_thread_default();
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_source_tag(task, export_document_to_png_async);
+    g_task_set_task_data(task, ae, async_png_export_free);
+    g_task_run_in_thread(task, png_export_thread);
+    g_object_unref(task);
+}
+
+gboolean export_document_to_png_finish(GAsyncResult *result, GError **error) {
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "document.h"
+
+G_BEGIN_DECLS
+
+#define PNG_EXPORT_DEFAULT_DPI 150.0
+
+// File a page is written to: base "sheet.png" gives "sheet-01.png",
+// "sheet-02.png", ... with as many digits as the page count needs.
+gchar *png_export_page_path(const char *base, int index, int count);
+
+// Called after each page has been written.
+typedef void (*PngExportProgressFunc)(int pages_done, int pages_total, gpointer user_data);
+
+// Render every page at dpi with the canvas drawing code and write one PNG per
+// page. Pages are rendered and encoded on the render worker pool, a few at a
+// time to bound memory. Stops with G_IO_ERROR_CANCELLED if cancellable fires.
+// progress (may be NULL) runs on the exporting thread. On failure the pages
+// written so far are deleted again.
+gboolean export_document_to_png(Document *doc, const char *base, double dpi, GCancellable *cancellable,
+                                PngExportProgressFunc progress, gpointer progress_data, GError **error);
+
+// Exports a snapshot of doc on a worker thread. progress is called in the
+// caller's thread-default main context.
+void export_document_to_png_async(Document *doc, const char *base, double dpi, GCancellable *cancellable,
+                                  PngExportProgressFunc progress, gpointer progress_data,
+                                  GAsyncReadyCallback callback, gpointer user_data);
+gboolean export_document_to_png_finish(GAsyncResult *result, GError **error);
+
+G_END_DECLS
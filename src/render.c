@@ -0,0 +1,156 @@
+#include "render.h"
+#include "trace.h"
+#include <math.h>
+
+typedef struct {
+    RenderFunc fn;
+    gpointer data;
+} RenderTask;
+
+static void render_worker(gpointer task_ptr, gpointer user_data) {
+    (void)user_data;
+    RenderTask *task = (RenderTask*)task_ptr;
+    task->fn(task->data);
+    g_free(task);
+}
+
+void render_run_async(RenderFunc fn, gpointer data) {
+    static GThreadPool *pool = NULL;
+    if (g_once_init_enter(&pool)) {
+        gint threads = (gint)MAX(1u, g_get_num_processors());
+        g_once_init_leave(&pool, g_thread_pool_new(render_worker, NULL, threads, FALSE, NULL));
+    }
+    RenderTask *task = g_new0(RenderTask, 1);
+    task->fn = fn;
+    task->data = data;
+    g_thread_pool_push(pool, task, NULL);
+}
+
+// Crossed-out grey box in place of an image whose data cannot be decoded, so
+// the item stays visible and can be selected and deleted.
+static void render_broken_image(cairo_t *cr, ImageItem *it) {
+    cairo_save(cr);
+    cairo_rectangle(cr, it->x, it->y, it->width, it->height);
+    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+    cairo_fill_preserve(cr);
+    cairo_move_to(cr, it->x, it->y);
+    cairo_line_to(cr, it->x + it->width, it->y + it->height);
+    cairo_move_to(cr, it->x + it->width, it->y);
+    cairo_line_to(cr, it->x, it->y + it->height);
+    cairo_set_source_rgb(cr, 0.6, 0.2, 0.2);
+    cairo_set_line_width(cr, 1.0);
+    cairo_stroke(cr);
+    cairo_restore(cr);
+}
+
+void render_image_item(cairo_t *cr, ImageItem *it, cairo_filter_t filter) {
+    // Decodes and converts the pixels if they are not cached
+    cairo_surface_t *surface = image_source_get_surface(it->source);
+    if (!surface) {
+        if (image_source_decode_failed(it->source)) render_broken_image(cr, it);
+        return;
+    }
+    cairo_surface_t *sub = cairo_surface_create_for_rectangle(surface, it->crop_x, it->crop_y, it->crop_w, it->crop_h);
+    cairo_save(cr);
+    cairo_translate(cr, it->x, it->y);
+    double sx = it->width / (double)it->crop_w;
+    double sy = it->height / (double)it->crop_h;
+    cairo_scale(cr, sx, sy);
+    cairo_set_source_surface(cr, sub, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), filter);
+    cairo_rectangle(cr, 0, 0, it->crop_w, it->crop_h);
+    cairo_fill(cr);
+    cairo_restore(cr);
+    cairo_surface_destroy(sub);
+    cairo_surface_destroy(surface);
+}
+
+void render_stroke(cairo_t *cr, Stroke *stroke) {
+    if (!stroke || !stroke->points || stroke->points->len < 2) return;
+    
+    cairo_save(cr);
+    cairo_set_source_rgba(cr, stroke->r, stroke->g, stroke->b, stroke->a);
+    cairo_set_line_width(cr, stroke->width);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+    
+    Point *p0 = &g_array_index(stroke->points, Point, 0);
+    cairo_move_to(cr, p0->x, p0->y);
+    
+    for (guint i = 1; i < stroke->points->len; i++) {
+        Point *p = &g_array_index(stroke->points, Point, i);
+        cairo_line_to(cr, p->x, p->y);
+    }
+    
+    cairo_stroke(cr);
+    cairo_restore(cr);
+}
+
+void render_page_content(cairo_t *cr, Page *page, cairo_filter_t filter) {
+    for (GList *l = page->items; l; l = l->next) {
+        render_image_item(cr, (ImageItem*)l->data, filter);
+    }
+    for (GList *l = page->strokes; l; l = l->next) {
+        render_stroke(cr, (Stroke*)l->data);
+    }
+}
+
+static void page_surface_size(double zoom, int scale, int *w, int *h) {
+    *w = (int)ceil(A4_WIDTH_PT * zoom * scale);
+    *h = (int)ceil(A4_HEIGHT_PT * zoom * scale);
+}
+
+gsize render_page_surface_bytes(double zoom, int scale) {
+    int w, h;
+    page_surface_size(zoom, scale, &w, &h);
+    return (gsize)w * (gsize)h * 4;
+}
+
+cairo_surface_t *render_page_to_surface(Page *page, double zoom, int scale) {
+    g_return_val_if_fail(page != NULL, NULL);
+    TRACE_SCOPE("render.page");
+    int w, h;
+    page_surface_size(zoom, scale, &w, &h);
+    // Pages are opaque, so skip the alpha channel when compositing
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, w, h);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+    cairo_surface_set_device_scale(surface, scale, scale);
+    cairo_t *cr = cairo_create(surface);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+    cairo_scale(cr, zoom, zoom);
+    render_page_content(cr, page, CAIRO_FILTER_GOOD);
+    cairo_destroy(cr);
+    return surface;
+}
+
+void render_page_tile_grid(double zoom, int scale, int *cols, int *rows) {
+    int w, h;
+    page_surface_size(zoom, scale, &w, &h);
+    *cols = (w + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    *rows = (h + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+}
+
+cairo_surface_t *render_page_tile(Page *page, double zoom, int scale, int tx, int ty) {
+    g_return_val_if_fail(page != NULL, NULL);
+    TRACE_SCOPE("render.tile");
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, RENDER_TILE_SIZE, RENDER_TILE_SIZE);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+    cairo_surface_set_device_scale(surface, scale, scale);
+    cairo_t *cr = cairo_create(surface);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+    // Shift the tile's corner to the origin; cairo skips whatever falls outside
+    double tile = RENDER_TILE_SIZE / (double)scale;
+    cairo_translate(cr, -tx * tile, -ty * tile);
+    cairo_scale(cr, zoom, zoom);
+    render_page_content(cr, page, CAIRO_FILTER_GOOD);
+    cairo_destroy(cr);
+    return surface;
+}
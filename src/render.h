@@ -0,0 +1,35 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "document.h"
+
+G_BEGIN_DECLS
+
+// Drawing of page content shared by the canvas and the offscreen caches. All
+// functions draw in page points; callers set up the transform. filter is the
+// image sampling filter: CAIRO_FILTER_FAST while the view is moving,
+// CAIRO_FILTER_GOOD for final output.
+void render_image_item(cairo_t *cr, ImageItem *it, cairo_filter_t filter);
+void render_stroke(cairo_t *cr, Stroke *stroke);
+// Images first, strokes on top, no background.
+void render_page_content(cairo_t *cr, Page *page, cairo_filter_t filter);
+
+// Render a whole page (white background and content) into a new image surface
+// of size A4 * zoom logical pixels at the given device scale. Safe to call from
+// worker threads on a page that is not being edited (e.g. a snapshot's page).
+cairo_surface_t *render_page_to_surface(Page *page, double zoom, int scale);
+// Device pixels of a page bitmap at this zoom and scale, used for size limits.
+gsize render_page_surface_bytes(double zoom, int scale);
+
+// Edge of a square page tile in device pixels.
+#define RENDER_TILE_SIZE 256
+// Number of tile columns and rows covering a page at this zoom and scale.
+void render_page_tile_grid(double zoom, int scale, int *cols, int *rows);
+// Render tile (tx, ty) of a page into a new RENDER_TILE_SIZE square surface.
+// Same threading rules as render_page_to_surface().
+cairo_surface_t *render_page_tile(Page *page, double zoom, int scale, int tx, int ty);
+
+// Run fn(data) on the shared pool of render worker threads.
+typedef void (*RenderFunc)(gpointer data);
+void render_run_async(RenderFunc fn, gpointer data);
+
+G_END_DECLS
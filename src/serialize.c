@@ -1,4 +1,5 @@
 #include "serialize.h"
+#include "trace.h"
 #include <json-glib/json-glib.h>
 #include <string.h>
 
@@ -11,142 +12,189 @@ gchar *get_autosave_path(void) {
     return path;
 }
 
-// Convert pixbuf to base64 PNG data
-static gchar *pixbuf_to_base64(GdkPixbuf *pixbuf, GError **error) {
-    gchar *buffer = NULL;
-    gsize buffer_size = 0;
-    
-    if (!gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &buffer_size, "png", error, NULL)) {
-        return NULL;
-    }
-    
-    gchar *base64 = g_base64_encode((const guchar*)buffer, buffer_size);
-    g_free(buffer);
+// Convert an image source to base64 of its compressed data (the original file
+// bytes when available, PNG otherwise)
+static gchar *source_to_base64(ImageSource *source, GError **error) {
+    GBytes *bytes = image_source_get_encoded(source, error);
+    if (!bytes) return NULL;
+    gsize size = 0;
+    const guchar *data = g_bytes_get_data(bytes, &size);
+    gchar *base64 = g_base64_encode(data, size);
+    g_bytes_unref(bytes);
     return base64;
 }
 
-// Convert base64 PNG data to pixbuf
-static GdkPixbuf *pixbuf_from_base64(const gchar *base64, GError **error) {
+// Convert base64 image data to an image source; pixels are decoded on first use
+static ImageSource *source_from_base64(const gchar *base64, GError **error) {
+    if (!base64) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Missing image data");
+        return NULL;
+    }
     gsize data_len = 0;
     guchar *data = g_base64_decode(base64, &data_len);
-    
-    GInputStream *stream = g_memory_input_stream_new_from_data(data, data_len, g_free);
-    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream(stream, NULL, error);
-    g_object_unref(stream);
-    
-    return pixbuf;
+    GBytes *bytes = g_bytes_new_take(data, data_len);
+    ImageSource *source = image_source_new_from_bytes(bytes, error);
+    g_bytes_unref(bytes);
+    return source;
 }
 
-gboolean document_save_to_file(Document *doc, const char *filepath, GError **error) {
-    if (!doc || !filepath) {
-        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid parameters");
-        return FALSE;
+// Length of the base64 text of a source's compressed data. Sources that have
+// not been compressed yet (pasted pixels) are guessed at half their RGBA size.
+static gsize base64_size(ImageSource *source) {
+    GBytes *bytes = image_source_peek_encoded(source);
+    gsize size;
+    if (bytes) {
+        size = g_bytes_get_size(bytes);
+        g_bytes_unref(bytes);
+    } else {
+        size = (gsize)image_source_get_width(source) * (gsize)image_source_get_height(source) * 2;
     }
-    
-    JsonBuilder *builder = json_builder_new();
+    return (size + 2) / 3 * 4;
+}
+
+// Adds one page object to builder. With image_bytes set the image data is
+// left out and the length it would have is added to *image_bytes instead.
+static void page_to_json(JsonBuilder *builder, Page *page, gsize *image_bytes) {
     json_builder_begin_object(builder);
     
-    // Save current page index
-    json_builder_set_member_name(builder, "current_page");
-    json_builder_add_int_value(builder, doc->current_page);
-    
-    // Save pages array
-    json_builder_set_member_name(builder, "pages");
+    // Save items array
+    json_builder_set_member_name(builder, "items");
     json_builder_begin_array(builder);
     
-    for (guint i = 0; i < doc->pages->len; i++) {
-        Page *page = (Page*)g_ptr_array_index(doc->pages, i);
+    for (GList *l = page->items; l; l = l->next) {
+        ImageItem *item = (ImageItem*)l->data;
         json_builder_begin_object(builder);
         
-        // Save items array
-        json_builder_set_member_name(builder, "items");
-        json_builder_begin_array(builder);
-        
-        for (GList *l = page->items; l; l = l->next) {
-            ImageItem *item = (ImageItem*)l->data;
-            json_builder_begin_object(builder);
-            
+        ImageSource *original = image_source_get_original(item->source);
+        if (image_bytes) {
+            // Sizing only: leave the image data empty and count its length
+            json_builder_set_member_name(builder, "image_data");
+            json_builder_add_string_value(builder, "");
+            *image_bytes += base64_size(item->source);
+            if (original) {
+                json_builder_set_member_name(builder, "original_data");
+                json_builder_add_string_value(builder, "");
+                *image_bytes += base64_size(original);
+            }
+        } else {
             // Save image data as base64
             GError *img_error = NULL;
-            gchar *img_data = pixbuf_to_base64(item->pixbuf, &img_error);
+            gchar *img_data = source_to_base64(item->source, &img_error);
             if (!img_data) {
                 g_warning("Failed to encode image: %s", img_error ? img_error->message : "unknown");
                 if (img_error) g_error_free(img_error);
+                json_builder_end_object(builder);
                 continue;
             }
-            
+
             json_builder_set_member_name(builder, "image_data");
             json_builder_add_string_value(builder, img_data);
             g_free(img_data);
-            
-            // Save position and size
-            json_builder_set_member_name(builder, "x");
-            json_builder_add_double_value(builder, item->x);
-            json_builder_set_member_name(builder, "y");
-            json_builder_add_double_value(builder, item->y);
-            json_builder_set_member_name(builder, "width");
-            json_builder_add_double_value(builder, item->width);
-            json_builder_set_member_name(builder, "height");
-            json_builder_add_double_value(builder, item->height);
-            
-            // Save crop info
-            json_builder_set_member_name(builder, "crop_x");
-            json_builder_add_int_value(builder, item->crop_x);
-            json_builder_set_member_name(builder, "crop_y");
-            json_builder_add_int_value(builder, item->crop_y);
-            json_builder_set_member_name(builder, "crop_w");
-            json_builder_add_int_value(builder, item->crop_w);
-            json_builder_set_member_name(builder, "crop_h");
-            json_builder_add_int_value(builder, item->crop_h);
-            
-            json_builder_end_object(builder);
+
+            // Full-resolution image the item was downscaled from, if kept
+            if (original) {
+                gchar *orig_data = source_to_base64(original, &img_error);
+                if (orig_data) {
+                    json_builder_set_member_name(builder, "original_data");
+                    json_builder_add_string_value(builder, orig_data);
+                    g_free(orig_data);
+                } else {
+                    g_warning("Failed to encode original image: %s", img_error ? img_error->message : "unknown");
+                    g_clear_error(&img_error);
+                }
+            }
         }
         
-        json_builder_end_array(builder);
+        // Save position and size
+        json_builder_set_member_name(builder, "x");
+        json_builder_add_double_value(builder, item->x);
+        json_builder_set_member_name(builder, "y");
+        json_builder_add_double_value(builder, item->y);
+        json_builder_set_member_name(builder, "width");
+        json_builder_add_double_value(builder, item->width);
+        json_builder_set_member_name(builder, "height");
+        json_builder_add_double_value(builder, item->height);
         
-        // Save strokes array
-        json_builder_set_member_name(builder, "strokes");
-        json_builder_begin_array(builder);
+        // Save crop info
+        json_builder_set_member_name(builder, "crop_x");
+        json_builder_add_int_value(builder, item->crop_x);
+        json_builder_set_member_name(builder, "crop_y");
+        json_builder_add_int_value(builder, item->crop_y);
+        json_builder_set_member_name(builder, "crop_w");
+        json_builder_add_int_value(builder, item->crop_w);
+        json_builder_set_member_name(builder, "crop_h");
+        json_builder_add_int_value(builder, item->crop_h);
+        
+        json_builder_end_object(builder);
+    }
+    
+    json_builder_end_array(builder);
+    
+    // Save strokes array
+    json_builder_set_member_name(builder, "strokes");
+    json_builder_begin_array(builder);
+    
+    for (GList *l = page->strokes; l; l = l->next) {
+        Stroke *stroke = (Stroke*)l->data;
+        json_builder_begin_object(builder);
+        
+        // Save color
+        json_builder_set_member_name(builder, "r");
+        json_builder_add_double_value(builder, stroke->r);
+        json_builder_set_member_name(builder, "g");
+        json_builder_add_double_value(builder, stroke->g);
+        json_builder_set_member_name(builder, "b");
+        json_builder_add_double_value(builder, stroke->b);
+        json_builder_set_member_name(builder, "a");
+        json_builder_add_double_value(builder, stroke->a);
+        json_builder_set_member_name(builder, "width");
+        json_builder_add_double_value(builder, stroke->width);
         
-        for (GList *l = page->strokes; l; l = l->next) {
-            Stroke *stroke = (Stroke*)l->data;
+        // Save points
+        json_builder_set_member_name(builder, "points");
+        json_builder_begin_array(builder);
+        for (guint j = 0; j < stroke->points->len; j++) {
+            Point *pt = &g_array_index(stroke->points, Point, j);
             json_builder_begin_object(builder);
-            
-            // Save color
-            json_builder_set_member_name(builder, "r");
-            json_builder_add_double_value(builder, stroke->r);
-            json_builder_set_member_name(builder, "g");
-            json_builder_add_double_value(builder, stroke->g);
-            json_builder_set_member_name(builder, "b");
-            json_builder_add_double_value(builder, stroke->b);
-            json_builder_set_member_name(builder, "a");
-            json_builder_add_double_value(builder, stroke->a);
-            json_builder_set_member_name(builder, "width");
-            json_builder_add_double_value(builder, stroke->width);
-            
-            // Save points
-            json_builder_set_member_name(builder, "points");
-            json_builder_begin_array(builder);
-            for (guint j = 0; j < stroke->points->len; j++) {
-                Point *pt = &g_array_index(stroke->points, Point, j);
-                json_builder_begin_object(builder);
-                json_builder_set_member_name(builder, "x");
-                json_builder_add_double_value(builder, pt->x);
-                json_builder_set_member_name(builder, "y");
-                json_builder_add_double_value(builder, pt->y);
-                json_builder_end_object(builder);
-            }
-            json_builder_end_array(builder);
-            
+            json_builder_set_member_name(builder, "x");
+            json_builder_add_double_value(builder, pt->x);
+            json_builder_set_member_name(builder, "y");
+            json_builder_add_double_value(builder, pt->y);
             json_builder_end_object(builder);
         }
-        
         json_builder_end_array(builder);
+        
         json_builder_end_object(builder);
     }
     
     json_builder_end_array(builder);
     json_builder_end_object(builder);
+}
+
+gboolean document_save_to_file(Document *doc, const char *filepath, GError **error) {
+    TRACE_SCOPE("document.save");
+    if (!doc || !filepath) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid parameters");
+        return FALSE;
+    }
+    
+    JsonBuilder *builder = json_builder_new();
+    json_builder_begin_object(builder);
+    
+    // Save current page index
+    json_builder_set_member_name(builder, "current_page");
+    json_builder_add_int_value(builder, doc->current_page);
+    
+    // Save pages array
+    json_builder_set_member_name(builder, "pages");
+    json_builder_begin_array(builder);
+    
+    for (guint i = 0; i < doc->pages->len; i++) {
+        page_to_json(builder, (Page*)g_ptr_array_index(doc->pages, i), NULL);
+    }
+    
+    json_builder_end_array(builder);
+    json_builder_end_object(builder);
     
     // Write to file
     JsonGenerator *gen = json_generator_new();
@@ -163,7 +211,136 @@ gboolean document_save_to_file(Document *doc, const char *filepath, GError **err
     return success;
 }
 
-Document *document_load_from_file(const char *filepath, GError **error) {
+gsize page_estimate_saved_size(Page *page) {
+    g_return_val_if_fail(page != NULL, 0);
+    // Nest the page as deep as in a document so the indentation matches
+    JsonBuilder *builder = json_builder_new();
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "pages");
+    json_builder_begin_array(builder);
+    gsize image_bytes = 0;
+    page_to_json(builder, page, &image_bytes);
+    json_builder_end_array(builder);
+    json_builder_end_object(builder);
+
+    JsonGenerator *gen = json_generator_new();
+    JsonNode *root = json_builder_get_root(builder);
+    json_generator_set_root(gen, root);
+    json_generator_set_pretty(gen, TRUE);
+    gsize length = 0;
+    g_free(json_generator_to_data(gen, &length));
+    json_node_free(root);
+    g_object_unref(gen);
+    g_object_unref(builder);
+    return length + image_bytes;
+}
+
+// Builds one page from its JSON object. Images are only base64-decoded here;
+// their pixels are decoded on first use.
+static Page *page_from_json(JsonObject *page_obj) {
+    TRACE_SCOPE("document.load_page");
+    Page *page = page_new();
+    
+    // Load items
+    if (json_object_has_member(page_obj, "items")) {
+        JsonArray *items_array = json_object_get_array_member(page_obj, "items");
+        guint num_items = json_array_get_length(items_array);
+        
+        for (guint j = 0; j < num_items; j++) {
+            JsonNode *item_node = json_array_get_element(items_array, j);
+            if (!JSON_NODE_HOLDS_OBJECT(item_node)) continue;
+            
+            JsonObject *item_obj = json_node_get_object(item_node);
+            
+            // Load image
+            const gchar *img_data = json_object_get_string_member(item_obj, "image_data");
+            GError *img_error = NULL;
+            ImageSource *source = source_from_base64(img_data, &img_error);
+            if (!source) {
+                g_warning("Failed to decode image: %s", img_error ? img_error->message : "unknown");
+                if (img_error) g_error_free(img_error);
+                continue;
+            }
+            if (json_object_has_member(item_obj, "original_data")) {
+                const gchar *orig_data = json_object_get_string_member(item_obj, "original_data");
+                ImageSource *original = source_from_base64(orig_data, &img_error);
+                if (original) {
+                    image_source_set_original(source, original);
+                    image_source_unref(original);
+                } else {
+                    g_warning("Failed to decode original image: %s", img_error ? img_error->message : "unknown");
+                    g_clear_error(&img_error);
+                }
+            }
+            
+            // Create item
+            ImageItem *item = g_new0(ImageItem, 1);
+            item->source = source;
+            
+            // Load position and size
+            item->x = json_object_get_double_member(item_obj, "x");
+            item->y = json_object_get_double_member(item_obj, "y");
+            item->width = json_object_get_double_member(item_obj, "width");
+            item->height = json_object_get_double_member(item_obj, "height");
+            
+            // Load crop info
+            item->crop_x = json_object_get_int_member(item_obj, "crop_x");
+            item->crop_y = json_object_get_int_member(item_obj, "crop_y");
+            item->crop_w = json_object_get_int_member(item_obj, "crop_w");
+            item->crop_h = json_object_get_int_member(item_obj, "crop_h");
+            
+            // Add to page
+            page->items = g_list_append(page->items, item);
+        }
+    }
+    
+    // Load strokes
+    if (json_object_has_member(page_obj, "strokes")) {
+        JsonArray *strokes_array = json_object_get_array_member(page_obj, "strokes");
+        guint num_strokes = json_array_get_length(strokes_array);
+        
+        for (guint j = 0; j < num_strokes; j++) {
+            JsonNode *stroke_node = json_array_get_element(strokes_array, j);
+            if (!JSON_NODE_HOLDS_OBJECT(stroke_node)) continue;
+            
+            JsonObject *stroke_obj = json_node_get_object(stroke_node);
+            
+            // Load color and width
+            double r = json_object_get_double_member(stroke_obj, "r");
+            double g = json_object_get_double_member(stroke_obj, "g");
+            double b = json_object_get_double_member(stroke_obj, "b");
+            double a = json_object_get_double_member(stroke_obj, "a");
+            double width = json_object_get_double_member(stroke_obj, "width");
+            
+            Stroke *stroke = stroke_new(r, g, b, a, width);
+            
+            // Load points
+            if (json_object_has_member(stroke_obj, "points")) {
+                JsonArray *points_array = json_object_get_array_member(stroke_obj, "points");
+                guint num_points = json_array_get_length(points_array);
+                
+                for (guint k = 0; k < num_points; k++) {
+                    JsonNode *point_node = json_array_get_element(points_array, k);
+                    if (!JSON_NODE_HOLDS_OBJECT(point_node)) continue;
+                    
+                    JsonObject *point_obj = json_node_get_object(point_node);
+                    double px = json_object_get_double_member(point_obj, "x");
+                    double py = json_object_get_double_member(point_obj, "y");
+                    
+                    stroke_add_point(stroke, px, py);
+                }
+            }
+            
+            // Add to page
+            page->strokes = g_list_append(page->strokes, stroke);
+        }
+    }
+    return page;
+}
+
+// Parses filepath and returns its root object, owned by *parser.
+static JsonObject *parse_document(const char *filepath, JsonParser **parser, GError **error) {
+    TRACE_SCOPE("document.parse");
     if (!filepath) {
         g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid filepath");
         return NULL;
@@ -175,20 +352,54 @@ Document *document_load_from_file(const char *filepath, GError **error) {
         return NULL;
     }
     
-    JsonParser *parser = json_parser_new();
-    if (!json_parser_load_from_file(parser, filepath, error)) {
-        g_object_unref(parser);
+    *parser = json_parser_new();
+    if (!json_parser_load_from_file(*parser, filepath, error)) {
+        g_clear_object(parser);
         return NULL;
     }
     
-    JsonNode *root = json_parser_get_root(parser);
-    if (!JSON_NODE_HOLDS_OBJECT(root)) {
+    JsonNode *root = json_parser_get_root(*parser);
+    if (!root || !JSON_NODE_HOLDS_OBJECT(root)) {
         g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid JSON format");
-        g_object_unref(parser);
+        g_clear_object(parser);
         return NULL;
     }
     
     JsonObject *root_obj = json_node_get_object(root);
+    if (!json_object_has_member(root_obj, "pages")) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Missing pages array");
+        g_clear_object(parser);
+        return NULL;
+    }
+    return root_obj;
+}
+
+// Page objects of the document, skipping malformed entries.
+static GPtrArray *page_objects(JsonObject *root_obj) {
+    JsonArray *pages_array = json_object_get_array_member(root_obj, "pages");
+    guint num_pages = pages_array ? json_array_get_length(pages_array) : 0;
+    GPtrArray *objects = g_ptr_array_sized_new(num_pages);
+    for (guint i = 0; i < num_pages; i++) {
+        JsonNode *page_node = json_array_get_element(pages_array, i);
+        if (JSON_NODE_HOLDS_OBJECT(page_node)) g_ptr_array_add(objects, json_node_get_object(page_node));
+    }
+    return objects;
+}
+
+// Saved current page index clamped to the page count (at least one page).
+static int saved_current_page(JsonObject *root_obj, guint page_count) {
+    int current = 0;
+    if (json_object_has_member(root_obj, "current_page")) {
+        current = (int)json_object_get_int_member(root_obj, "current_page");
+    }
+    return CLAMP(current, 0, (int)MAX(page_count, 1) - 1);
+}
+
+Document *document_load_from_file(const char *filepath, GError **error) {
+    TRACE_SCOPE("document.load");
+    JsonParser *parser = NULL;
+    JsonObject *root_obj = parse_document(filepath, &parser, error);
+    if (!root_obj) return NULL;
     
     // Create new document (starts with 1 empty page)
     Document *doc = document_new();
@@ -196,132 +407,261 @@ Document *document_load_from_file(const char *filepath, GError **error) {
     // Clear the default page - we'll load pages from file
     g_ptr_array_remove_index(doc->pages, 0);
     
-    // Load current page index
-    if (json_object_has_member(root_obj, "current_page")) {
-        doc->current_page = json_object_get_int_member(root_obj, "current_page");
+    GPtrArray *objects = page_objects(root_obj);
+    for (guint i = 0; i < objects->len; i++) {
+        g_ptr_array_add(doc->pages, page_from_json((JsonObject*)g_ptr_array_index(objects, i)));
     }
     
-    // Load pages
-    if (!json_object_has_member(root_obj, "pages")) {
-        document_free(doc);
-        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Missing pages array");
-        g_object_unref(parser);
-        return NULL;
+    // Ensure at least one page exists
+    if (doc->pages->len == 0) {
+        g_ptr_array_add(doc->pages, page_new());
     }
+    doc->current_page = saved_current_page(root_obj, objects->len);
     
-    JsonArray *pages_array = json_object_get_array_member(root_obj, "pages");
-    guint num_pages = json_array_get_length(pages_array);
-    
-    for (guint i = 0; i < num_pages; i++) {
-        JsonNode *page_node = json_array_get_element(pages_array, i);
-        if (!JSON_NODE_HOLDS_OBJECT(page_node)) continue;
-        
-        JsonObject *page_obj = json_node_get_object(page_node);
-        Page *page = g_new0(Page, 1);
-        page->items = NULL;
-        
-        // Load items
-        if (json_object_has_member(page_obj, "items")) {
-            JsonArray *items_array = json_object_get_array_member(page_obj, "items");
-            guint num_items = json_array_get_length(items_array);
-            
-            for (guint j = 0; j < num_items; j++) {
-                JsonNode *item_node = json_array_get_element(items_array, j);
-                if (!JSON_NODE_HOLDS_OBJECT(item_node)) continue;
-                
-                JsonObject *item_obj = json_node_get_object(item_node);
-                
-                // Load image
-                const gchar *img_data = json_object_get_string_member(item_obj, "image_data");
-                GError *img_error = NULL;
-                GdkPixbuf *pixbuf = pixbuf_from_base64(img_data, &img_error);
-                if (!pixbuf) {
-                    g_warning("Failed to decode image: %s", img_error ? img_error->message : "unknown");
-                    if (img_error) g_error_free(img_error);
-                    continue;
-                }
-                
-                // Create item
-                ImageItem *item = g_new0(ImageItem, 1);
-                item->pixbuf = pixbuf;
-                
-                // Load position and size
-                item->x = json_object_get_double_member(item_obj, "x");
-                item->y = json_object_get_double_member(item_obj, "y");
-                item->width = json_object_get_double_member(item_obj, "width");
-                item->height = json_object_get_double_member(item_obj, "height");
-                
-                // Load crop info
-                item->crop_x = json_object_get_int_member(item_obj, "crop_x");
-                item->crop_y = json_object_get_int_member(item_obj, "crop_y");
-                item->crop_w = json_object_get_int_member(item_obj, "crop_w");
-                item->crop_h = json_object_get_int_member(item_obj, "crop_h");
-                
-                // Add to page
-                page->items = g_list_append(page->items, item);
+    g_ptr_array_unref(objects);
+    g_object_unref(parser);
+    return doc;
+}
+
+typedef struct {
+    gchar *filepath;
+    DocumentLoadPageFunc page_func;
+    gpointer page_data;
+    GMainContext *context;
+    GCancellable *cancellable;
+} LoadJob;
+
+typedef struct {
+    DocumentLoadPageFunc page_func;
+    gpointer page_data;
+    GCancellable *cancellable;
+    Page *page;
+    int index, page_count, current_page;
+} LoadedPage;
+
+static void load_job_free(gpointer data) {
+    LoadJob *job = (LoadJob*)data;
+    g_free(job->filepath);
+    g_main_context_unref(job->context);
+    if (job->cancellable) g_object_unref(job->cancellable);
+    g_free(job);
+}
+
+static void loaded_page_free(gpointer data) {
+    LoadedPage *lp = (LoadedPage*)data;
+    page_unref(lp->page);
+    if (lp->cancellable) g_object_unref(lp->cancellable);
+    g_free(lp);
+}
+
+static gboolean deliver_page(gpointer data) {
+    LoadedPage *lp = (LoadedPage*)data;
+    // Nothing arrives after the caller cancelled
+    if (!g_cancellable_is_cancelled(lp->cancellable)) {
+        lp->page_func(lp->page, lp->index, lp->page_count, lp->current_page, lp->page_data);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void relay_page(LoadJob *job, Page *page, int index, int page_count, int current_page) {
+    LoadedPage *lp = g_new0(LoadedPage, 1);
+    lp->page_func = job->page_func;
+    lp->page_data = job->page_data;
+    lp->cancellable = job->cancellable ? g_object_ref(job->cancellable) : NULL;
+    lp->page = page;
+    lp->index = index;
+    lp->page_count = page_count;
+    lp->current_page = current_page;
+    g_main_context_invoke_full(job->context, G_PRIORITY_DEFAULT, deliver_page, lp, loaded_page_free);
+}
+
+// Byte ranges of the saved pages, found without building the JSON tree, so
+// the current page can be parsed before the others. Only the structure is
+// followed; the base64 image strings are skipped with memchr().
+typedef struct {
+    const char *p, *end;
+} JsonScan;
+
+static void scan_space(JsonScan *s) {
+    while (s->p < s->end && g_ascii_isspace(*s->p)) s->p++;
+}
+
+// Skips the string starting at s->p.
+static gboolean scan_string(JsonScan *s) {
+    const char *q = s->p + 1;
+    for (;;) {
+        q = memchr(q, '"', (gsize)(s->end - q));
+        if (!q) return FALSE;
+        // A quote preceded by an odd number of backslashes is escaped
+        const char *b = q;
+        while (b > s->p + 1 && b[-1] == '\\') b--;
+        if ((q - b) % 2 == 0) {
+            s->p = q + 1;
+            return TRUE;
+        }
+        q++;
+    }
+}
+
+// Skips one value of any kind.
+static gboolean scan_value(JsonScan *s) {
+    scan_space(s);
+    if (s->p >= s->end) return FALSE;
+    if (*s->p == '"') return scan_string(s);
+    if (*s->p == '{' || *s->p == '[') {
+        int depth = 0;
+        while (s->p < s->end) {
+            char c = *s->p;
+            if (c == '"') {
+                if (!scan_string(s)) return FALSE;
+                continue;
             }
+            s->p++;
+            if (c == '{' || c == '[') depth++;
+            else if ((c == '}' || c == ']') && --depth == 0) return TRUE;
         }
-        
-        // Load strokes
-        if (json_object_has_member(page_obj, "strokes")) {
-            JsonArray *strokes_array = json_object_get_array_member(page_obj, "strokes");
-            guint num_strokes = json_array_get_length(strokes_array);
-            
-            for (guint j = 0; j < num_strokes; j++) {
-                JsonNode *stroke_node = json_array_get_element(strokes_array, j);
-                if (!JSON_NODE_HOLDS_OBJECT(stroke_node)) continue;
-                
-                JsonObject *stroke_obj = json_node_get_object(stroke_node);
-                
-                // Load color and width
-                double r = json_object_get_double_member(stroke_obj, "r");
-                double g = json_object_get_double_member(stroke_obj, "g");
-                double b = json_object_get_double_member(stroke_obj, "b");
-                double a = json_object_get_double_member(stroke_obj, "a");
-                double width = json_object_get_double_member(stroke_obj, "width");
-                
-                Stroke *stroke = stroke_new(r, g, b, a, width);
-                
-                // Load points
-                if (json_object_has_member(stroke_obj, "points")) {
-                    JsonArray *points_array = json_object_get_array_member(stroke_obj, "points");
-                    guint num_points = json_array_get_length(points_array);
-                    
-                    for (guint k = 0; k < num_points; k++) {
-                        JsonNode *point_node = json_array_get_element(points_array, k);
-                        if (!JSON_NODE_HOLDS_OBJECT(point_node)) continue;
-                        
-                        JsonObject *point_obj = json_node_get_object(point_node);
-                        double px = json_object_get_double_member(point_obj, "x");
-                        double py = json_object_get_double_member(point_obj, "y");
-                        
-                        stroke_add_point(stroke, px, py);
-                    }
+        return FALSE;
+    }
+    while (s->p < s->end && *s->p != ',' && *s->p != '}' && *s->p != ']' && !g_ascii_isspace(*s->p)) s->p++;
+    return TRUE;
+}
+
+typedef struct {
+    const char *data;
+    gsize len;
+} JsonSlice;
+
+// Fills pages with the object elements of the top-level "pages" array and
+// reads "current_page" (0 if missing).
+static gboolean scan_document(const char *data, gsize len, GArray *pages, gint64 *current_page, GError **error) {
+    TRACE_SCOPE("document.scan");
+    JsonScan s = { data, data + len };
+    gboolean have_pages = FALSE;
+    *current_page = 0;
+    scan_space(&s);
+    if (s.p >= s.end || *s.p != '{') goto invalid;
+    s.p++;
+    for (;;) {
+        scan_space(&s);
+        if (s.p < s.end && *s.p == '}') break;
+        if (s.p >= s.end || *s.p != '"') goto invalid;
+        const char *key = s.p + 1;
+        if (!scan_string(&s)) goto invalid;
+        gsize key_len = (gsize)(s.p - 1 - key);
+        scan_space(&s);
+        if (s.p >= s.end || *s.p != ':') goto invalid;
+        s.p++;
+        scan_space(&s);
+        if (key_len == 5 && memcmp(key, "pages", 5) == 0 && s.p < s.end && *s.p == '[') {
+            have_pages = TRUE;
+            s.p++;
+            for (;;) {
+                scan_space(&s);
+                if (s.p < s.end && *s.p == ']') { s.p++; break; }
+                const char *element = s.p;
+                if (!scan_value(&s)) goto invalid;
+                // Malformed entries are skipped, as by page_objects()
+                if (*element == '{') {
+                    JsonSlice slice = { element, (gsize)(s.p - element) };
+                    g_array_append_val(pages, slice);
                 }
-                
-                // Add to page
-                page->strokes = g_list_append(page->strokes, stroke);
+                scan_space(&s);
+                if (s.p < s.end && *s.p == ',') s.p++;
+            }
+        } else {
+            if (key_len == 12 && memcmp(key, "current_page", 12) == 0) {
+                gchar *number = g_strndup(s.p, (gsize)MIN(s.end - s.p, 24));
+                *current_page = g_ascii_strtoll(number, NULL, 10);
+                g_free(number);
             }
+            if (!scan_value(&s)) goto invalid;
         }
-        
-        g_ptr_array_add(doc->pages, page);
-    }
-    
-    // Ensure at least one page exists
-    if (doc->pages->len == 0) {
-        Page *default_page = g_new0(Page, 1);
-        default_page->items = NULL;
-        g_ptr_array_add(doc->pages, default_page);
+        scan_space(&s);
+        if (s.p < s.end && *s.p == ',') s.p++;
     }
-    
-    // Clamp current page index
-    if (doc->current_page >= (int)doc->pages->len) {
-        doc->current_page = (int)doc->pages->len - 1;
+    if (!have_pages) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Missing pages array");
+        return FALSE;
     }
-    if (doc->current_page < 0) {
-        doc->current_page = 0;
+    return TRUE;
+
+invalid:
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid JSON format");
+    return FALSE;
+}
+
+static Page *page_from_slice(const JsonSlice *slice) {
+    JsonParser *parser = json_parser_new();
+    Page *page = NULL;
+    if (json_parser_load_from_data(parser, slice->data, (gssize)slice->len, NULL)) {
+        JsonNode *root = json_parser_get_root(parser);
+        if (root && JSON_NODE_HOLDS_OBJECT(root)) page = page_from_json(json_node_get_object(root));
     }
-    
     g_object_unref(parser);
-    return doc;
+    return page ? page : page_new();
+}
+
+static void load_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    (void)source_object;
+    LoadJob *job = (LoadJob*)task_data;
+    TRACE_SCOPE("document.load_async");
+    GError *error = NULL;
+    GMappedFile *file = g_mapped_file_new(job->filepath, FALSE, &error);
+    if (!file) {
+        g_task_return_error(task, error);
+        return;
+    }
+    GArray *slices = g_array_new(FALSE, FALSE, sizeof(JsonSlice));
+    gint64 saved_current = 0;
+    const char *data = g_mapped_file_get_contents(file);
+    if (!data || !scan_document(data, g_mapped_file_get_length(file), slices, &saved_current, &error)) {
+        if (!error) g_set_error(&error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid JSON format");
+        g_array_unref(slices);
+        g_mapped_file_unref(file);
+        g_task_return_error(task, error);
+        return;
+    }
+    int count = (int)MAX(slices->len, 1);
+    int current = (int)CLAMP(saved_current, 0, count - 1);
+
+    // The current page comes first, parsed on its own and with its images
+    // decoded so the first frame does not wait for them; then the others,
+    // nearest first.
+    for (int step = 0; step < 2 * count; step++) {
+        int index = current + (step % 2 ? (step + 1) / 2 : -(step / 2));
+        if (index < 0 || index >= count) continue;
+        if (g_cancellable_set_error_if_cancelled(cancellable, &error)) break;
+        Page *page = index < (int)slices->len ? page_from_slice(&g_array_index(slices, JsonSlice, index)) : page_new();
+        if (index == current) {
+            for (GList *l = page->items; l; l = l->next) image_source_preload(((ImageItem*)l->data)->source);
+        }
+        relay_page(job, page, index, count, current);
+    }
+
+    g_array_unref(slices);
+    g_mapped_file_unref(file);
+    if (error) g_task_return_error(task, error);
+    else g_task_return_boolean(task, TRUE);
+}
+
+void document_load_async(const char *filepath, GCancellable *cancellable, DocumentLoadPageFunc page_func,
+                         gpointer page_data, GAsyncReadyCallback callback, gpointer user_data) {
+    g_return_if_fail(filepath != NULL && page_func != NULL);
+    LoadJob *job = g_new0(LoadJob, 1);
+    job->filepath = g_strdup(filepath);
+    job->page_func = page_func;
+    job->page_data = page_data;
+    job->context = g_main_context_ref_thread_default();
+    job->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_source_tag(task, document_load_async);
+    g_task_set_task_data(task, job, load_job_free);
+    g_task_run_in_thread(task, load_thread);
+    g_object_unref(task);
+}
+
+gboolean document_load_finish(GAsyncResult *result, GError **error) {
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    return g_task_propagate_boolean(G_TASK(result), error);
 }
@@ -10,9 +10,29 @@ extern "C" {
 // Save a document to a JSON file
 gboolean document_save_to_file(Document *doc, const char *filepath, GError **error);
 
+// Approximate bytes the page takes in a file written by
+// document_save_to_file(), without encoding any image. Images that have no
+// compressed form yet are guessed at.
+gsize page_estimate_saved_size(Page *page);
+
 // Load a document from a JSON file
 Document *document_load_from_file(const char *filepath, GError **error);
 
+// Receives one page of a document being loaded by document_load_async(). The
+// page is borrowed; take a reference to keep it. page_count and current_page
+// are those of the saved document and are the same for every call.
+typedef void (*DocumentLoadPageFunc)(Page *page, int index, int page_count, int current_page, gpointer user_data);
+
+// Loads a document on a worker thread, handing over pages one by one in the
+// caller's thread-default main context: the saved current page first, with
+// its images already decoded, then the rest nearest first. Only the current
+// page is parsed before it is delivered; finding it takes one quick scan over
+// the file that skips the image data. No page is delivered after cancellable
+// fires. callback runs once all pages are sent.
+void document_load_async(const char *filepath, GCancellable *cancellable, DocumentLoadPageFunc page_func,
+                         gpointer page_data, GAsyncReadyCallback callback, gpointer user_data);
+gboolean document_load_finish(GAsyncResult *result, GError **error);
+
 // Get the default auto-save file path
 gchar *get_autosave_path(void);
 
@@ -0,0 +1,341 @@
+#include "thumbnails.h"
+#include "render.h"
+#include <math.h>
+
+// Thumbnail width in logical pixels; the height follows the A4 aspect ratio.
+#define THUMB_WIDTH 120.0
+#define THUMB_PAD 10.0
+#define THUMB_LABEL_H 16.0
+// Edits arrive every motion event; wait for a pause before re-rendering.
+#define THUMB_REFRESH_DELAY_MS 250
+
+struct _CheatThumbnails {
+    GtkDrawingArea parent_instance;
+    Document *doc;               // not owned
+
+    GHashTable *thumbs;          // page stamp -> cairo_surface_t*
+    GHashTable *pending;         // page stamps with a render job in flight
+    GPtrArray *shown;            // per row, the last thumbnail drawn (cairo_surface_t* or NULL)
+    guint refresh_id;
+    gint generation;             // bumped on set_document; stale jobs drop their result
+
+    // drag-to-reorder state
+    int press_row;               // -1 when no button is held
+    double press_y;
+    gboolean dragging;
+    int drop_slot;               // insertion point 0..n while dragging
+};
+
+G_DEFINE_TYPE(CheatThumbnails, cheat_thumbnails, GTK_TYPE_DRAWING_AREA)
+
+enum { SIGNAL_PAGE_ACTIVATED, SIGNAL_PAGE_MOVED, N_SIGNALS };
+static guint thumb_signals[N_SIGNALS];
+
+static double thumb_zoom(void) { return THUMB_WIDTH / A4_WIDTH_PT; }
+static double thumb_height(void) { return A4_HEIGHT_PT * thumb_zoom(); }
+static double row_height(void) { return thumb_height() + THUMB_LABEL_H + THUMB_PAD; }
+
+static int page_count(CheatThumbnails *self) { return self->doc ? document_page_count(self->doc) : 0; }
+
+static void surface_unref(gpointer surface) {
+    if (surface) cairo_surface_destroy((cairo_surface_t*)surface);
+}
+
+typedef struct {
+    CheatThumbnails *thumbs;     // strong ref, released on the main thread
+    Page *page;                  // strong ref; edits clone the page instead of touching it
+    guint stamp;
+    int scale;
+    gint generation;
+    cairo_surface_t *surface;    // result
+} ThumbJob;
+
+static gboolean thumb_deliver(gpointer data) {
+    ThumbJob *job = (ThumbJob*)data;
+    CheatThumbnails *self = job->thumbs;
+    if (self->thumbs && job->generation == self->generation) {
+        g_hash_table_remove(self->pending, GUINT_TO_POINTER(job->stamp));
+        if (job->surface) {
+            g_hash_table_replace(self->thumbs, GUINT_TO_POINTER(job->stamp), cairo_surface_reference(job->surface));
+            gtk_widget_queue_draw(GTK_WIDGET(self));
+        }
+    }
+    if (job->surface) cairo_surface_destroy(job->surface);
+    page_unref(job->page);
+    g_object_unref(self);
+    g_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+static void thumb_run(gpointer data) {
+    ThumbJob *job = (ThumbJob*)data;
+    job->surface = render_page_to_surface(job->page, thumb_zoom(), job->scale);
+    g_idle_add(thumb_deliver, job);
+}
+
+static void request_thumb(CheatThumbnails *self, Page *p) {
+    if (g_hash_table_contains(self->pending, GUINT_TO_POINTER(p->stamp))) return;
+    g_hash_table_add(self->pending, GUINT_TO_POINTER(p->stamp));
+    ThumbJob *job = g_new0(ThumbJob, 1);
+    job->thumbs = g_object_ref(self);
+    job->page = page_ref(p);
+    job->stamp = p->stamp;
+    job->scale = gtk_widget_get_scale_factor(GTK_WIDGET(self));
+    job->generation = self->generation;
+    render_run_async(thumb_run, job);
+}
+
+// Drop thumbnails of page versions that are no longer in the document.
+static void prune_thumbs(CheatThumbnails *self) {
+    GHashTable *live = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (int i = 0; i < page_count(self); i++) {
+        Page *p = (Page*)g_ptr_array_index(self->doc->pages, i);
+        g_hash_table_add(live, GUINT_TO_POINTER(p->stamp));
+    }
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, self->thumbs);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (!g_hash_table_contains(live, key)) g_hash_table_iter_remove(&iter);
+    }
+    g_hash_table_unref(live);
+}
+
+static void update_size(CheatThumbnails *self) {
+    int n = page_count(self);
+    gtk_widget_set_size_request(GTK_WIDGET(self), (int)ceil(THUMB_WIDTH + 2 * THUMB_PAD),
+                                (int)ceil(n * row_height() + THUMB_PAD));
+    if (self->shown->len > (guint)n) g_ptr_array_set_size(self->shown, n);
+    while (self->shown->len < (guint)n) g_ptr_array_add(self->shown, NULL);
+}
+
+static gboolean refresh_timeout(gpointer data) {
+    CheatThumbnails *self = CHEAT_THUMBNAILS(data);
+    self->refresh_id = 0;
+    prune_thumbs(self);
+    gtk_widget_queue_draw(GTK_WIDGET(self));
+    return G_SOURCE_REMOVE;
+}
+
+static void draw_row(CheatThumbnails *self, cairo_t *cr, int i, gboolean current) {
+    Page *p = (Page*)g_ptr_array_index(self->doc->pages, i);
+    double x = THUMB_PAD, y = THUMB_PAD + i * row_height();
+    double tw = THUMB_WIDTH, th = thumb_height();
+
+    cairo_surface_t *thumb = (cairo_surface_t*)g_hash_table_lookup(self->thumbs, GUINT_TO_POINTER(p->stamp));
+    if (thumb) {
+        if (g_ptr_array_index(self->shown, i) != thumb) {
+            surface_unref(g_ptr_array_index(self->shown, i));
+            g_ptr_array_index(self->shown, i) = cairo_surface_reference(thumb);
+        }
+    } else {
+        // Keep showing the previous version while the new one renders, but
+        // not while edits are still coming in
+        if (!self->refresh_id) request_thumb(self, p);
+        thumb = (cairo_surface_t*)g_ptr_array_index(self->shown, i);
+    }
+
+    // drop shadow
+    cairo_set_source_rgba(cr, 0, 0, 0, 0.25);
+    cairo_rectangle(cr, x + 3, y + 3, tw, th);
+    cairo_fill(cr);
+
+    if (thumb) {
+        cairo_set_source_surface(cr, thumb, x, y);
+        cairo_rectangle(cr, x, y, tw, th);
+        cairo_fill(cr);
+    } else {
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        cairo_rectangle(cr, x, y, tw, th);
+        cairo_fill(cr);
+    }
+
+    if (current) {
+        cairo_set_source_rgba(cr, 0.2, 0.6, 1.0, 0.9);
+        cairo_set_line_width(cr, 3.0);
+        cairo_rectangle(cr, x - 1.5, y - 1.5, tw + 3, th + 3);
+        cairo_stroke(cr);
+    }
+
+    // page number
+    gchar *label = g_strdup_printf("%d", i + 1);
+    cairo_text_extents_t ext;
+    cairo_set_font_size(cr, 11.0);
+    cairo_text_extents(cr, label, &ext);
+    cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
+    cairo_move_to(cr, x + (tw - ext.width) / 2.0 - ext.x_bearing, y + th + THUMB_LABEL_H - 3);
+    cairo_show_text(cr, label);
+    g_free(label);
+}
+
+static gboolean on_draw(GtkWidget *w, cairo_t *cr, gpointer user_data) {
+    (void)user_data;
+    CheatThumbnails *self = CHEAT_THUMBNAILS(w);
+    int n = page_count(self);
+    if (n == 0) return FALSE;
+    if (self->shown->len != (guint)n) update_size(self);
+
+    // Only rows inside the exposed area; the strip sits in a scrolled window
+    double x1, y1, x2, y2;
+    cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+    int first = CLAMP((int)floor((y1 - THUMB_PAD) / row_height()), 0, n - 1);
+    int last = CLAMP((int)floor((y2 - THUMB_PAD) / row_height()), 0, n - 1);
+    for (int i = first; i <= last; i++) draw_row(self, cr, i, i == self->doc->current_page);
+
+    if (self->dragging) {
+        double y = THUMB_PAD / 2.0 + self->drop_slot * row_height();
+        cairo_set_source_rgba(cr, 0.2, 0.6, 1.0, 0.9);
+        cairo_set_line_width(cr, 3.0);
+        cairo_move_to(cr, THUMB_PAD / 2.0, y);
+        cairo_line_to(cr, THUMB_WIDTH + THUMB_PAD * 1.5, y);
+        cairo_stroke(cr);
+    }
+    return FALSE;
+}
+
+static int row_at(CheatThumbnails *self, double y) {
+    int n = page_count(self);
+    int row = (int)floor((y - THUMB_PAD / 2.0) / row_height());
+    return (row >= 0 && row < n) ? row : -1;
+}
+
+static gboolean on_button_press(GtkWidget *w, GdkEventButton *ev, gpointer user_data) {
+    (void)user_data;
+    CheatThumbnails *self = CHEAT_THUMBNAILS(w);
+    if (ev->button != GDK_BUTTON_PRIMARY || ev->type != GDK_BUTTON_PRESS) return FALSE;
+    self->press_row = row_at(self, ev->y);
+    self->press_y = ev->y;
+    self->dragging = FALSE;
+    return self->press_row >= 0;
+}
+
+static gboolean on_motion(GtkWidget *w, GdkEventMotion *ev, gpointer user_data) {
+    (void)user_data;
+    CheatThumbnails *self = CHEAT_THUMBNAILS(w);
+    if (self->press_row < 0) return FALSE;
+    if (!self->dragging && fabs(ev->y - self->press_y) < 8.0) return TRUE;
+    self->dragging = TRUE;
+    int slot = (int)floor((ev->y - THUMB_PAD / 2.0) / row_height() + 0.5);
+    self->drop_slot = CLAMP(slot, 0, page_count(self));
+    gtk_widget_queue_draw(w);
+    return TRUE;
+}
+
+// Move the page at index from to index to, one neighbour swap at a time.
+static void move_page(Document *doc, int from, int to) {
+    doc->current_page = from;
+    while (doc->current_page > to) document_move_page_up(doc);
+    while (doc->current_page < to) document_move_page_down(doc);
+}
+
+static gboolean on_button_release(GtkWidget *w, GdkEventButton *ev, gpointer user_data) {
+    (void)user_data;
+    CheatThumbnails *self = CHEAT_THUMBNAILS(w);
+    if (ev->button != GDK_BUTTON_PRIMARY || self->press_row < 0) return FALSE;
+    int from = self->press_row;
+    self->press_row = -1;
+
+    if (!self->dragging) {
+        g_signal_emit(self, thumb_signals[SIGNAL_PAGE_ACTIVATED], 0, from);
+        gtk_widget_queue_draw(w);
+        return TRUE;
+    }
+
+    self->dragging = FALSE;
+    // Slots are gaps between rows; dropping below itself lands one row higher
+    int to = self->drop_slot > from ? self->drop_slot - 1 : self->drop_slot;
+    if (to != from && self->doc) {
+        move_page(self->doc, from, to);
+        // Rows keep their thumbnails; they are looked up by stamp again
+        g_ptr_array_set_size(self->shown, 0);
+        update_size(self);
+        g_signal_emit(self, thumb_signals[SIGNAL_PAGE_MOVED], 0, from, to);
+    }
+    gtk_widget_queue_draw(w);
+    return TRUE;
+}
+
+static void cheat_thumbnails_init(CheatThumbnails *self) {
+    self->doc = NULL;
+    self->thumbs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, surface_unref);
+    self->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+    self->shown = g_ptr_array_new_with_free_func(surface_unref);
+    self->refresh_id = 0;
+    self->generation = 0;
+    self->press_row = -1;
+    self->dragging = FALSE;
+    self->drop_slot = 0;
+    gtk_widget_add_events(GTK_WIDGET(self), GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK |
+                                              GDK_BUTTON_MOTION_MASK);
+    g_signal_connect(self, "draw", G_CALLBACK(on_draw), NULL);
+    g_signal_connect(self, "button-press-event", G_CALLBACK(on_button_press), NULL);
+    g_signal_connect(self, "button-release-event", G_CALLBACK(on_button_release), NULL);
+    g_signal_connect(self, "motion-notify-event", G_CALLBACK(on_motion), NULL);
+}
+
+static void cheat_thumbnails_dispose(GObject *obj) {
+    CheatThumbnails *self = CHEAT_THUMBNAILS(obj);
+    self->doc = NULL;
+    if (self->refresh_id) {
+        g_source_remove(self->refresh_id);
+        self->refresh_id = 0;
+    }
+    g_clear_pointer(&self->thumbs, g_hash_table_unref);
+    g_clear_pointer(&self->pending, g_hash_table_unref);
+    g_clear_pointer(&self->shown, g_ptr_array_unref);
+    G_OBJECT_CLASS(cheat_thumbnails_parent_class)->dispose(obj);
+}
+
+static void cheat_thumbnails_class_init(CheatThumbnailsClass *klass) {
+    GObjectClass *gobj_class = G_OBJECT_CLASS(klass);
+    gobj_class->dispose = cheat_thumbnails_dispose;
+
+    thumb_signals[SIGNAL_PAGE_ACTIVATED] = g_signal_new("page-activated", G_TYPE_FROM_CLASS(klass),
+                                                        G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
+                                                        G_TYPE_NONE, 1, G_TYPE_INT);
+    thumb_signals[SIGNAL_PAGE_MOVED] = g_signal_new("page-moved", G_TYPE_FROM_CLASS(klass),
+                                                    G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
+                                                    G_TYPE_NONE, 2, G_TYPE_INT, G_TYPE_INT);
+}
+
+GtkWidget *cheat_thumbnails_new(Document *doc) {
+    CheatThumbnails *self = g_object_new(CHEAT_TYPE_THUMBNAILS, NULL);
+    cheat_thumbnails_set_document(self, doc);
+    return GTK_WIDGET(self);
+}
+
+void cheat_thumbnails_set_document(CheatThumbnails *self, Document *doc) {
+    g_return_if_fail(CHEAT_IS_THUMBNAILS(self));
+    if (self->doc != doc) {
+        self->generation++;
+        g_hash_table_remove_all(self->thumbs);
+        g_hash_table_remove_all(self->pending);
+        g_ptr_array_set_size(self->shown, 0);
+    }
+    self->doc = doc;
+    update_size(self);
+    gtk_widget_queue_draw(GTK_WIDGET(self));
+}
+
+gsize cheat_thumbnails_get_cache_bytes(CheatThumbnails *self) {
+    g_return_val_if_fail(CHEAT_IS_THUMBNAILS(self), 0);
+    if (!self->thumbs) return 0;
+    gsize bytes = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, self->thumbs);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        cairo_surface_t *s = (cairo_surface_t*)value;
+        bytes += (gsize)cairo_image_surface_get_stride(s) * (gsize)cairo_image_surface_get_height(s);
+    }
+    return bytes;
+}
+
+void cheat_thumbnails_refresh(CheatThumbnails *self) {
+    g_return_if_fail(CHEAT_IS_THUMBNAILS(self));
+    update_size(self);
+    if (self->refresh_id) g_source_remove(self->refresh_id);
+    self->refresh_id = g_timeout_add(THUMB_REFRESH_DELAY_MS, refresh_timeout, self);
+    // The current-page highlight and row layout update right away
+    gtk_widget_queue_draw(GTK_WIDGET(self));
+}
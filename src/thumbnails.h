@@ -0,0 +1,27 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "document.h"
+
+G_BEGIN_DECLS
+
+// Sidebar strip of page thumbnails. Thumbnails are rendered on the render
+// pool from references to the pages, so editing on the canvas never waits for
+// them, and are keyed by page stamp so only changed pages are redrawn.
+//
+// Signals:
+//   "page-activated" (int index)       a thumbnail was clicked
+//   "page-moved"     (int from, int to) a thumbnail was dragged; the document
+//                                       has already been reordered and its
+//                                       current page is the moved page
+#define CHEAT_TYPE_THUMBNAILS (cheat_thumbnails_get_type())
+G_DECLARE_FINAL_TYPE(CheatThumbnails, cheat_thumbnails, CHEAT, THUMBNAILS, GtkDrawingArea)
+
+GtkWidget *cheat_thumbnails_new(Document *doc);
+void cheat_thumbnails_set_document(CheatThumbnails *self, Document *doc);
+// Call after pages were edited, added, removed or reordered. Cheap and safe
+// to call on every edit; re-rendering is deferred until edits pause.
+void cheat_thumbnails_refresh(CheatThumbnails *self);
+// Bytes of thumbnail bitmaps held.
+gsize cheat_thumbnails_get_cache_bytes(CheatThumbnails *self);
+
+G_END_DECLS
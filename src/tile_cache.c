@@ -0,0 +1,154 @@
+#include "tile_cache.h"
+#include "render.h"
+#include "trace.h"
+#include <math.h>
+
+typedef struct {
+    TileKey key;
+    cairo_surface_t *surface;   // NULL until the first render lands
+    gboolean valid;             // surface matches the page
+    gboolean pending;           // a render is in flight
+    guint serial;               // bumped on invalidation
+    GList link;                 // in TileCache.lru, data points back here
+} TileEntry;
+
+struct _TileCache {
+    GHashTable *entries;        // TileKey* -> TileEntry*
+    GQueue lru;                 // most recently used at head
+    gsize bytes;
+    gsize max_bytes;
+    guint next_serial;
+};
+
+static guint tile_key_hash(gconstpointer p) {
+    const TileKey *k = (const TileKey*)p;
+    guint h = k->uid;
+    h = h * 31u + (guint)k->tx;
+    h = h * 31u + (guint)k->ty;
+    h = h * 31u + (guint)k->scale;
+    h = h * 31u + (guint)(k->zoom * 1000.0);
+    return h;
+}
+
+static gboolean tile_key_equal(gconstpointer a, gconstpointer b) {
+    const TileKey *x = (const TileKey*)a, *y = (const TileKey*)b;
+    return x->uid == y->uid && x->zoom == y->zoom && x->scale == y->scale && x->tx == y->tx && x->ty == y->ty;
+}
+
+static gsize surface_bytes(cairo_surface_t *surface) {
+    if (!surface) return 0;
+    return (gsize)cairo_image_surface_get_stride(surface) * (gsize)cairo_image_surface_get_height(surface);
+}
+
+static void entry_free(gpointer data) {
+    TileEntry *e = (TileEntry*)data;
+    if (e->surface) cairo_surface_destroy(e->surface);
+    g_free(e);
+}
+
+TileCache *tile_cache_new(gsize max_bytes) {
+    TileCache *cache = g_new0(TileCache, 1);
+    cache->entries = g_hash_table_new_full(tile_key_hash, tile_key_equal, NULL, entry_free);
+    g_queue_init(&cache->lru);
+    cache->max_bytes = max_bytes;
+    cache->next_serial = 1;
+    return cache;
+}
+
+void tile_cache_free(TileCache *cache) {
+    if (!cache) return;
+    tile_cache_clear(cache);
+    g_hash_table_unref(cache->entries);
+    g_free(cache);
+}
+
+static void remove_entry(TileCache *cache, TileEntry *e) {
+    g_queue_unlink(&cache->lru, &e->link);
+    cache->bytes -= surface_bytes(e->surface);
+    g_hash_table_remove(cache->entries, &e->key);
+}
+
+static void touch(TileCache *cache, TileEntry *e) {
+    g_queue_unlink(&cache->lru, &e->link);
+    g_queue_push_head_link(&cache->lru, &e->link);
+}
+
+static void enforce_budget(TileCache *cache, TileEntry *keep) {
+    GList *l = cache->lru.tail;
+    while (cache->bytes > cache->max_bytes && l) {
+        GList *prev = l->prev;
+        TileEntry *e = (TileEntry*)l->data;
+        if (e != keep) remove_entry(cache, e);
+        l = prev;
+    }
+}
+
+cairo_surface_t *tile_cache_lookup(TileCache *cache, const TileKey *key, gboolean *valid) {
+    g_return_val_if_fail(cache != NULL && key != NULL, NULL);
+    TileEntry *e = (TileEntry*)g_hash_table_lookup(cache->entries, key);
+    if (valid) *valid = e && e->valid;
+    if (!e) return NULL;
+    touch(cache, e);
+    return e->surface;
+}
+
+guint tile_cache_begin_render(TileCache *cache, const TileKey *key) {
+    g_return_val_if_fail(cache != NULL && key != NULL, 0);
+    TileEntry *e = (TileEntry*)g_hash_table_lookup(cache->entries, key);
+    if (!e) {
+        e = g_new0(TileEntry, 1);
+        e->key = *key;
+        e->serial = cache->next_serial++;
+        e->link.data = e;
+        g_hash_table_insert(cache->entries, &e->key, e);
+        g_queue_push_head_link(&cache->lru, &e->link);
+    }
+    if (e->pending) return 0;
+    e->pending = TRUE;
+    return e->serial;
+}
+
+void tile_cache_finish_render(TileCache *cache, const TileKey *key, guint serial, cairo_surface_t *surface) {
+    g_return_if_fail(cache != NULL && key != NULL);
+    TileEntry *e = (TileEntry*)g_hash_table_lookup(cache->entries, key);
+    if (!e) return;
+    e->pending = FALSE;
+    if (e->serial != serial || !surface) return;
+    cache->bytes -= surface_bytes(e->surface);
+    if (e->surface) cairo_surface_destroy(e->surface);
+    e->surface = cairo_surface_reference(surface);
+    e->valid = TRUE;
+    cache->bytes += surface_bytes(surface);
+    touch(cache, e);
+    enforce_budget(cache, e);
+    trace_counter("tiles.cache_bytes", (gint64)cache->bytes);
+}
+
+void tile_cache_invalidate(TileCache *cache, guint uid, double x, double y, double w, double h) {
+    g_return_if_fail(cache != NULL);
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, cache->entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        TileEntry *e = (TileEntry*)value;
+        if (e->key.uid != uid) continue;
+        // tile bounds in page points
+        double size = RENDER_TILE_SIZE / (e->key.scale * e->key.zoom);
+        double tx0 = e->key.tx * size, ty0 = e->key.ty * size;
+        if (tx0 >= x + w || ty0 >= y + h || tx0 + size <= x || ty0 + size <= y) continue;
+        e->valid = FALSE;
+        e->serial = cache->next_serial++;
+    }
+}
+
+void tile_cache_clear(TileCache *cache) {
+    g_return_if_fail(cache != NULL);
+    g_queue_init(&cache->lru);
+    g_hash_table_remove_all(cache->entries);
+    cache->bytes = 0;
+}
+
+gsize tile_cache_get_bytes(TileCache *cache) {
+    g_return_val_if_fail(cache != NULL, 0);
+    return cache->bytes;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "document.h"
+
+G_BEGIN_DECLS
+
+// Bitmaps of fixed-size tiles of a page at one zoom, used when the whole page
+// bitmap would be too large to cache. Tiles are keyed by page uid so they
+// survive edits elsewhere on the page; edits must report the page area they
+// touch with tile_cache_invalidate(). Only used from the main thread.
+typedef struct _TileCache TileCache;
+
+typedef struct {
+    guint uid;                  // Page.uid
+    double zoom;
+    int scale;                  // device scale
+    int tx, ty;                 // tile column and row
+} TileKey;
+
+TileCache *tile_cache_new(gsize max_bytes);
+void tile_cache_free(TileCache *cache);
+
+// Returns a borrowed bitmap of the tile or NULL. A bitmap from before the
+// last invalidation is still returned, with *valid set to FALSE, so it can be
+// shown until its replacement is ready.
+cairo_surface_t *tile_cache_lookup(TileCache *cache, const TileKey *key, gboolean *valid);
+// Marks the tile as being rendered. Returns the serial to pass to
+// tile_cache_finish_render(), or 0 if a render is already in flight.
+guint tile_cache_begin_render(TileCache *cache, const TileKey *key);
+// Stores a rendered tile (surface may be NULL if rendering was skipped). The
+// result is dropped if the tile was invalidated or evicted since it started.
+void tile_cache_finish_render(TileCache *cache, const TileKey *key, guint serial, cairo_surface_t *surface);
+
+// Invalidate the tiles of page uid at every zoom that intersect the given
+// rectangle in page points.
+void tile_cache_invalidate(TileCache *cache, guint uid, double x, double y, double w, double h);
+void tile_cache_clear(TileCache *cache);
+// Bytes of tile bitmaps held.
+gsize tile_cache_get_bytes(TileCache *cache);
+
+G_END_DECLS
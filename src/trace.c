@@ -0,0 +1,140 @@
+#include "trace.h"
+#include <errno.h>
+#include <stdio.h>
+
+typedef struct {
+    const char *name;
+    char phase;                 // 'X' complete span, 'C' counter
+    gint64 ts;                  // monotonic microseconds
+    gint64 value;               // duration for spans, sample for counters
+} TraceEvent;
+
+// Each thread appends to its own buffer, so recording threads never wait on
+// each other; the buffer lock is only contended while trace_stop() writes.
+// Buffers live as long as the process since threads keep pointers to them.
+typedef struct {
+    GMutex lock;
+    GArray *events;             // TraceEvent
+    int tid;
+} TraceBuffer;
+
+gint trace_recording = 0;
+
+static GMutex trace_lock;       // guards everything below
+static GPtrArray *buffers;      // TraceBuffer*
+static gchar *trace_path;
+static gint64 trace_origin;
+static int main_tid;
+static int next_tid = 1;
+static GPrivate thread_buffer;
+
+static TraceBuffer *get_thread_buffer(void) {
+    TraceBuffer *buf = g_private_get(&thread_buffer);
+    if (buf) return buf;
+    buf = g_new0(TraceBuffer, 1);
+    g_mutex_init(&buf->lock);
+    buf->events = g_array_new(FALSE, FALSE, sizeof(TraceEvent));
+    g_mutex_lock(&trace_lock);
+    buf->tid = next_tid++;
+    if (!buffers) buffers = g_ptr_array_new();
+    g_ptr_array_add(buffers, buf);
+    g_mutex_unlock(&trace_lock);
+    g_private_set(&thread_buffer, buf);
+    return buf;
+}
+
+static void record(const char *name, char phase, gint64 ts, gint64 value) {
+    if (!trace_enabled()) return;
+    TraceBuffer *buf = get_thread_buffer();
+    TraceEvent ev = { name, phase, ts, value };
+    g_mutex_lock(&buf->lock);
+    g_array_append_val(buf->events, ev);
+    g_mutex_unlock(&buf->lock);
+}
+
+void trace_record_span(const char *name, gint64 start, gint64 end) {
+    record(name, 'X', start, end - start);
+}
+
+void trace_counter(const char *name, gint64 value) {
+    if (!trace_enabled()) return;
+    record(name, 'C', g_get_monotonic_time(), value);
+}
+
+gboolean trace_start(const char *path) {
+    g_return_val_if_fail(path != NULL, FALSE);
+    TraceBuffer *own = get_thread_buffer();
+    g_mutex_lock(&trace_lock);
+    if (trace_path) {
+        g_mutex_unlock(&trace_lock);
+        return FALSE;
+    }
+    // Leftovers of spans that ended after the previous recording stopped
+    for (guint i = 0; i < buffers->len; i++) {
+        TraceBuffer *buf = g_ptr_array_index(buffers, i);
+        g_mutex_lock(&buf->lock);
+        g_array_set_size(buf->events, 0);
+        g_mutex_unlock(&buf->lock);
+    }
+    trace_path = g_strdup(path);
+    trace_origin = g_get_monotonic_time();
+    main_tid = own->tid;
+    g_atomic_int_set(&trace_recording, 1);
+    g_mutex_unlock(&trace_lock);
+    return TRUE;
+}
+
+static void write_name(FILE *f, const char *name) {
+    fputc('"', f);
+    for (const char *p = name; *p; p++) {
+        if (*p == '"' || *p == '\\') fputc('\\', f);
+        if ((guchar)*p >= 0x20) fputc(*p, f);
+    }
+    fputc('"', f);
+}
+
+static void write_events(FILE *f, TraceBuffer *buf, gboolean *first) {
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s%d\"}}",
+            *first ? "" : ",", buf->tid, buf->tid == main_tid ? "main " : "worker ", buf->tid);
+    *first = FALSE;
+    for (guint i = 0; i < buf->events->len; i++) {
+        TraceEvent *ev = &g_array_index(buf->events, TraceEvent, i);
+        fputs(",\n{\"name\":", f);
+        write_name(f, ev->name);
+        if (ev->phase == 'X') {
+            fprintf(f, ",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":%d}",
+                    ev->ts - trace_origin, ev->value, buf->tid);
+        } else {
+            fprintf(f, ",\"ph\":\"C\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":%d,\"args\":{\"value\":%" G_GINT64_FORMAT "}}",
+                    ev->ts - trace_origin, buf->tid, ev->value);
+        }
+    }
+    g_array_set_size(buf->events, 0);
+}
+
+gboolean trace_stop(void) {
+    g_mutex_lock(&trace_lock);
+    if (!trace_path) {
+        g_mutex_unlock(&trace_lock);
+        return TRUE;
+    }
+    g_atomic_int_set(&trace_recording, 0);
+    gboolean ok = FALSE;
+    FILE *f = fopen(trace_path, "w");
+    if (f) {
+        gboolean first = TRUE;
+        fputs("{\"traceEvents\":[", f);
+        for (guint i = 0; i < buffers->len; i++) {
+            TraceBuffer *buf = g_ptr_array_index(buffers, i);
+            g_mutex_lock(&buf->lock);
+            if (buf->events->len > 0 || buf->tid == main_tid) write_events(f, buf, &first);
+            g_mutex_unlock(&buf->lock);
+        }
+        fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+        ok = fclose(f) == 0;
+    }
+    if (!ok) g_warning("Cannot write trace to %s: %s", trace_path, g_strerror(errno));
+    g_clear_pointer(&trace_path, g_free);
+    g_mutex_unlock(&trace_lock);
+    return ok;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Trace-event recording in the Chrome JSON format; open the file in
+// ui.perfetto.dev or chrome://tracing. Recording is off unless trace_start()
+// is called (main does so for --trace FILE or CHEATSHEET_TRACE=FILE); while
+// off, a span or counter costs one atomic load. Event names must be string
+// literals or otherwise outlive the recording.
+
+// Starts recording into memory; the file is written by trace_stop(). Returns
+// FALSE if a recording is already running.
+gboolean trace_start(const char *path);
+// Stops recording and writes the file. Returns FALSE with a warning if the
+// file cannot be written; does nothing if no recording is running.
+gboolean trace_stop(void);
+
+extern gint trace_recording;
+static inline gboolean trace_enabled(void) { return g_atomic_int_get(&trace_recording) != 0; }
+
+typedef struct {
+    const char *name;
+    gint64 start;               // 0 if recording was off when it began
+} TraceSpan;
+
+void trace_record_span(const char *name, gint64 start, gint64 end);
+// Records a sample of a named value, shown as a counter track.
+void trace_counter(const char *name, gint64 value);
+
+static inline TraceSpan trace_span_begin(const char *name) {
+    TraceSpan span = { name, trace_enabled() ? g_get_monotonic_time() : 0 };
+    return span;
+}
+
+static inline void trace_span_end(TraceSpan *span) {
+    if (span->start) trace_record_span(span->name, span->start, g_get_monotonic_time());
+}
+
+// Span covering the rest of the enclosing block.
+#define TRACE_SCOPE(name) \
+    __attribute__((cleanup(trace_span_end))) TraceSpan G_PASTE(trace_scope_, __LINE__) = trace_span_begin(name)
+
+G_END_DECLS
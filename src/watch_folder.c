@@ -0,0 +1,199 @@
+#include "watch_folder.h"
+#include "image_io.h"
+#include "trace.h"
+
+typedef struct WatchBatch WatchBatch;
+
+typedef struct {
+    WatchBatch *batch;
+    gchar *path;
+    ImageSource *source;        // NULL until loaded, or if loading failed
+} WatchSlot;
+
+struct WatchBatch {
+    WatchFolder *watch;         // NULL once the watch is freed
+    WatchSlot *slots;
+    guint n_slots;
+    guint pending;              // slots still loading
+};
+
+struct _WatchFolder {
+    gchar *path;
+    GFileMonitor *monitor;
+    ImportPolicy policy;
+    WatchFolderFunc func;
+    gpointer user_data;
+    GCancellable *cancellable;
+    GPtrArray *incoming;        // paths of the batch being gathered, in order
+    GHashTable *seen;           // paths queued so far, so rewrites are not imported again
+    guint quiet_id;
+    guint max_delay_id;
+    GQueue batches;             // WatchBatch* loading or waiting for an older one, oldest first
+};
+
+static void watch_batch_free(WatchBatch *batch) {
+    for (guint i = 0; i < batch->n_slots; i++) {
+        g_free(batch->slots[i].path);
+        if (batch->slots[i].source) image_source_unref(batch->slots[i].source);
+    }
+    g_free(batch->slots);
+    g_free(batch);
+}
+
+// Hands over every finished batch that has no unfinished batch before it.
+static void deliver_batches(WatchFolder *watch) {
+    WatchBatch *batch;
+    while ((batch = (WatchBatch*)g_queue_peek_head(&watch->batches)) && batch->pending == 0) {
+        g_queue_pop_head(&watch->batches);
+        TRACE_SCOPE("watch.deliver");
+        GPtrArray *sources = g_ptr_array_sized_new(batch->n_slots);
+        for (guint i = 0; i < batch->n_slots; i++) {
+            if (batch->slots[i].source) g_ptr_array_add(sources, batch->slots[i].source);
+        }
+        if (sources->len > 0) watch->func((ImageSource * const *)sources->pdata, sources->len, watch->user_data);
+        g_ptr_array_unref(sources);
+        watch_batch_free(batch);
+    }
+}
+
+static void on_file_loaded(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    (void)source_object;
+    WatchSlot *slot = (WatchSlot*)user_data;
+    WatchBatch *batch = slot->batch;
+    GError *err = NULL;
+    slot->source = import_policy_finish(res, &err);
+    if (!slot->source && !g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_warning("Cannot import %s: %s", slot->path, err ? err->message : "unknown error");
+    }
+    g_clear_error(&err);
+    batch->pending--;
+    if (batch->watch) deliver_batches(batch->watch);
+    else if (batch->pending == 0) watch_batch_free(batch);
+}
+
+static void start_batch(WatchFolder *watch) {
+    g_clear_handle_id(&watch->quiet_id, g_source_remove);
+    g_clear_handle_id(&watch->max_delay_id, g_source_remove);
+    if (watch->incoming->len == 0) return;
+    WatchBatch *batch = g_new0(WatchBatch, 1);
+    batch->watch = watch;
+    batch->n_slots = watch->incoming->len;
+    batch->pending = batch->n_slots;
+    batch->slots = g_new0(WatchSlot, batch->n_slots);
+    for (guint i = 0; i < batch->n_slots; i++) {
+        batch->slots[i].batch = batch;
+        batch->slots[i].path = g_strdup((const gchar*)g_ptr_array_index(watch->incoming, i));
+    }
+    g_ptr_array_set_size(watch->incoming, 0);
+    g_queue_push_tail(&watch->batches, batch);
+    for (guint i = 0; i < batch->n_slots; i++) {
+        import_policy_load_file_async(&watch->policy, batch->slots[i].path, watch->cancellable, on_file_loaded,
+                                      &batch->slots[i]);
+    }
+}
+
+// Shared by both timers; whichever fires first starts the batch.
+static gboolean on_batch_timeout(gpointer user_data) {
+    WatchFolder *watch = (WatchFolder*)user_data;
+    start_batch(watch);
+    return G_SOURCE_REMOVE;
+}
+
+// Restarts the quiet period; the first event of a batch also starts the
+// maximum delay.
+static void schedule_batch(WatchFolder *watch) {
+    g_clear_handle_id(&watch->quiet_id, g_source_remove);
+    watch->quiet_id = g_timeout_add(WATCH_FOLDER_QUIET_MS, on_batch_timeout, watch);
+    if (!watch->max_delay_id) watch->max_delay_id = g_timeout_add(WATCH_FOLDER_MAX_DELAY_MS, on_batch_timeout, watch);
+}
+
+static void queue_file(WatchFolder *watch, GFile *file) {
+    gchar *path = g_file_get_path(file);
+    if (path && path_looks_like_image(path) && g_hash_table_add(watch->seen, g_strdup(path))) {
+        g_ptr_array_add(watch->incoming, g_strdup(path));
+        schedule_batch(watch);
+    }
+    g_free(path);
+}
+
+static void forget_file(WatchFolder *watch, GFile *file) {
+    gchar *path = g_file_get_path(file);
+    if (path) g_hash_table_remove(watch->seen, path);
+    g_free(path);
+}
+
+static void on_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other, GFileMonitorEvent event,
+                               gpointer user_data) {
+    (void)monitor;
+    WatchFolder *watch = (WatchFolder*)user_data;
+    switch (event) {
+    case G_FILE_MONITOR_EVENT_CREATED:
+        // Still being written; wait for the changes-done hint, but keep the
+        // batch open meanwhile
+        if (watch->incoming->len > 0) schedule_batch(watch);
+        break;
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+        queue_file(watch, file);
+        break;
+    case G_FILE_MONITOR_EVENT_RENAMED:
+        // Tools that write to a temporary name and rename it when done
+        forget_file(watch, file);
+        if (other) queue_file(watch, other);
+        break;
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+        forget_file(watch, file);
+        break;
+    default:
+        break;
+    }
+}
+
+WatchFolder *watch_folder_new(const char *path, const ImportPolicy *policy, WatchFolderFunc func, gpointer user_data,
+                              GError **error) {
+    g_return_val_if_fail(path != NULL && policy != NULL && func != NULL, NULL);
+    GFile *dir = g_file_new_for_path(path);
+    GFileMonitor *monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_WATCH_MOVES, NULL, error);
+    g_object_unref(dir);
+    if (!monitor) return NULL;
+
+    WatchFolder *watch = g_new0(WatchFolder, 1);
+    watch->path = g_strdup(path);
+    watch->monitor = monitor;
+    watch->policy = *policy;
+    watch->func = func;
+    watch->user_data = user_data;
+    watch->cancellable = g_cancellable_new();
+    watch->incoming = g_ptr_array_new_with_free_func(g_free);
+    watch->seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_queue_init(&watch->batches);
+    g_signal_connect(monitor, "changed", G_CALLBACK(on_monitor_changed), watch);
+    return watch;
+}
+
+void watch_folder_free(WatchFolder *watch) {
+    if (!watch) return;
+    g_signal_handlers_disconnect_by_data(watch->monitor, watch);
+    g_file_monitor_cancel(watch->monitor);
+    g_object_unref(watch->monitor);
+    g_clear_handle_id(&watch->quiet_id, g_source_remove);
+    g_clear_handle_id(&watch->max_delay_id, g_source_remove);
+    g_cancellable_cancel(watch->cancellable);
+    g_object_unref(watch->cancellable);
+    // Loads still in flight finish on their own and free their batch
+    WatchBatch *batch;
+    while ((batch = (WatchBatch*)g_queue_pop_head(&watch->batches))) {
+        if (batch->pending == 0) watch_batch_free(batch);
+        else batch->watch = NULL;
+    }
+    g_ptr_array_unref(watch->incoming);
+    g_hash_table_unref(watch->seen);
+    g_free(watch->path);
+    g_free(watch);
+}
+
+const char *watch_folder_get_path(WatchFolder *watch) {
+    g_return_val_if_fail(watch != NULL, NULL);
+    return watch->path;
+}
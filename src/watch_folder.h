@@ -0,0 +1,28 @@
+#pragma once
+#include <gtk/gtk.h>
+#include "import_policy.h"
+
+G_BEGIN_DECLS
+
+// Imports images as they appear in a directory, e.g. where a screenshot tool
+// saves them. New files are gathered until the directory has been quiet for
+// WATCH_FOLDER_QUIET_MS, or WATCH_FOLDER_MAX_DELAY_MS after the first one, so
+// a burst of files becomes one batch. Each batch is loaded on worker threads
+// through the import policy and handed over in one call. Batches and the files
+// in them keep the order the files appeared in. Only used from the main thread.
+typedef struct _WatchFolder WatchFolder;
+
+#define WATCH_FOLDER_QUIET_MS 400
+#define WATCH_FOLDER_MAX_DELAY_MS 3000
+
+// Receives the sources of one batch; files that failed to load are left out
+// with a warning. The array and the sources are borrowed.
+typedef void (*WatchFolderFunc)(ImageSource * const *sources, guint n_sources, gpointer user_data);
+
+WatchFolder *watch_folder_new(const char *path, const ImportPolicy *policy, WatchFolderFunc func, gpointer user_data,
+                              GError **error);
+// Stops watching. Batches still loading are dropped.
+void watch_folder_free(WatchFolder *watch);
+const char *watch_folder_get_path(WatchFolder *watch);
+
+G_END_DECLS